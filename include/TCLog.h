@@ -28,6 +28,8 @@ between Telechips and Company.
 
 #include <stdio.h>
 
+#include "TCLogConfig.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -40,17 +42,221 @@ typedef enum {
 	TotalTCLogLevels
 } TCLogLevel;
 
+typedef enum {
+	TCLogAsyncBlock,			// wait for the writer thread to free a slot
+	TCLogAsyncDropNewest,		// discard the line being logged
+	TCLogAsyncOverwriteOldest,	// discard the oldest queued line
+	TotalTCLogAsyncPolicies
+} TCLogAsyncPolicy;
+
+typedef enum {
+	TCLogClockRealtime,			// wall clock, default
+	TCLogClockRealtimeCoarse,	// wall clock at scheduler tick resolution, cheapest to read
+	TCLogClockMonotonic,		// seconds since boot, for latency analysis
+	TotalTCLogClocks
+} TCLogClock;
+
+typedef enum {
+	TCLogDurabilityNone,		// written at once, the kernel decides when it reaches the flash
+	TCLogDurabilityPeriodic,	// fdatasync() at least every sync interval while lines are pending
+	TCLogDurabilitySync,		// fdatasync() before the call returns
+	TotalTCLogDurabilities
+} TCLogDurability;
+
+typedef int TCLogCategory;
+
+typedef enum {
+	TCLogEventJson,				// one JSON object per line in the text log, default
+	TCLogEventTlv,				// compact records in the TCLogBinaryOpen() file, read with tclog-decode
+	TotalTCLogEventFormats
+} TCLogEventFormat;
+
+typedef enum {
+	TCLogFieldInt = 1,
+	TCLogFieldString,
+	TCLogFieldDouble,
+	TCLogFieldBytes
+} TCLogFieldType;
+
+typedef struct {
+	const char *key;
+	TCLogFieldType type;
+	long long i;
+	double d;
+	const void *p;				// string or bytes, not copied
+	unsigned int length;		// bytes only
+} TCLogField;
+
+#define TC_LOG_FIELD_INT(key, value)			{ (key), TCLogFieldInt, (long long)(value), 0.0, NULL, 0 }
+#define TC_LOG_FIELD_STRING(key, value)			{ (key), TCLogFieldString, 0, 0.0, (value), 0 }
+#define TC_LOG_FIELD_DOUBLE(key, value)			{ (key), TCLogFieldDouble, 0, (double)(value), NULL, 0 }
+#define TC_LOG_FIELD_BYTES(key, value, length)	{ (key), TCLogFieldBytes, 0, 0.0, (value), (length) }
+
+// the text is the formatted line, valid only during the call
+typedef void (*TCLogSinkCallback)(void *context, TCLogLevel level, const char *text, unsigned int length);
+
+#define TC_LOG_PRIMARY_SINK		0	// the TCRedirectLog() stream or the rotated files
+
+typedef struct TCLogger TCLogger;
+typedef struct TCLogReader TCLogReader;
+
+// a line read back with TCLogReaderNext(), the pointers stay valid until the next call
+typedef struct {
+	const char *text;			// the whole line without its new line, not NUL terminated
+	unsigned int length;
+	int level;					// TCLogLevel, -1 for lines without a header such as hex dump rows
+	const char *time;			// the stamp inside the brackets, NULL when the line has none
+	unsigned int timeLength;
+	const char *prefix;			// NULL when the line has no prefix
+	unsigned int prefixLength;
+	const char *subPrefix;		// the sub prefix or the tag, NULL when the line has none
+	unsigned int subPrefixLength;
+	const char *message;
+	unsigned int messageLength;
+} TCLogLine;
+
+#define TC_LOG_STATS_BUCKETS	32	// bucket n counts durations of [2^n, 2^(n+1)) nanoseconds
+
+// counters of the process wide log since start or TCLogResetStats(), TCLogger instances are not included
+typedef struct {
+	unsigned long lines[TotalTCLogLevels];		// lines handed to the output and the sinks, a hex dump counts per chunk
+	unsigned long bytes[TotalTCLogLevels];
+	unsigned long dropped[TotalTCLogLevels];	// lines the primary output could not take
+	unsigned long suppressed[TotalTCLogLevels];	// rate limited or collapsed as duplicates
+	unsigned long rotations;
+	unsigned long refused;						// file opens refused by the disk budget
+	unsigned long callLatency[TC_LOG_STATS_BUCKETS];	// only with TCLogSetStatsTiming()
+	unsigned long lockWait[TC_LOG_STATS_BUCKETS];		// an uncontended lock counts in bucket 0
+} TCLogStats;
+
 void TCLogInitialize(const char *prefix, const char *sub_prefix, int use_time);
 void TCEnableLog(int enable);
 FILE *TCRedirectLog(FILE *fp);
 void TCLogSetFileName(const char *name);
 void TCLogSetLevel(int level);
+void TCLogSetPersistentFile(int enable);
+void TCLogSetClock(TCLogClock clock);
+void TCLogSetMappedFile(int enable, unsigned int syncIntervalMs);
+int TCLogSetUringFile(int enable, unsigned int syncIntervalMs);
+int TCLogEnableThreadBuffers(unsigned int bufferSize, unsigned int flushIntervalMs);
+void TCLogDisableThreadBuffers(void);
+void TCLogFlushThreadBuffers(void);
 int TCLog(TCLogLevel level, const char *format, ...);
 int TCLogHex(TCLogLevel level, const void *buffer, unsigned int length, const char *title);
 int getFileLength(FILE *fp);
 double GetTotalFreeSpaceRate();
 FILE *TCLogFilePtr();
 int OpenFile(int year, int month, int day, int hour);
+int TCLogEnableAsync(unsigned int capacity, TCLogAsyncPolicy policy);
+void TCLogDisableAsync(void);
+void TCLogGetAsyncDropCounts(unsigned long *dropped, unsigned long *overwritten);
+int TCLogBinaryOpen(const char *path);
+void TCLogBinaryClose(void);
+int TCLogBinary(TCLogLevel level, const char *format, ...);
+TCLogCategory TCLogRegisterCategory(const char *name);
+int TCLogSetCategoryLevel(const char *name, int level);
+int TCLogCategoryEnabled(TCLogCategory category, TCLogLevel level);
+int TCLogC(TCLogCategory category, TCLogLevel level, const char *format, ...);
+int TCLogWatchCategoryConfig(const char *path);
+void TCLogUnwatchCategoryConfig(void);
+int TCLogSetRateLimit(unsigned int burst, unsigned int perSecond);
+int TCLogSetDuplicateCollapse(unsigned int windowSec);
+int TCLogSetHexDumpOptions(unsigned int maxBytes, int ascii, int deferred);
+int TCLogEnableCompression(int level);
+void TCLogDisableCompression(void);
+int TCLogSetDiskBudget(unsigned long long maxBytes, unsigned int maxFiles,
+					   unsigned int minFreePercent, unsigned int intervalSec);
+void TCLogStopDiskBudget(void);
+void TCLogSetIndexInterval(unsigned int intervalBytes);
+int TCLogConnectDaemon(const char *path, unsigned int ringBytes, TCLogAsyncPolicy policy);
+void TCLogDisconnectDaemon(void);
+TCLogReader *TCLogReaderOpen(const char *path);
+TCLogReader *TCLogReaderFollow(const char *name);
+int TCLogReaderNext(TCLogReader *reader, TCLogLine *line);
+int TCLogReaderWait(TCLogReader *reader, int timeoutMs);
+int TCLogReaderFd(const TCLogReader *reader);
+void TCLogReaderClose(TCLogReader *reader);
+void TCLogGetStats(TCLogStats *stats);
+void TCLogResetStats(void);
+void TCLogSetStatsTiming(int enable);
+int TCLogSetEventFormat(TCLogEventFormat format);
+int TCLogEvent(TCLogLevel level, const char *event, const TCLogField *fields, unsigned int count);
+int TCLogOpenFlightRecorder(const char *path, unsigned int size, int crashHandler);
+void TCLogCloseFlightRecorder(void);
+int TCLogSetDurability(TCLogLevel level, TCLogDurability policy, unsigned int syncIntervalMs);
+int TCLogAddStreamSink(FILE *fp, int level);
+int TCLogAddDatagramSink(const char *path, int level);
+int TCLogAddCallbackSink(TCLogSinkCallback callback, void *context, int level);
+int TCLogAddShippingSink(const char *path, int level, unsigned int queueBytes, TCLogAsyncPolicy policy);
+int TCLogSetSinkLevel(int sink, int level);
+int TCLogRemoveSink(int sink);
+TCLogger *TCLoggerCreate(const char *prefix, const char *subPrefix, int useTime);
+void TCLoggerDestroy(TCLogger *logger);
+TCLogger *TCLoggerDefault(void);
+FILE *TCLoggerRedirect(TCLogger *logger, FILE *fp);
+void TCLoggerSetFileName(TCLogger *logger, const char *name);
+void TCLoggerSetLevel(TCLogger *logger, int level);
+void TCLoggerSetPersistentFile(TCLogger *logger, int enable);
+void TCLoggerEnable(TCLogger *logger, int enable);
+int TCLoggerLog(TCLogger *logger, TCLogLevel level, const char *format, ...);
+int TCLoggerHex(TCLogger *logger, TCLogLevel level, const void *buffer, unsigned int length, const char *title);
+
+/*
+ * TC_LOG_* macros check the runtime level before any argument is evaluated,
+ * levels above TC_LOG_MIN_LEVEL compile to nothing.
+ */
+extern int tc_internal_logThreshold;
+
+#if defined(__GNUC__)
+#define TC_LOG_UNLIKELY(x)	__builtin_expect(!!(x), 0)
+#define TC_LOG_THRESHOLD()	__atomic_load_n(&tc_internal_logThreshold, __ATOMIC_RELAXED)
+#else
+#define TC_LOG_UNLIKELY(x)	(x)
+#define TC_LOG_THRESHOLD()	(*(volatile int *)&tc_internal_logThreshold)
+#endif
+
+#define TC_LOG_ENABLED(level)	TC_LOG_UNLIKELY(TC_LOG_THRESHOLD() >= (int)(level))
+
+#define TC_LOG_CALL(level, ...) \
+	do { if (TC_LOG_ENABLED(level)) (void)TCLog((level), __VA_ARGS__); } while (0)
+#define TC_LOG_HEX_CALL(level, buffer, length, title) \
+	do { if (TC_LOG_ENABLED(level)) (void)TCLogHex((level), (buffer), (length), (title)); } while (0)
+#define TC_LOG_NONE(level, ...) \
+	do { if (0) (void)TCLog((level), __VA_ARGS__); } while (0)
+#define TC_LOG_HEX_NONE(level, buffer, length, title) \
+	do { if (0) (void)TCLogHex((level), (buffer), (length), (title)); } while (0)
+
+#if TC_LOG_MIN_LEVEL >= TC_LOG_LEVEL_ERROR
+#define TC_LOG_ERROR(...)						TC_LOG_CALL(TCLogLevelError, __VA_ARGS__)
+#define TC_LOG_HEX_ERROR(buffer, length, title)	TC_LOG_HEX_CALL(TCLogLevelError, buffer, length, title)
+#else
+#define TC_LOG_ERROR(...)						TC_LOG_NONE(TCLogLevelError, __VA_ARGS__)
+#define TC_LOG_HEX_ERROR(buffer, length, title)	TC_LOG_HEX_NONE(TCLogLevelError, buffer, length, title)
+#endif
+
+#if TC_LOG_MIN_LEVEL >= TC_LOG_LEVEL_WARN
+#define TC_LOG_WARN(...)						TC_LOG_CALL(TCLogLevelWarn, __VA_ARGS__)
+#define TC_LOG_HEX_WARN(buffer, length, title)	TC_LOG_HEX_CALL(TCLogLevelWarn, buffer, length, title)
+#else
+#define TC_LOG_WARN(...)						TC_LOG_NONE(TCLogLevelWarn, __VA_ARGS__)
+#define TC_LOG_HEX_WARN(buffer, length, title)	TC_LOG_HEX_NONE(TCLogLevelWarn, buffer, length, title)
+#endif
+
+#if TC_LOG_MIN_LEVEL >= TC_LOG_LEVEL_INFO
+#define TC_LOG_INFO(...)						TC_LOG_CALL(TCLogLevelInfo, __VA_ARGS__)
+#define TC_LOG_HEX_INFO(buffer, length, title)	TC_LOG_HEX_CALL(TCLogLevelInfo, buffer, length, title)
+#else
+#define TC_LOG_INFO(...)						TC_LOG_NONE(TCLogLevelInfo, __VA_ARGS__)
+#define TC_LOG_HEX_INFO(buffer, length, title)	TC_LOG_HEX_NONE(TCLogLevelInfo, buffer, length, title)
+#endif
+
+#if TC_LOG_MIN_LEVEL >= TC_LOG_LEVEL_DEBUG
+#define TC_LOG_DEBUG(...)						TC_LOG_CALL(TCLogLevelDebug, __VA_ARGS__)
+#define TC_LOG_HEX_DEBUG(buffer, length, title)	TC_LOG_HEX_CALL(TCLogLevelDebug, buffer, length, title)
+#else
+#define TC_LOG_DEBUG(...)						TC_LOG_NONE(TCLogLevelDebug, __VA_ARGS__)
+#define TC_LOG_HEX_DEBUG(buffer, length, title)	TC_LOG_HEX_NONE(TCLogLevelDebug, buffer, length, title)
+#endif
 
 #ifdef __cplusplus
 }
@@ -24,6 +24,7 @@ between Telechips and Company.
 ****************************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <pthread.h>
 #include <unistd.h>
@@ -31,14 +32,22 @@ between Telechips and Company.
 #include <sys/vfs.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <pwd.h>
 
 #include "TCLog.h"
+#include "TCLogInternal.h"
 
 #define MAX_LOG_FILE_SIZE	10485760 // 10 MB
 #define MAX_STRING_SIZE		256
+#define HEX_HEADER_SIZE		512
+#define HEX_TRAILER_SIZE	64
+#define MAX_HEADER_SIZE		(MAX_STRING_SIZE * 2 + 32)
 
 static FILE *tc_internal_logFp = NULL;
+int tc_internal_logThreshold = -1;
 static pthread_mutex_t g_logMutex;
 static pthread_mutex_t* g_logMutexPtr = NULL;
 static char g_stringBuffer[5][MAX_STRING_SIZE];
@@ -52,7 +61,15 @@ static int g_enable = 0;
 static int g_use_time = 0;
 static int g_fileIndex = 0;
 static int g_fileHour = -1;
+static int g_fileDay = -1;
+static long g_fileBytes = 0;
+static int g_persistentFile = 0;
+static int g_mappedFile = 0;
+static int g_uringFile = 0;
 static int g_freeSpaceErrorCnt = 0;
+static int g_budgetBlocked = 0;
+static char g_levelHeaders[TotalTCLogLevels][MAX_HEADER_SIZE];
+static int g_levelHeaderLengths[TotalTCLogLevels];
 static const char *g_logLevelNames[TotalTCLogLevels] = {
 	"ERROR",
 	"WARN",
@@ -60,6 +77,19 @@ static const char *g_logLevelNames[TotalTCLogLevels] = {
 	"DEBUG"
 };
 
+static int FormatLogLine(char *buffer, size_t size, const TCLogTime *logTime, TCLogLevel level,
+						 const char *tag, int *messageOffset, const char *format, va_list va);
+static int FormatHeader(char *buffer, size_t size, TCLogLevel level, const char *tag);
+static void BuildLevelHeaders(void);
+static void BuildFilePath(int year, int month, int day, int hour);
+static int PrepareOutput(const TCLogTime *logTime, unsigned int length);
+static int PrepareMappedOutput(const TCLogTime *logTime, unsigned int length);
+static void CloseMappedFile(void);
+static int PrepareUringOutput(const TCLogTime *logTime, unsigned int length);
+static void CloseUringFile(void);
+static int RotateFile(const TCLogTime *logTime);
+static int EmitText(TCLogLevel level, const TCLogTime *logTime, const char *text, unsigned int length);
+
 void TCLogInitialize(const char *prefix, const char *sub_prefix, int use_time)
 {
 	int err;
@@ -67,14 +97,14 @@ void TCLogInitialize(const char *prefix, const char *sub_prefix, int use_time)
 
 	if (prefix != NULL)
 	{
-		g_prefix = (char *)&g_stringBuffer[2];
+		g_prefix = (char *)&g_stringBuffer[3];
 		memset(g_prefix, 0x00, MAX_STRING_SIZE);
 		strncpy(g_prefix, prefix, MAX_STRING_SIZE - 1);
 	}
 
 	if (sub_prefix != NULL)
 	{
-		g_sub_prefix = (char *)&g_stringBuffer[3];
+		g_sub_prefix = (char *)&g_stringBuffer[4];
 		memset(g_sub_prefix, 0x00, MAX_STRING_SIZE);
 		strncpy(g_sub_prefix, sub_prefix, MAX_STRING_SIZE - 1);
 	}
@@ -93,6 +123,7 @@ void TCLogInitialize(const char *prefix, const char *sub_prefix, int use_time)
 	}
 
 	g_use_time = (use_time != 0);
+	BuildLevelHeaders();
 
 	pw = getpwuid(getuid());
 	memset(g_fileDir, 0x00, MAX_STRING_SIZE);
@@ -112,6 +143,7 @@ void TCLogInitialize(const char *prefix, const char *sub_prefix, int use_time)
 void TCEnableLog(int enable)
 {
 	g_enable = enable;
+	TCLogUpdateThreshold();
 }
 
 FILE *TCRedirectLog(FILE *fp)
@@ -126,7 +158,10 @@ void TCLogSetFileName(const char *name)
 	if (name != NULL)
 	{
 		if (tc_internal_logFp != stdout && tc_internal_logFp != NULL)
+		{
 			fclose(tc_internal_logFp);
+			tc_internal_logFp = NULL;
+		}
 
 		memset(g_fileName, 0x00, MAX_STRING_SIZE);
 		strncpy(g_fileName, name, MAX_STRING_SIZE - 1);
@@ -137,11 +172,114 @@ void TCLogSetFileName(const char *name)
 	}
 }
 
+void TCLogSetPersistentFile(int enable)
+{
+	if (g_logMutexPtr != NULL)
+	{
+		(void)pthread_mutex_lock(g_logMutexPtr);
+		g_persistentFile = (enable != 0);
+		if (g_persistentFile == 0 && tc_internal_logFp != NULL && tc_internal_logFp != stdout)
+		{
+			fclose(tc_internal_logFp);
+			tc_internal_logFp = NULL;
+		}
+		(void)pthread_mutex_unlock(g_logMutexPtr);
+	}
+	else
+	{
+		fprintf(stderr, "%s: TCLogInitialize must be called first\n", __func__);
+	}
+}
+
+void TCLogSetMappedFile(int enable, unsigned int syncIntervalMs)
+{
+	if (g_logMutexPtr != NULL)
+	{
+		(void)pthread_mutex_lock(g_logMutexPtr);
+		if (tc_internal_logFp != NULL && tc_internal_logFp != stdout)
+		{
+			fclose(tc_internal_logFp);
+			tc_internal_logFp = NULL;
+		}
+		TCLogMappedClose();
+		TCLogMappedSetSyncInterval(syncIntervalMs);
+		g_mappedFile = (enable != 0);
+		(void)pthread_mutex_unlock(g_logMutexPtr);
+
+		if (g_mappedFile != 0)
+		{
+			static int registered = 0;
+
+			// trim the preallocated tail of the last segment on a normal exit
+			if (registered == 0 && atexit(CloseMappedFile) == 0)
+			{
+				registered = 1;
+			}
+		}
+	}
+	else
+	{
+		fprintf(stderr, "%s: TCLogInitialize must be called first\n", __func__);
+	}
+}
+
+int TCLogSetUringFile(int enable, unsigned int syncIntervalMs)
+{
+	int ret = 0;
+
+	if (g_logMutexPtr != NULL)
+	{
+		(void)pthread_mutex_lock(g_logMutexPtr);
+		if (tc_internal_logFp != NULL && tc_internal_logFp != stdout)
+		{
+			fclose(tc_internal_logFp);
+			tc_internal_logFp = NULL;
+		}
+		TCLogUringClose();
+		TCLogUringSetSyncInterval(syncIntervalMs);
+		if (enable != 0 && TCLogUringAvailable() != 0)
+		{
+			TCLogMappedClose();
+			g_mappedFile = 0;
+			g_uringFile = 1;
+		}
+		else
+		{
+			if (enable != 0)
+			{
+				fprintf(stderr, "%s: io_uring is not available, keep the stdio output\n", __func__);
+			}
+			TCLogUringShutdown();
+			g_uringFile = 0;
+		}
+		ret = g_uringFile;
+		(void)pthread_mutex_unlock(g_logMutexPtr);
+
+		if (g_uringFile != 0)
+		{
+			static int registered = 0;
+
+			// writes still in the kernel would be cancelled with the ring
+			if (registered == 0 && atexit(CloseUringFile) == 0)
+			{
+				registered = 1;
+			}
+		}
+	}
+	else
+	{
+		fprintf(stderr, "%s: TCLogInitialize must be called first\n", __func__);
+	}
+
+	return ret;
+}
+
 void TCLogSetLevel(int level)
 {
 	if (level >= TCLogLevelError && level < TotalTCLogLevels)
 	{
 		g_level = level;
+		TCLogUpdateThreshold();
 	}
 	else
 	{
@@ -150,138 +288,249 @@ void TCLogSetLevel(int level)
 }
 
 int TCLog(TCLogLevel level, const char *format, ...)
+{
+	int printLog;
+	va_list va;
+
+	va_start(va, format);
+	printLog = TCLogV(level, format, va);
+	va_end(va);
+
+	return printLog;
+}
+
+int TCLogV(TCLogLevel level, const char *format, va_list va)
 {
 	int	printLog = ((level >= TCLogLevelError) && (level <= g_level)) ? 1 : 0;
 	if ((g_enable != 0) && (printLog != 0))
 	{
-		int year, mon, day, hour, min, ms;
-		double second;
-		time_t timeNow;
-		va_list va;
+		printLog = TCLogTagV(level, g_sub_prefix, format, va);
+	}
+	else
+	{
+		TCLogRecordV(level, g_sub_prefix, format, va);
+		printLog = 0;
+	}
 
-		(void)pthread_mutex_lock(g_logMutexPtr);
-		struct timeval timeVal;
-		struct tm *tmData;
-		gettimeofday(&timeVal, NULL);
-		timeNow = timeVal.tv_sec;
-		ms = (int)(timeVal.tv_usec / 1000.0 + 0.5);
-		if (ms >= 1000)
-		{
-			timeNow++;
-			ms %= 1000;
-		}
+	return printLog;
+}
 
-		tmData = localtime(&timeNow);
+int TCLogTagV(TCLogLevel level, const char *tag, const char *format, va_list va)
+{
+	unsigned long long start = TCLogStatsStart();
+	unsigned int suppressed = 0;
+	int	printLog = ((level >= TCLogLevelError) && (level < TotalTCLogLevels)) ? 1 : 0;
+	if ((g_enable != 0) && (printLog != 0) && (TCLogStormAdmit(format, &suppressed) != 0))
+	{
+		TCLogTime logTime;
+		char lineBuffer[TC_LOG_LINE_SIZE];
+		char *text = lineBuffer;
+		int length;
+		int offset = 0;
+		va_list copy;
 
-		year = tmData->tm_year + 1900;
-		mon = tmData->tm_mon + 1;
-		day =  tmData->tm_mday;
-		hour = tmData->tm_hour;
-		min = tmData->tm_min;
-		second = tmData->tm_sec + ms / 1000.0;
+		TCLogThreadBufferGetTime(&logTime);
 
-		printLog = OpenFile(year, mon, day, hour);
+		if (suppressed > 0U)
+		{
+			(void)TCLogNote(level, &logTime, tag, "%u similar messages suppressed by rate limit\n", suppressed);
+		}
 
-		if (printLog != 0)
+		va_copy(copy, va);
+		length = FormatLogLine(lineBuffer, sizeof(lineBuffer), &logTime, level, tag, &offset, format, copy);
+		va_end(copy);
+
+		if (TCLogFlightEnabled() != 0)
 		{
-			if (g_use_time != 0)
-			{
-				fprintf(tc_internal_logFp, "[%d-%02d-%02d %02d:%02d:%02.03f]",
-						year, mon, day, hour, min, second);
-			}
+			TCLogFlightWrite(lineBuffer, (length < (int)sizeof(lineBuffer)) ? (unsigned int)length : sizeof(lineBuffer) - 1);
+		}
 
-			if (g_prefix != NULL && g_sub_prefix != NULL)
-			{
-				fprintf(tc_internal_logFp, "[%s][%s][%s] ",
-						g_logLevelNames[level], g_prefix, g_sub_prefix);
-			}
-			else if (g_prefix != NULL)
+		if (length >= (int)sizeof(lineBuffer))
+		{
+			if (TCLogAsyncEnabled() != 0)
 			{
-				fprintf(tc_internal_logFp, "[%s][%s] ",
-						g_logLevelNames[level], g_prefix);
+				// asynchronous slots are fixed size, keep the line terminated
+				length = (int)sizeof(lineBuffer) - 1;
+				lineBuffer[length - 1] = '\n';
 			}
 			else
 			{
-				fprintf(tc_internal_logFp, "[%s][NO NAME] ",
-						g_logLevelNames[level]);
+				text = (char *)malloc((size_t)length + 1);
+				if (text != NULL)
+				{
+					va_copy(copy, va);
+					(void)FormatLogLine(text, (size_t)length + 1, &logTime, level, tag, NULL, format, copy);
+					va_end(copy);
+				}
+				else
+				{
+					text = lineBuffer;
+					length = (int)sizeof(lineBuffer) - 1;
+				}
 			}
+		}
 
-			va_start(va, format);
-			vfprintf(tc_internal_logFp, format, va);
-			fflush(tc_internal_logFp);
-			if (tc_internal_logFp != stdout)
-			{
-				fclose(tc_internal_logFp);
-				tc_internal_logFp = NULL;
-			}
-			va_end(va);
+		if (length > 0 && offset < length &&
+			TCLogStormCollapse(level, &logTime, tag, text + offset, (unsigned int)(length - offset)) != 0)
+		{
+			printLog = EmitText(level, &logTime, text, (unsigned int)length);
 		}
+		else if (length > 0 && offset < length)
+		{
+			TCLogStatsSuppressed(level);
+		}
+		TCLogThreadBufferDone();
 
-		(void)pthread_mutex_unlock(g_logMutexPtr);
+		if (text != lineBuffer)
+		{
+			free(text);
+		}
 	}
 	else
+	{
+		if ((g_enable != 0) && (printLog != 0))
+		{
+			// only the rate limit turns an enabled line away here
+			TCLogStatsSuppressed(level);
+		}
 		printLog = 0;
+	}
+	TCLogStatsCall(start);
 
 	return printLog;
 }
 
+void TCLogRecordV(TCLogLevel level, const char *tag, const char *format, va_list va)
+{
+	if ((g_enable != 0) && (level >= TCLogLevelError) && (level < TotalTCLogLevels) && (TCLogFlightEnabled() != 0))
+	{
+		TCLogTime logTime;
+		char lineBuffer[TC_LOG_LINE_SIZE];
+		int length;
+		va_list copy;
+
+		TCLogGetTime(&logTime);
+
+		va_copy(copy, va);
+		length = FormatLogLine(lineBuffer, sizeof(lineBuffer), &logTime, level, tag, NULL, format, copy);
+		va_end(copy);
+
+		if (length > 0)
+		{
+			TCLogFlightWrite(lineBuffer, (length < (int)sizeof(lineBuffer)) ? (unsigned int)length : sizeof(lineBuffer) - 1);
+		}
+	}
+}
+
+int TCLogNote(TCLogLevel level, const TCLogTime *logTime, const char *tag, const char *format, ...)
+{
+	char lineBuffer[TC_LOG_LINE_SIZE];
+	int length;
+	va_list va;
+
+	va_start(va, format);
+	length = FormatLogLine(lineBuffer, sizeof(lineBuffer), logTime, level, tag, NULL, format, va);
+	va_end(va);
+
+	if (length >= (int)sizeof(lineBuffer))
+	{
+		length = (int)sizeof(lineBuffer) - 1;
+	}
+
+	return (length > 0) ? EmitText(level, logTime, lineBuffer, (unsigned int)length) : 0;
+}
+
+int TCLogEmit(TCLogLevel level, const TCLogTime *logTime, const char *text, unsigned int length)
+{
+	return (g_enable != 0) ? EmitText(level, logTime, text, length) : 0;
+}
+
 int TCLogHex(TCLogLevel level, const void *buffer, unsigned int length, const char *title)
 {
-	int	printLog = ((level >= TCLogLevelError) && (level < g_level)) ? 1 : 0;
+	int	printLog = ((level >= TCLogLevelError) && (level <= g_level)) ? 1 : 0;
 	if ((g_enable != 0) && (printLog != 0))
 	{
-		int year, mon, day, hour, ms;
-		time_t timeNow;
+		unsigned long long start = TCLogStatsStart();
+		TCLogTime logTime;
 
-		(void)pthread_mutex_lock(g_logMutexPtr);
-		struct timeval timeVal;
-		struct tm *tmData;
+		TCLogThreadBufferGetTime(&logTime);
 
-		gettimeofday(&timeVal, NULL);
-		timeNow = timeVal.tv_sec;
-		ms = (int)(timeVal.tv_usec / 1000.0 + 0.5);
-		if (ms >= 1000)
+		printLog = TCLogHexDefer(level, &logTime, buffer, length, title);
+		if (printLog < 0)
 		{
-			timeNow++;
-			ms %= 1000;
+			printLog = TCLogHexWrite(level, &logTime, (const unsigned char *)buffer,
+									 TCLogHexShownBytes(length), length, title);
 		}
+		TCLogThreadBufferDone();
+		TCLogStatsCall(start);
+	}
+	else
+		printLog = 0;
 
-		tmData = localtime(&timeNow);
-
-		year = tmData->tm_year + 1900;
-		mon = tmData->tm_mon + 1;
-		day =  tmData->tm_mday;
-		hour = tmData->tm_hour;
+	return printLog;
+}
 
-		printLog = OpenFile(year, mon, day, hour);
+int TCLogHexWrite(TCLogLevel level, const TCLogTime *logTime, const unsigned char *bufp,
+				  unsigned int shown, unsigned int length, const char *title)
+{
+	unsigned int rowSize = TCLogHexRowSize();
+	char chunk[TC_LOG_LINE_SIZE];
+	char *dump = chunk;
+	size_t size = sizeof(chunk);
+	int used;
+	int printLog = 1;
+	unsigned int i;
 
-		if (printLog != 0)
+	if (TCLogThreadBuffersEnabled() == 0 && TCLogAsyncEnabled() == 0 && TCLogDaemonConnected() == 0 &&
+		(g_mappedFile == 0 || tc_internal_logFp == stdout))
+	{
+		// the plain file output takes the whole dump with a single write
+		size = HEX_HEADER_SIZE + ((size_t)shown / 16 + 1) * rowSize + HEX_TRAILER_SIZE;
+		dump = (char *)malloc(size);
+		if (dump == NULL)
 		{
-			unsigned char *bufp = (unsigned char *)buffer;
-			unsigned int i;
-			fprintf(tc_internal_logFp, "\n    %s%sHEXDUMP [%u BYTES]\n             | 00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F\n",
+			dump = chunk;
+			size = sizeof(chunk);
+		}
+	}
+
+	used = snprintf(dump, HEX_HEADER_SIZE, "\n    %s%sHEXDUMP [%u BYTES]\n             | 00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F\n"
+					"    ---------+------------------------------------------------",
 					title != NULL ? title : "", title != NULL ? " " : "", length);
-			fprintf(tc_internal_logFp, "    ---------+------------------------------------------------");
+	if (used >= HEX_HEADER_SIZE)
+	{
+		used = HEX_HEADER_SIZE - 1;
+	}
 
-			for (i = 0; i < length; i++)
-			{
-				if (i % 16 == 0)
-					fprintf(tc_internal_logFp, "\n    %08X | ", i);
-				fprintf(tc_internal_logFp, "%02X ", bufp[i]);
-			}
-			fprintf(tc_internal_logFp, "\n\n");
-			fflush(tc_internal_logFp);
-			if (tc_internal_logFp != stdout)
+	for (i = 0; i < shown; i += 16)
+	{
+		// hand over whole rows only, so the dump is split on line boundaries
+		if ((size_t)used + rowSize + HEX_TRAILER_SIZE > size)
+		{
+			if (EmitText(level, logTime, dump, (unsigned int)used) == 0)
 			{
-				fclose(tc_internal_logFp);
-				tc_internal_logFp = NULL;
+				printLog = 0;
 			}
+			used = 0;
 		}
+		used += (int)TCLogHexFormatRow(dump + used, bufp + i, (shown - i < 16) ? shown - i : 16, i);
+	}
 
-		(void)pthread_mutex_unlock(g_logMutexPtr);
+	if (shown < length)
+	{
+		used += snprintf(dump + used, size - used, "\n    ... %u of %u bytes shown", shown, length);
 	}
-	else
+	used += snprintf(dump + used, size - used, "\n\n");
+
+	if (EmitText(level, logTime, dump, (unsigned int)used) == 0)
+	{
 		printLog = 0;
+	}
+
+	if (dump != chunk)
+	{
+		free(dump);
+	}
 
 	return printLog;
 }
@@ -330,27 +579,10 @@ FILE *TCLogFilePtr()
 	{
 		if (tc_internal_logFp == NULL)
 		{
-			struct tm *tmData;
-			time_t timeNow;
-			int year, mon, day, hour, ms;
-			struct timeval timeVal;
+			TCLogTime logTime;
 
-			gettimeofday(&timeVal, NULL);
-			timeNow = timeVal.tv_sec;
-			ms = (int)(timeVal.tv_usec / 1000.0 + 0.5);
-			if (ms >= 1000)
-			{
-				timeNow++;
-				ms %= 1000;
-			}
-
-			tmData = localtime(&timeNow);
-			year = tmData->tm_year + 1900;
-			mon = tmData->tm_mon + 1;
-			day =  tmData->tm_mday;
-			hour = tmData->tm_hour;
-
-			OpenFile(year, mon, day, hour);
+			TCLogGetTime(&logTime);
+			OpenFile(logTime.year, logTime.month, logTime.day, logTime.hour);
 		}
 
 		return tc_internal_logFp;
@@ -364,9 +596,14 @@ int OpenFile(int year, int month, int day, int hour)
 	int opened;
 	if (g_enable != 0)
 	{
-		if (g_freeSpaceErrorCnt >= 10 && GetTotalFreeSpaceRate() < 5.0)
+		if (TCLogBudgetMayWrite() == 0)
 		{
-			fprintf(stderr, "can not append logs because current partition`s available space was less than 5 percents\n");
+			if (g_budgetBlocked == 0)
+			{
+				fprintf(stderr, "can not append logs because current partition`s available space is below the log budget\n");
+				g_budgetBlocked = 1;
+			}
+			TCLogStatsRefused();
 			if (tc_internal_logFp != NULL && tc_internal_logFp != stdout)
 			{
 				fclose(tc_internal_logFp);
@@ -376,20 +613,10 @@ int OpenFile(int year, int month, int day, int hour)
 		}
 		else
 		{
+			g_budgetBlocked = 0;
 			if (tc_internal_logFp != stdout)
 			{
-				snprintf(g_filePath, MAX_STRING_SIZE, "%s-%d%02d%02d%02d_%d.log",
-						g_fileName, year, month, day, hour, g_fileIndex);
-
-				if (g_fileHour == -1)
-				{
-					g_fileHour = hour;
-				}
-				else if (g_fileHour != hour)
-				{
-					g_fileHour = hour;
-					g_fileIndex = 0;
-				}
+				BuildFilePath(year, month, day, hour);
 
 				if (access(g_filePath, F_OK) == 0)
 				{
@@ -400,14 +627,18 @@ int OpenFile(int year, int month, int day, int hour)
 					tc_internal_logFp = fopen(g_filePath, "w");
 				}
 
-				if (tc_internal_logFp != NULL && getFileLength(tc_internal_logFp) > MAX_LOG_FILE_SIZE)
+				if (tc_internal_logFp != NULL)
 				{
-					fclose(tc_internal_logFp);
+					g_fileBytes = getFileLength(tc_internal_logFp);
+					if (g_fileBytes > MAX_LOG_FILE_SIZE)
+					{
+						fclose(tc_internal_logFp);
 
-					g_fileIndex++;
-					snprintf(g_filePath, MAX_STRING_SIZE, "%s-%d%02d%02d%02d_%d.log",
-							g_fileName, year, month, day, hour, g_fileIndex);
-					tc_internal_logFp = fopen(g_filePath, "w");
+						g_fileIndex++;
+						BuildFilePath(year, month, day, hour);
+						tc_internal_logFp = fopen(g_filePath, "w");
+						g_fileBytes = 0;
+					}
 				}
 			}
 
@@ -428,3 +659,543 @@ int OpenFile(int year, int month, int day, int hour)
 
 	return opened;
 }
+
+void TCLogUpdateThreshold(void)
+{
+	int threshold = -1;
+
+	if (g_enable != 0)
+	{
+		threshold = (TCLogFlightEnabled() != 0) ? (int)TCLogLevelDebug : (int)g_level;
+	}
+	__atomic_store_n(&tc_internal_logThreshold, threshold, __ATOMIC_RELAXED);
+}
+
+int TCLogGetLevel(void)
+{
+	return (int)g_level;
+}
+
+int TCLogIsLevelEnabled(TCLogLevel level)
+{
+	return ((g_enable != 0) && (level >= TCLogLevelError) && (level <= g_level)) ? 1 : 0;
+}
+
+void TCLogGetPrefixes(const char **prefix, const char **subPrefix, int *useTime)
+{
+	*prefix = g_prefix;
+	*subPrefix = g_sub_prefix;
+	*useTime = g_use_time;
+}
+
+void TCLogGetFileName(char *name, size_t size)
+{
+	if (g_logMutexPtr != NULL)
+	{
+		(void)pthread_mutex_lock(g_logMutexPtr);
+		strncpy(name, g_fileName, size - 1);
+		name[size - 1] = '\0';
+		(void)pthread_mutex_unlock(g_logMutexPtr);
+	}
+	else
+	{
+		name[0] = '\0';
+	}
+}
+
+void TCLogGetFilePath(char *path, size_t size)
+{
+	if (g_logMutexPtr != NULL)
+	{
+		(void)pthread_mutex_lock(g_logMutexPtr);
+		strncpy(path, g_filePath, size - 1);
+		path[size - 1] = '\0';
+		(void)pthread_mutex_unlock(g_logMutexPtr);
+	}
+	else
+	{
+		path[0] = '\0';
+	}
+}
+
+pthread_mutex_t *TCLogMutex(void)
+{
+	return g_logMutexPtr;
+}
+
+int TCLogWriteText(const TCLogTime *logTime, const char *text, unsigned int length)
+{
+	int written;
+	long offset = 0;
+
+	if (g_mappedFile != 0 && tc_internal_logFp != stdout)
+	{
+		written = PrepareMappedOutput(logTime, length);
+		if (written != 0)
+		{
+			offset = TCLogMappedBytes();
+			written = TCLogMappedWrite(text, length);
+		}
+		else if (g_enable != 0 && TCLogBudgetMayWrite() != 0 && PrepareOutput(logTime, length) != 0)
+		{
+			// no segment could be reserved, append through stdio and close so a later mapping sees the line
+			(void)fwrite(text, 1, length, tc_internal_logFp);
+			offset = g_fileBytes;
+			g_fileBytes += length;
+			fclose(tc_internal_logFp);
+			tc_internal_logFp = NULL;
+			written = 1;
+		}
+	}
+	else if (g_uringFile != 0 && tc_internal_logFp != stdout)
+	{
+		written = PrepareUringOutput(logTime, length);
+		if (written != 0)
+		{
+			offset = TCLogUringFileBytes();
+			written = TCLogUringWrite(text, length);
+		}
+	}
+	else if ((written = PrepareOutput(logTime, length)) != 0)
+	{
+		(void)fwrite(text, 1, length, tc_internal_logFp);
+		offset = g_fileBytes;
+		g_fileBytes += length;
+	}
+
+	if (written != 0 && tc_internal_logFp != stdout)
+	{
+		TCLogIndexWrite(g_filePath, offset, text, length);
+	}
+
+	return written;
+}
+
+int TCLogWriteVector(const TCLogTime *logTime, struct iovec *iov, int count, unsigned int length, int sync)
+{
+	int written = 0;
+	int i;
+
+	if ((g_mappedFile != 0 || g_uringFile != 0) && tc_internal_logFp != stdout)
+	{
+		for (i = 0; i < count; i++)
+		{
+			written = TCLogWriteText(logTime, (const char *)iov[i].iov_base, (unsigned int)iov[i].iov_len);
+		}
+
+		// msync(MS_SYNC) or a drained io_uring fsync before the group commit reports the lines durable
+		if (sync != 0)
+		{
+			TCLogSyncOutput();
+		}
+		else
+		{
+			TCLogFinishWrite();
+		}
+	}
+	else if ((written = PrepareOutput(logTime, length)) != 0)
+	{
+		int fd = fileno(tc_internal_logFp);
+		int first = 0;
+		ssize_t ret;
+		long offset = g_fileBytes;
+		const char *lineText = (const char *)iov[0].iov_base;
+		unsigned int lineLength = (unsigned int)iov[0].iov_len;
+
+		// anything written through stdio so far has to land before this batch
+		fflush(tc_internal_logFp);
+
+		while (first < count)
+		{
+			ret = writev(fd, &iov[first], count - first);
+			if (ret < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				written = 0;
+				break;
+			}
+
+			// only bytes on the file count for rotation, only whole lines get an index entry
+			g_fileBytes += (long)ret;
+			while (first < count && (size_t)ret >= iov[first].iov_len)
+			{
+				ret -= (ssize_t)iov[first].iov_len;
+				if (tc_internal_logFp != stdout)
+				{
+					TCLogIndexWrite(g_filePath, offset, lineText, lineLength);
+				}
+				offset += (long)lineLength;
+				first++;
+				if (first < count)
+				{
+					lineText = (const char *)iov[first].iov_base;
+					lineLength = (unsigned int)iov[first].iov_len;
+				}
+			}
+
+			// a short write resumes inside the first unfinished line
+			if (first < count)
+			{
+				iov[first].iov_base = (char *)iov[first].iov_base + ret;
+				iov[first].iov_len -= (size_t)ret;
+			}
+		}
+
+		if (tc_internal_logFp != stdout)
+		{
+			if (sync != 0)
+			{
+				(void)fdatasync(fd);
+			}
+			if (g_persistentFile == 0)
+			{
+				fclose(tc_internal_logFp);
+				tc_internal_logFp = NULL;
+			}
+		}
+	}
+
+	return written;
+}
+
+void TCLogSyncOutput(void)
+{
+	if (g_mappedFile != 0 && tc_internal_logFp != stdout)
+	{
+		TCLogMappedSync(1);
+	}
+	else if (g_uringFile != 0 && tc_internal_logFp != stdout)
+	{
+		TCLogUringSubmit(1);
+	}
+	else if (tc_internal_logFp != NULL && tc_internal_logFp != stdout)
+	{
+		fflush(tc_internal_logFp);
+		(void)fdatasync(fileno(tc_internal_logFp));
+	}
+	else if (tc_internal_logFp == NULL && g_filePath[0] != '\0')
+	{
+		// the non persistent output closes the file after every write
+		int fd = open(g_filePath, O_WRONLY | O_CLOEXEC);
+
+		if (fd >= 0)
+		{
+			(void)fdatasync(fd);
+			close(fd);
+		}
+	}
+}
+
+void TCLogFinishWrite(void)
+{
+	if (g_mappedFile != 0 && tc_internal_logFp != stdout)
+	{
+		TCLogMappedSync(0);
+	}
+	else if (g_uringFile != 0 && tc_internal_logFp != stdout)
+	{
+		TCLogUringSubmit(0);
+	}
+	else if (tc_internal_logFp != NULL)
+	{
+		fflush(tc_internal_logFp);
+		if (tc_internal_logFp != stdout && g_persistentFile == 0)
+		{
+			fclose(tc_internal_logFp);
+			tc_internal_logFp = NULL;
+		}
+	}
+}
+
+static int FormatLogLine(char *buffer, size_t size, const TCLogTime *logTime, TCLogLevel level,
+						 const char *tag, int *messageOffset, const char *format, va_list va)
+{
+	int length = 0;
+	int ret;
+
+	if (g_use_time != 0)
+	{
+		length += TCLogFormatTime(buffer, size, logTime);
+	}
+
+	if (messageOffset != NULL)
+	{
+		*messageOffset = length;
+	}
+
+	// the default tag is the sub prefix, its header only changes in TCLogInitialize()
+	if (tag == g_sub_prefix && g_levelHeaderLengths[level] > 0 && (size_t)(length + g_levelHeaderLengths[level]) < size)
+	{
+		memcpy(buffer + length, g_levelHeaders[level], (size_t)g_levelHeaderLengths[level]);
+		length += g_levelHeaderLengths[level];
+	}
+	else
+	{
+		length += FormatHeader(buffer + length, size - length, level, tag);
+	}
+
+	ret = TCLogFormatMessage(buffer + length, size - length, format, va);
+	if (ret > 0)
+	{
+		length += ret;
+	}
+
+	return length;
+}
+
+static int FormatHeader(char *buffer, size_t size, TCLogLevel level, const char *tag)
+{
+	int length;
+
+	if (g_prefix != NULL && tag != NULL)
+	{
+		length = snprintf(buffer, size, "[%s][%s][%s] ", g_logLevelNames[level], g_prefix, tag);
+	}
+	else if (g_prefix != NULL)
+	{
+		length = snprintf(buffer, size, "[%s][%s] ", g_logLevelNames[level], g_prefix);
+	}
+	else
+	{
+		length = snprintf(buffer, size, "[%s][NO NAME] ", g_logLevelNames[level]);
+	}
+
+	return length;
+}
+
+static void BuildLevelHeaders(void)
+{
+	int level;
+
+	for (level = 0; level < TotalTCLogLevels; level++)
+	{
+		g_levelHeaderLengths[level] = FormatHeader(g_levelHeaders[level], MAX_HEADER_SIZE, (TCLogLevel)level, g_sub_prefix);
+	}
+}
+
+static void BuildFilePath(int year, int month, int day, int hour)
+{
+	char closedPath[MAX_STRING_SIZE];
+	char archivePath[MAX_STRING_SIZE + 4];
+
+	// every caller has closed the previous file, it is final once the name moves on
+	memcpy(closedPath, g_filePath, MAX_STRING_SIZE);
+
+	if (g_fileHour == -1)
+	{
+		g_fileHour = hour;
+	}
+	else if (g_fileHour != hour || g_fileDay != day)
+	{
+		g_fileHour = hour;
+		g_fileIndex = 0;
+	}
+	g_fileDay = day;
+
+	for (;;)
+	{
+		snprintf(g_filePath, MAX_STRING_SIZE, "%s-%d%02d%02d%02d_%d.log",
+				g_fileName, year, month, day, hour, g_fileIndex);
+
+		// an archive left by an earlier run within this hour keeps its index
+		snprintf(archivePath, sizeof(archivePath), "%s.gz", g_filePath);
+		if (access(archivePath, F_OK) != 0)
+		{
+			break;
+		}
+		g_fileIndex++;
+	}
+
+	if (strcmp(closedPath, g_filePath) != 0)
+	{
+		TCLogCompressClosedFile(closedPath);
+		TCLogBudgetKick();
+		if (closedPath[0] != '\0')
+		{
+			TCLogStatsRotation();
+		}
+	}
+}
+
+static int PrepareOutput(const TCLogTime *logTime, unsigned int length)
+{
+	int opened;
+
+	if (tc_internal_logFp == NULL || tc_internal_logFp == stdout)
+	{
+		opened = OpenFile(logTime->year, logTime->month, logTime->day, logTime->hour);
+	}
+	else if (g_fileHour != logTime->hour || g_fileDay != logTime->day)
+	{
+		fclose(tc_internal_logFp);
+		tc_internal_logFp = NULL;
+		opened = OpenFile(logTime->year, logTime->month, logTime->day, logTime->hour);
+	}
+	else if (g_persistentFile != 0 && g_fileBytes + (long)length > MAX_LOG_FILE_SIZE)
+	{
+		opened = RotateFile(logTime);
+	}
+	else
+	{
+		// the file is still open for the current hour, no need to look it up again
+		opened = 1;
+	}
+
+	return opened;
+}
+
+static int PrepareMappedOutput(const TCLogTime *logTime, unsigned int length)
+{
+	int opened = 0;
+	int tries;
+
+	if (TCLogMappedIsOpen() != 0 && (g_fileHour != logTime->hour || g_fileDay != logTime->day))
+	{
+		TCLogMappedClose();
+	}
+
+	// switch to the next preallocated segment once the line does not fit anymore
+	for (tries = 0; tries < 16 && opened == 0; tries++)
+	{
+		if (TCLogMappedIsOpen() == 0)
+		{
+			if (g_enable == 0)
+			{
+				break;
+			}
+			if (TCLogBudgetMayWrite() == 0)
+			{
+				TCLogStatsRefused();
+				break;
+			}
+
+			BuildFilePath(logTime->year, logTime->month, logTime->day, logTime->hour);
+			if (TCLogMappedOpen(g_filePath, MAX_LOG_FILE_SIZE) == 0)
+			{
+				break;
+			}
+		}
+
+		if (TCLogMappedHasRoom(length) != 0)
+		{
+			opened = 1;
+		}
+		else
+		{
+			TCLogMappedClose();
+			g_fileIndex++;
+		}
+	}
+
+	return opened;
+}
+
+static void CloseMappedFile(void)
+{
+	(void)pthread_mutex_lock(g_logMutexPtr);
+	TCLogMappedClose();
+	(void)pthread_mutex_unlock(g_logMutexPtr);
+}
+
+static int PrepareUringOutput(const TCLogTime *logTime, unsigned int length)
+{
+	int opened = 0;
+	int tries;
+
+	if (TCLogUringIsOpen() != 0 && (g_fileHour != logTime->hour || g_fileDay != logTime->day))
+	{
+		TCLogUringClose();
+	}
+
+	for (tries = 0; tries < 16 && opened == 0; tries++)
+	{
+		if (TCLogUringIsOpen() == 0)
+		{
+			if (g_enable == 0)
+			{
+				break;
+			}
+			if (TCLogBudgetMayWrite() == 0)
+			{
+				TCLogStatsRefused();
+				break;
+			}
+
+			BuildFilePath(logTime->year, logTime->month, logTime->day, logTime->hour);
+			if (TCLogUringOpen(g_filePath) == 0)
+			{
+				break;
+			}
+		}
+
+		if (TCLogUringFileBytes() + (long)length <= MAX_LOG_FILE_SIZE || TCLogUringFileBytes() == 0)
+		{
+			opened = 1;
+		}
+		else
+		{
+			TCLogUringClose();
+			g_fileIndex++;
+		}
+	}
+
+	return opened;
+}
+
+static void CloseUringFile(void)
+{
+	(void)pthread_mutex_lock(g_logMutexPtr);
+	TCLogUringClose();
+	(void)pthread_mutex_unlock(g_logMutexPtr);
+}
+
+static int RotateFile(const TCLogTime *logTime)
+{
+	fclose(tc_internal_logFp);
+	tc_internal_logFp = NULL;
+	g_fileIndex++;
+
+	return OpenFile(logTime->year, logTime->month, logTime->day, logTime->hour);
+}
+
+static int EmitText(TCLogLevel level, const TCLogTime *logTime, const char *text, unsigned int length)
+{
+	int printLog = TCLogSinkDispatch(level, text, length);
+
+	if (TCLogSinkPrimaryEnabled(level) == 0)
+	{
+		TCLogStatsLine(level, length, 1);
+		return (printLog > 0) ? 1 : 0;
+	}
+
+	printLog = TCLogDaemonPush(level, logTime, text, length);
+
+	if (printLog < 0)
+	{
+		printLog = TCLogThreadBufferPush(level, logTime, text, length);
+	}
+
+	if (printLog < 0)
+	{
+		printLog = TCLogAsyncPush(logTime, text, length);
+	}
+
+	if (printLog < 0)
+	{
+		printLog = TCLogCommitPush(level, logTime, text, length);
+	}
+
+	if (printLog < 0)
+	{
+		TCLogStatsLock(g_logMutexPtr);
+		printLog = TCLogWriteText(logTime, text, length);
+		TCLogFinishWrite();
+		(void)pthread_mutex_unlock(g_logMutexPtr);
+	}
+	TCLogStatsLine(level, length, printLog);
+
+	return printLog;
+}
@@ -0,0 +1,432 @@
+/****************************************************************************************
+ *   FileName    : TCLogAsync.c
+ *   Description : Asynchronous TCLog backend, bounded multi-producer ring drained by a writer thread
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define DEFAULT_ASYNC_CAPACITY		256
+#define MAX_ASYNC_CAPACITY			65536
+#define WRITER_BATCH_SIZE			64
+#define WRITER_IDLE_TIMEOUT_MS		100
+#define PRODUCER_WAIT_TIMEOUT_MS	10
+
+typedef struct {
+	unsigned long sequence;
+	TCLogTime time;
+	unsigned int length;
+	char text[TC_LOG_LINE_SIZE];
+} AsyncSlot;
+
+static AsyncSlot *ClaimEnqueueSlot(unsigned long *position);
+static AsyncSlot *ClaimDequeueSlot(unsigned long *position);
+static int IsRingEmpty(void);
+static unsigned int DrainSlots(unsigned int max);
+static void WakeWriter(void);
+static void WaitForSpace(void);
+static void *WriterThread(void *arg);
+static void GetTimeout(struct timespec *ts, long msec);
+
+static AsyncSlot *g_slots = NULL;
+static unsigned long g_mask = 0;
+static unsigned long g_enqueuePos __attribute__((aligned(64))) = 0;
+static unsigned long g_dequeuePos __attribute__((aligned(64))) = 0;
+static TCLogAsyncPolicy g_policy = TCLogAsyncBlock;
+static int g_asyncEnabled = 0;
+static int g_asyncUsers = 0;
+static int g_writerRun = 0;
+static int g_writerSleeping = 0;
+static int g_spaceWaiters = 0;
+static int g_exitHandler = 0;
+static unsigned long g_droppedCount = 0;
+static unsigned long g_overwrittenCount = 0;
+static pthread_t g_writerThread;
+static pthread_mutex_t g_asyncControlMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_asyncMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_writerCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_spaceCond = PTHREAD_COND_INITIALIZER;
+
+int TCLogEnableAsync(unsigned int capacity, TCLogAsyncPolicy policy)
+{
+	int enabled = 0;
+
+	(void)pthread_mutex_lock(&g_asyncControlMutex);
+	if (g_asyncEnabled != 0)
+	{
+		fprintf(stderr, "%s: asynchronous log already enabled\n", __func__);
+	}
+	else if (TCLogMutex() == NULL)
+	{
+		fprintf(stderr, "%s: TCLogInitialize must be called first\n", __func__);
+	}
+	else if (policy < TCLogAsyncBlock || policy >= TotalTCLogAsyncPolicies)
+	{
+		fprintf(stderr, "%s: invalid policy(%d)\n", __func__, policy);
+	}
+	else
+	{
+		unsigned long size = 2;
+		unsigned long i;
+
+		if (capacity == 0)
+		{
+			capacity = DEFAULT_ASYNC_CAPACITY;
+		}
+		else if (capacity > MAX_ASYNC_CAPACITY)
+		{
+			capacity = MAX_ASYNC_CAPACITY;
+		}
+
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+
+		g_slots = (AsyncSlot *)malloc(size * sizeof(AsyncSlot));
+		if (g_slots != NULL)
+		{
+			for (i = 0; i < size; i++)
+			{
+				g_slots[i].sequence = i;
+			}
+			g_mask = size - 1;
+			g_enqueuePos = 0;
+			g_dequeuePos = 0;
+			g_policy = policy;
+			g_writerRun = 1;
+
+			if (pthread_create(&g_writerThread, NULL, WriterThread, NULL) == 0)
+			{
+				__atomic_store_n(&g_asyncEnabled, 1, __ATOMIC_SEQ_CST);
+				enabled = 1;
+
+				// lines still queued at exit() are written out before the process goes
+				if (g_exitHandler == 0)
+				{
+					g_exitHandler = (atexit(TCLogDisableAsync) == 0) ? 1 : 0;
+				}
+			}
+			else
+			{
+				perror("create log writer thread failed: ");
+				g_writerRun = 0;
+				free(g_slots);
+				g_slots = NULL;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "%s: allocate %lu slots failed\n", __func__, size);
+		}
+	}
+	(void)pthread_mutex_unlock(&g_asyncControlMutex);
+
+	return enabled;
+}
+
+void TCLogDisableAsync(void)
+{
+	(void)pthread_mutex_lock(&g_asyncControlMutex);
+	if (g_asyncEnabled != 0)
+	{
+		__atomic_store_n(&g_asyncEnabled, 0, __ATOMIC_SEQ_CST);
+
+		// new lines take the synchronous path from here, wait for pushes in flight
+		while (__atomic_load_n(&g_asyncUsers, __ATOMIC_SEQ_CST) != 0)
+		{
+			(void)sched_yield();
+		}
+
+		(void)pthread_mutex_lock(&g_asyncMutex);
+		g_writerRun = 0;
+		(void)pthread_cond_signal(&g_writerCond);
+		(void)pthread_mutex_unlock(&g_asyncMutex);
+		(void)pthread_join(g_writerThread, NULL);
+
+		free(g_slots);
+		g_slots = NULL;
+	}
+	(void)pthread_mutex_unlock(&g_asyncControlMutex);
+}
+
+void TCLogGetAsyncDropCounts(unsigned long *dropped, unsigned long *overwritten)
+{
+	if (dropped != NULL)
+	{
+		*dropped = __atomic_load_n(&g_droppedCount, __ATOMIC_RELAXED);
+	}
+
+	if (overwritten != NULL)
+	{
+		*overwritten = __atomic_load_n(&g_overwrittenCount, __ATOMIC_RELAXED);
+	}
+}
+
+int TCLogAsyncEnabled(void)
+{
+	return __atomic_load_n(&g_asyncEnabled, __ATOMIC_RELAXED);
+}
+
+int TCLogAsyncPush(const TCLogTime *logTime, const char *text, unsigned int length)
+{
+	int queued = -1;
+
+	__atomic_add_fetch(&g_asyncUsers, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&g_asyncEnabled, __ATOMIC_SEQ_CST) != 0)
+	{
+		AsyncSlot *slot;
+		unsigned long position;
+
+		if (length > TC_LOG_LINE_SIZE)
+		{
+			length = TC_LOG_LINE_SIZE;
+		}
+
+		slot = ClaimEnqueueSlot(&position);
+		while (slot == NULL && g_policy != TCLogAsyncDropNewest)
+		{
+			if (g_policy == TCLogAsyncOverwriteOldest)
+			{
+				unsigned long oldest;
+				AsyncSlot *victim = ClaimDequeueSlot(&oldest);
+				if (victim != NULL)
+				{
+					__atomic_store_n(&victim->sequence, oldest + g_mask + 1, __ATOMIC_RELEASE);
+					__atomic_add_fetch(&g_overwrittenCount, 1, __ATOMIC_RELAXED);
+				}
+			}
+			else
+			{
+				WaitForSpace();
+			}
+			slot = ClaimEnqueueSlot(&position);
+		}
+
+		if (slot != NULL)
+		{
+			slot->time = *logTime;
+			slot->length = length;
+			memcpy(slot->text, text, length);
+			__atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+			queued = 1;
+
+			if (__atomic_load_n(&g_writerSleeping, __ATOMIC_SEQ_CST) != 0)
+			{
+				WakeWriter();
+			}
+		}
+		else
+		{
+			__atomic_add_fetch(&g_droppedCount, 1, __ATOMIC_RELAXED);
+			queued = 0;
+		}
+	}
+	__atomic_sub_fetch(&g_asyncUsers, 1, __ATOMIC_SEQ_CST);
+
+	return queued;
+}
+
+static AsyncSlot *ClaimEnqueueSlot(unsigned long *position)
+{
+	AsyncSlot *claimed = NULL;
+	unsigned long pos = __atomic_load_n(&g_enqueuePos, __ATOMIC_RELAXED);
+
+	for (;;)
+	{
+		AsyncSlot *slot = &g_slots[pos & g_mask];
+		unsigned long sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		long diff = (long)(sequence - pos);
+
+		if (diff == 0)
+		{
+			if (__atomic_compare_exchange_n(&g_enqueuePos, &pos, pos + 1, 1,
+											__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				claimed = slot;
+				*position = pos;
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			// ring is full
+			break;
+		}
+		else
+		{
+			pos = __atomic_load_n(&g_enqueuePos, __ATOMIC_RELAXED);
+		}
+	}
+
+	return claimed;
+}
+
+static AsyncSlot *ClaimDequeueSlot(unsigned long *position)
+{
+	AsyncSlot *claimed = NULL;
+	unsigned long pos = __atomic_load_n(&g_dequeuePos, __ATOMIC_RELAXED);
+
+	for (;;)
+	{
+		AsyncSlot *slot = &g_slots[pos & g_mask];
+		unsigned long sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		long diff = (long)(sequence - (pos + 1));
+
+		if (diff == 0)
+		{
+			if (__atomic_compare_exchange_n(&g_dequeuePos, &pos, pos + 1, 1,
+											__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				claimed = slot;
+				*position = pos;
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			// ring is empty
+			break;
+		}
+		else
+		{
+			pos = __atomic_load_n(&g_dequeuePos, __ATOMIC_RELAXED);
+		}
+	}
+
+	return claimed;
+}
+
+static int IsRingEmpty(void)
+{
+	unsigned long pos = __atomic_load_n(&g_dequeuePos, __ATOMIC_SEQ_CST);
+	AsyncSlot *slot = &g_slots[pos & g_mask];
+
+	return (__atomic_load_n(&slot->sequence, __ATOMIC_SEQ_CST) != pos + 1) ? 1 : 0;
+}
+
+static unsigned int DrainSlots(unsigned int max)
+{
+	pthread_mutex_t *logMutex = TCLogMutex();
+	unsigned int count = 0;
+	AsyncSlot *slot;
+	unsigned long position;
+
+	(void)pthread_mutex_lock(logMutex);
+	while (count < max && (slot = ClaimDequeueSlot(&position)) != NULL)
+	{
+		(void)TCLogWriteText(&slot->time, slot->text, slot->length);
+		__atomic_store_n(&slot->sequence, position + g_mask + 1, __ATOMIC_RELEASE);
+		count++;
+	}
+
+	if (count > 0)
+	{
+		TCLogFinishWrite();
+	}
+	(void)pthread_mutex_unlock(logMutex);
+
+	if (count > 0 && __atomic_load_n(&g_spaceWaiters, __ATOMIC_SEQ_CST) != 0)
+	{
+		(void)pthread_mutex_lock(&g_asyncMutex);
+		(void)pthread_cond_broadcast(&g_spaceCond);
+		(void)pthread_mutex_unlock(&g_asyncMutex);
+	}
+
+	return count;
+}
+
+static void WakeWriter(void)
+{
+	(void)pthread_mutex_lock(&g_asyncMutex);
+	(void)pthread_cond_signal(&g_writerCond);
+	(void)pthread_mutex_unlock(&g_asyncMutex);
+}
+
+static void WaitForSpace(void)
+{
+	struct timespec ts;
+
+	GetTimeout(&ts, PRODUCER_WAIT_TIMEOUT_MS);
+
+	(void)pthread_mutex_lock(&g_asyncMutex);
+	__atomic_add_fetch(&g_spaceWaiters, 1, __ATOMIC_SEQ_CST);
+	(void)pthread_cond_signal(&g_writerCond);
+	(void)pthread_cond_timedwait(&g_spaceCond, &g_asyncMutex, &ts);
+	__atomic_sub_fetch(&g_spaceWaiters, 1, __ATOMIC_SEQ_CST);
+	(void)pthread_mutex_unlock(&g_asyncMutex);
+}
+
+static void *WriterThread(void *arg)
+{
+	(void)arg;
+
+	for (;;)
+	{
+		if (DrainSlots(WRITER_BATCH_SIZE) == 0)
+		{
+			int run;
+
+			(void)pthread_mutex_lock(&g_asyncMutex);
+			__atomic_store_n(&g_writerSleeping, 1, __ATOMIC_SEQ_CST);
+			run = g_writerRun;
+			if (run != 0 && IsRingEmpty() != 0)
+			{
+				struct timespec ts;
+
+				GetTimeout(&ts, WRITER_IDLE_TIMEOUT_MS);
+				(void)pthread_cond_timedwait(&g_writerCond, &g_asyncMutex, &ts);
+			}
+			__atomic_store_n(&g_writerSleeping, 0, __ATOMIC_SEQ_CST);
+			(void)pthread_mutex_unlock(&g_asyncMutex);
+
+			// leave only after the ring has been drained
+			if (run == 0 && IsRingEmpty() != 0)
+			{
+				break;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void GetTimeout(struct timespec *ts, long msec)
+{
+	(void)clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += msec / 1000;
+	ts->tv_nsec += (msec % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
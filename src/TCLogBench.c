@@ -0,0 +1,579 @@
+/****************************************************************************************
+ *   FileName    : TCLogBench.c
+ *   Description : tclog-bench, throughput and call latency of TCLog and TCLogHex
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "TCLog.h"
+
+#define MAX_THREADS			64
+#define MAX_RUN_VALUES		16
+#define MAX_MESSAGE_SIZE	4096
+#define SUB_BUCKET_BITS		4
+#define SUB_BUCKETS			(1 << SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS	(SUB_BUCKETS * 61)
+#define LOAD_CHUNK_SIZE		(4 * 1024 * 1024)
+#define LOAD_FILE_LIMIT		(256L * 1024 * 1024)
+
+typedef enum {
+	SinkNull,
+	SinkFile,
+	SinkStdout,
+	SinkUring,
+	TotalSinks
+} BenchSink;
+
+typedef enum {
+	ModeDirect,
+	ModeBuffered,
+	ModeAsync,
+	TotalModes
+} BenchMode;
+
+typedef struct {
+	int hex;
+	int level;
+	unsigned int size;
+	long iterations;
+	const char *payload;
+	unsigned long long histogram[HISTOGRAM_BUCKETS];
+	unsigned long long maxNs;
+	long long startNs;
+	long long endNs;
+} Worker;
+
+static int ParseList(const char *text, int *values, int max);
+static int ParseNames(const char *text, const char *const *names, int total, int *selected);
+static int SelectSink(int sink, const char *dir);
+static int StartMode(int mode);
+static void StopMode(int mode);
+static void RunCase(int hex, int sink, int mode, int threads, int size, int enabled);
+static void *WorkerThread(void *arg);
+static void *LoadThread(void *arg);
+static unsigned int BucketIndex(unsigned long long ns);
+static unsigned long long BucketValue(unsigned int index);
+static unsigned long long Percentile(const unsigned long long *histogram, unsigned long long total, double fraction);
+static long long GetNs(void);
+
+static const char *const g_sinkNames[TotalSinks] = { "null", "file", "stdout", "uring" };
+static const char *const g_modeNames[TotalModes] = { "direct", "buffered", "async" };
+static FILE *g_results = NULL;
+static FILE *g_null = NULL;
+static int g_nullSink = -1;
+static long g_iterations = 20000;
+static int g_printHistogram = 0;
+static int g_runId = 0;
+static int g_uringActive = 0;
+static pthread_barrier_t g_barrier;
+static volatile int g_stopLoad = 0;
+static char g_loadPath[1024];
+
+int main(int argc, char *argv[])
+{
+	const char *dir = "/tmp";
+	const char *output = NULL;
+	int threads[MAX_RUN_VALUES] = { 1, 4 };
+	int sizes[MAX_RUN_VALUES] = { 32, 256 };
+	int sinks[TotalSinks] = { 1, 1, 0, 0 };
+	int modes[TotalModes] = { 1, 0, 0 };
+	int threadCount = 2;
+	int sizeCount = 2;
+	int saturate = 0;
+	pthread_t load;
+	int opt;
+	int hex;
+	int sink;
+	int mode;
+	int t;
+	int s;
+
+	while ((opt = getopt(argc, argv, "d:n:t:m:k:w:o:sHh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'd':
+				dir = optarg;
+				break;
+			case 'n':
+				g_iterations = atol(optarg);
+				break;
+			case 't':
+				threadCount = ParseList(optarg, threads, MAX_THREADS);
+				break;
+			case 'm':
+				sizeCount = ParseList(optarg, sizes, MAX_MESSAGE_SIZE);
+				break;
+			case 'k':
+				if (ParseNames(optarg, g_sinkNames, TotalSinks, sinks) == 0)
+				{
+					return 1;
+				}
+				break;
+			case 'w':
+				if (ParseNames(optarg, g_modeNames, TotalModes, modes) == 0)
+				{
+					return 1;
+				}
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 's':
+				saturate = 1;
+				break;
+			case 'H':
+				g_printHistogram = 1;
+				break;
+			default:
+				printf("usage: %s [-d DIR] [-n CALLS] [-t THREADS,...] [-m BYTES,...] [-k SINK,...] [-w MODE,...] [-o FILE] [-s] [-H]\n", argv[0]);
+				printf("  -d DIR     directory of the file and uring sinks (default /tmp)\n");
+				printf("  -n CALLS   calls per thread and case (default 20000)\n");
+				printf("  -t LIST    thread counts (default 1,4)\n");
+				printf("  -m LIST    message sizes in bytes (default 32,256)\n");
+				printf("  -k LIST    sinks out of null, file, stdout, uring (default null,file)\n");
+				printf("  -w LIST    write modes out of direct, buffered, async (default direct)\n");
+				printf("  -o FILE    write the results to FILE, needed to keep them apart from the stdout sink\n");
+				printf("  -s         keep the device busy with large synced writes meanwhile\n");
+				printf("  -H         also print the latency histogram of every case\n");
+				printf("results are CSV rows, histogram rows start with \"hist\"\n");
+				return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if (g_iterations < 1 || threadCount == 0 || sizeCount == 0)
+	{
+		fprintf(stderr, "%s: invalid calls, thread counts or message sizes\n", argv[0]);
+		return 1;
+	}
+
+	g_results = (output != NULL) ? fopen(output, "w") : stdout;
+	g_null = fopen("/dev/null", "w");
+	if (g_results == NULL || g_null == NULL)
+	{
+		fprintf(stderr, "%s: open output failed\n", argv[0]);
+		return 1;
+	}
+
+	TCLogInitialize("bench", "tclog", 1);
+	TCLogSetPersistentFile(1);
+
+	if (saturate != 0)
+	{
+		(void)snprintf(g_loadPath, sizeof(g_loadPath), "%s/tclog-bench-load", dir);
+		if (pthread_create(&load, NULL, LoadThread, NULL) != 0)
+		{
+			saturate = 0;
+		}
+	}
+
+	fprintf(g_results, "run,op,sink,mode,threads,size,level,calls,seconds,calls_per_sec,p50_ns,p99_ns,p999_ns,max_ns\n");
+	for (hex = 0; hex < 2; hex++)
+	{
+		for (sink = 0; sink < TotalSinks; sink++)
+		{
+			if (sinks[sink] == 0)
+			{
+				continue;
+			}
+			if (SelectSink(sink, dir) == 0)
+			{
+				fprintf(stderr, "%s: sink %s is not available, skipped\n", argv[0], g_sinkNames[sink]);
+				continue;
+			}
+
+			for (mode = 0; mode < TotalModes; mode++)
+			{
+				// the null sink is written by the calling thread, the other modes only move the primary output
+				if (modes[mode] == 0 || (sink == SinkNull && mode != ModeDirect) || StartMode(mode) == 0)
+				{
+					continue;
+				}
+				for (t = 0; t < threadCount; t++)
+				{
+					for (s = 0; s < sizeCount; s++)
+					{
+						RunCase(hex, sink, mode, threads[t], sizes[s], 1);
+						RunCase(hex, sink, mode, threads[t], sizes[s], 0);
+					}
+				}
+				StopMode(mode);
+			}
+		}
+	}
+	if (g_uringActive != 0)
+	{
+		(void)TCLogSetUringFile(0, 0);
+	}
+	if (g_nullSink >= 0)
+	{
+		(void)TCLogRemoveSink(g_nullSink);
+	}
+
+	if (saturate != 0)
+	{
+		g_stopLoad = 1;
+		(void)pthread_join(load, NULL);
+		(void)unlink(g_loadPath);
+	}
+
+	if (g_results != stdout)
+	{
+		fclose(g_results);
+	}
+
+	return 0;
+}
+
+static int ParseList(const char *text, int *values, int max)
+{
+	int count = 0;
+	char *end;
+	long value;
+
+	while (*text != '\0' && count < MAX_RUN_VALUES)
+	{
+		value = strtol(text, &end, 10);
+		if (end == text || value < 1 || value > max || (*end != ',' && *end != '\0'))
+		{
+			return 0;
+		}
+		values[count++] = (int)value;
+		text = (*end == ',') ? end + 1 : end;
+	}
+
+	return count;
+}
+
+static int ParseNames(const char *text, const char *const *names, int total, int *selected)
+{
+	char list[256];
+	char *save = NULL;
+	char *name;
+	int i;
+
+	memset(selected, 0x00, sizeof(int) * (size_t)total);
+	(void)snprintf(list, sizeof(list), "%s", text);
+	for (name = strtok_r(list, ",", &save); name != NULL; name = strtok_r(NULL, ",", &save))
+	{
+		for (i = 0; i < total && strcmp(name, names[i]) != 0; i++)
+		{
+		}
+		if (i == total)
+		{
+			fprintf(stderr, "unknown name %s\n", name);
+			return 0;
+		}
+		selected[i] = 1;
+	}
+
+	return 1;
+}
+
+static int SelectSink(int sink, const char *dir)
+{
+	char path[1024];
+	FILE *previous;
+
+	// leaving the uring output closes the current stream, only do it when it is on
+	if (g_uringActive != 0)
+	{
+		(void)TCLogSetUringFile(0, 0);
+		g_uringActive = 0;
+	}
+	if (g_nullSink >= 0)
+	{
+		(void)TCLogRemoveSink(g_nullSink);
+		(void)TCLogSetSinkLevel(TC_LOG_PRIMARY_SINK, TCLogLevelDebug);
+		g_nullSink = -1;
+	}
+	previous = TCRedirectLog((sink == SinkStdout) ? stdout : NULL);
+	if (previous != NULL && previous != stdout)
+	{
+		fclose(previous);
+	}
+
+	switch (sink)
+	{
+		case SinkNull:
+			// any redirected stream other than stdout is taken for the rotated files, feed /dev/null as a sink instead
+			g_nullSink = TCLogAddStreamSink(g_null, TCLogLevelDebug);
+			if (g_nullSink < 0)
+			{
+				return 0;
+			}
+			(void)TCLogSetSinkLevel(TC_LOG_PRIMARY_SINK, -1);
+			break;
+		case SinkStdout:
+			break;
+		default:
+			(void)snprintf(path, sizeof(path), "%s/tclog-bench-%s", dir, g_sinkNames[sink]);
+			TCLogSetFileName(path);
+			if (sink == SinkUring)
+			{
+				g_uringActive = TCLogSetUringFile(1, 0);
+				if (g_uringActive == 0)
+				{
+					return 0;
+				}
+			}
+			break;
+	}
+
+	return 1;
+}
+
+static int StartMode(int mode)
+{
+	int started = 1;
+
+	if (mode == ModeBuffered)
+	{
+		started = TCLogEnableThreadBuffers(0, 0);
+	}
+	else if (mode == ModeAsync)
+	{
+		started = TCLogEnableAsync(0, TCLogAsyncBlock);
+	}
+
+	return started;
+}
+
+static void StopMode(int mode)
+{
+	// the lines still held back land before the next mode is measured
+	if (mode == ModeBuffered)
+	{
+		TCLogDisableThreadBuffers();
+	}
+	else if (mode == ModeAsync)
+	{
+		TCLogDisableAsync();
+	}
+}
+
+static void RunCase(int hex, int sink, int mode, int threads, int size, int enabled)
+{
+	static Worker workers[MAX_THREADS];
+	static unsigned long long histogram[HISTOGRAM_BUCKETS];
+	pthread_t tids[MAX_THREADS];
+	char payload[MAX_MESSAGE_SIZE + 1];
+	unsigned long long total;
+	unsigned long long maxNs = 0;
+	long long start = 0;
+	long long end = 0;
+	double seconds;
+	int i;
+	int j;
+
+	memset(payload, 'x', (size_t)size);
+	payload[size] = '\0';
+	memset(histogram, 0x00, sizeof(histogram));
+
+	// the disabled case logs DEBUG lines below the INFO level
+	TCLogSetLevel(TCLogLevelInfo);
+	(void)pthread_barrier_init(&g_barrier, NULL, (unsigned int)threads + 1);
+	for (i = 0; i < threads; i++)
+	{
+		memset(&workers[i], 0x00, sizeof(Worker));
+		workers[i].hex = hex;
+		workers[i].level = (enabled == 0) ? TCLogLevelDebug : TCLogLevelInfo;
+		workers[i].size = (unsigned int)size;
+		workers[i].iterations = g_iterations;
+		workers[i].payload = payload;
+		if (pthread_create(&tids[i], NULL, WorkerThread, &workers[i]) != 0)
+		{
+			fprintf(stderr, "%s: thread creation failed\n", __func__);
+			exit(1);
+		}
+	}
+
+	(void)pthread_barrier_wait(&g_barrier);
+	for (i = 0; i < threads; i++)
+	{
+		(void)pthread_join(tids[i], NULL);
+		start = (i == 0 || workers[i].startNs < start) ? workers[i].startNs : start;
+		end = (workers[i].endNs > end) ? workers[i].endNs : end;
+	}
+	seconds = (double)(end - start) / 1e9;
+	(void)pthread_barrier_destroy(&g_barrier);
+
+	for (i = 0; i < threads; i++)
+	{
+		for (j = 0; j < HISTOGRAM_BUCKETS; j++)
+		{
+			histogram[j] += workers[i].histogram[j];
+		}
+		maxNs = (workers[i].maxNs > maxNs) ? workers[i].maxNs : maxNs;
+	}
+	total = (unsigned long long)g_iterations * (unsigned long long)threads;
+
+	g_runId++;
+	fprintf(g_results, "%d,%s,%s,%s,%d,%d,%s,%llu,%.4f,%.0f,%llu,%llu,%llu,%llu\n", g_runId,
+			(hex != 0) ? "hex" : "log", g_sinkNames[sink], g_modeNames[mode], threads, size, (enabled != 0) ? "enabled" : "disabled",
+			total, seconds, (double)total / seconds, Percentile(histogram, total, 0.50),
+			Percentile(histogram, total, 0.99), Percentile(histogram, total, 0.999), maxNs);
+
+	if (g_printHistogram != 0)
+	{
+		for (j = 0; j < HISTOGRAM_BUCKETS; j++)
+		{
+			if (histogram[j] != 0ULL)
+			{
+				fprintf(g_results, "hist,%d,%llu,%llu\n", g_runId, BucketValue((unsigned int)j), histogram[j]);
+			}
+		}
+	}
+	fflush(g_results);
+}
+
+static void *WorkerThread(void *arg)
+{
+	Worker *worker = (Worker *)arg;
+	unsigned long long spent;
+	long long before;
+	long i;
+
+	(void)pthread_barrier_wait(&g_barrier);
+	worker->startNs = GetNs();
+	for (i = 0; i < worker->iterations; i++)
+	{
+		before = GetNs();
+		if (worker->hex != 0)
+		{
+			(void)TCLogHex((TCLogLevel)worker->level, worker->payload, worker->size, "bench");
+		}
+		else
+		{
+			(void)TCLog((TCLogLevel)worker->level, "bench %ld %s\n", i, worker->payload);
+		}
+		spent = (unsigned long long)(GetNs() - before);
+
+		worker->histogram[BucketIndex(spent)]++;
+		worker->maxNs = (spent > worker->maxNs) ? spent : worker->maxNs;
+	}
+	worker->endNs = GetNs();
+
+	return NULL;
+}
+
+static void *LoadThread(void *arg)
+{
+	char *chunk = (char *)malloc(LOAD_CHUNK_SIZE);
+	int fd = open(g_loadPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	long written = 0;
+
+	(void)arg;
+	if (chunk != NULL && fd >= 0)
+	{
+		memset(chunk, 0x5A, LOAD_CHUNK_SIZE);
+		while (g_stopLoad == 0)
+		{
+			if (write(fd, chunk, LOAD_CHUNK_SIZE) != LOAD_CHUNK_SIZE)
+			{
+				break;
+			}
+			(void)fdatasync(fd);
+
+			written += LOAD_CHUNK_SIZE;
+			if (written >= LOAD_FILE_LIMIT)
+			{
+				(void)lseek(fd, 0, SEEK_SET);
+				written = 0;
+			}
+		}
+	}
+
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	free(chunk);
+
+	return NULL;
+}
+
+// log linear buckets, 16 per power of two keep the error of a percentile below 7 %
+static unsigned int BucketIndex(unsigned long long ns)
+{
+	unsigned int exponent;
+	unsigned int index;
+
+	if (ns < SUB_BUCKETS)
+	{
+		return (unsigned int)ns;
+	}
+
+	exponent = 63U - (unsigned int)__builtin_clzll(ns);
+	index = (exponent - SUB_BUCKET_BITS + 1U) * SUB_BUCKETS +
+			(unsigned int)((ns >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+
+	return (index < HISTOGRAM_BUCKETS) ? index : HISTOGRAM_BUCKETS - 1;
+}
+
+static unsigned long long BucketValue(unsigned int index)
+{
+	unsigned int exponent;
+
+	if (index < SUB_BUCKETS)
+	{
+		return index;
+	}
+
+	exponent = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1U;
+
+	return (unsigned long long)(SUB_BUCKETS + index % SUB_BUCKETS) << (exponent - SUB_BUCKET_BITS);
+}
+
+static unsigned long long Percentile(const unsigned long long *histogram, unsigned long long total, double fraction)
+{
+	unsigned long long rank = (unsigned long long)((double)total * fraction);
+	unsigned long long seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += histogram[i];
+		if (seen > rank)
+		{
+			break;
+		}
+	}
+
+	return BucketValue((i < HISTOGRAM_BUCKETS) ? i : HISTOGRAM_BUCKETS - 1);
+}
+
+static long long GetNs(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
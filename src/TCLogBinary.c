@@ -0,0 +1,436 @@
+/****************************************************************************************
+ *   FileName    : TCLogBinary.c
+ *   Description : Binary deferred-format logging, printf runs offline in tclog-decode
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+#include "TCLogBinary.h"
+
+#define FORMAT_TABLE_SIZE		1024	// power of two
+#define MAX_FORMAT_ARGUMENTS	16
+#define MAX_STRING_ARGUMENT		1024
+#define BINARY_BUFFER_SIZE		65536
+
+typedef struct {
+	const char *format;
+	int supported;
+	int count;
+	unsigned char types[MAX_FORMAT_ARGUMENTS];
+	char specifiers[MAX_FORMAT_ARGUMENTS];
+	short precisions[MAX_FORMAT_ARGUMENTS];	// string precision, -1 none, -2 taken from the previous argument
+} FormatSignature;
+
+static const FormatSignature *LookupSignature(const char *format);
+static void ParseSignature(FormatSignature *signature, const char *format);
+static int EncodeArguments(uint8_t *buffer, int size, const FormatSignature *signature, va_list va);
+static void WriteRecord(uint8_t type, uint8_t level, const void *payload, unsigned int length);
+static void WriteHeaderRecord(void);
+
+static FILE *g_binaryFp = NULL;
+static char *g_binaryBuffer = NULL;
+static FormatSignature g_formatTable[FORMAT_TABLE_SIZE];
+static pthread_mutex_t g_binaryMutex = PTHREAD_MUTEX_INITIALIZER;
+
+int TCLogBinaryOpen(const char *path)
+{
+	int opened = 0;
+
+	if (path != NULL)
+	{
+		(void)pthread_mutex_lock(&g_binaryMutex);
+		if (g_binaryFp != NULL)
+		{
+			fclose(g_binaryFp);
+		}
+
+		g_binaryFp = fopen(path, "w");
+		if (g_binaryFp != NULL)
+		{
+			if (g_binaryBuffer == NULL)
+			{
+				g_binaryBuffer = (char *)malloc(BINARY_BUFFER_SIZE);
+			}
+			if (g_binaryBuffer != NULL)
+			{
+				(void)setvbuf(g_binaryFp, g_binaryBuffer, _IOFBF, BINARY_BUFFER_SIZE);
+			}
+
+			// every file carries its own format definitions
+			memset(g_formatTable, 0x00, sizeof(g_formatTable));
+			WriteHeaderRecord();
+			opened = 1;
+		}
+		else
+		{
+			fprintf(stderr, "%s: open %s failed\n", __func__, path);
+		}
+		(void)pthread_mutex_unlock(&g_binaryMutex);
+	}
+	else
+	{
+		fprintf(stderr, "%s: path is null pointer\n", __func__);
+	}
+
+	return opened;
+}
+
+void TCLogBinaryClose(void)
+{
+	(void)pthread_mutex_lock(&g_binaryMutex);
+	if (g_binaryFp != NULL)
+	{
+		fclose(g_binaryFp);
+		g_binaryFp = NULL;
+	}
+	(void)pthread_mutex_unlock(&g_binaryMutex);
+}
+
+int TCLogBinary(TCLogLevel level, const char *format, ...)
+{
+	int printLog = TCLogIsLevelEnabled(level);
+
+	if (printLog != 0)
+	{
+		int deferred = 0;
+		va_list va;
+
+		va_start(va, format);
+		if (__atomic_load_n(&g_binaryFp, __ATOMIC_RELAXED) != NULL)
+		{
+			uint8_t record[TC_LOG_BINARY_RECORD_SIZE];
+			const FormatSignature *signature;
+			TCLogTime logTime;
+			uint64_t value;
+			uint16_t ms;
+			int length;
+
+			TCLogGetTime(&logTime);
+
+			(void)pthread_mutex_lock(&g_binaryMutex);
+			signature = (g_binaryFp != NULL) ? LookupSignature(format) : NULL;
+			if (signature != NULL && signature->supported != 0)
+			{
+				value = (uint64_t)(uintptr_t)format;
+				memcpy(&record[0], &value, 8);
+				value = (uint64_t)(int64_t)logTime.epoch;
+				memcpy(&record[8], &value, 8);
+				value = (uint64_t)(int64_t)logTime.stampSec;
+				memcpy(&record[16], &value, 8);
+				ms = (uint16_t)logTime.stampMs;
+				memcpy(&record[24], &ms, 2);
+				record[26] = (uint8_t)logTime.monotonic;
+				record[27] = 0;
+
+				length = EncodeArguments(&record[TC_LOG_BINARY_LINE_SIZE],
+										 (int)sizeof(record) - TC_LOG_BINARY_LINE_SIZE, signature, va);
+				WriteRecord(TCLogRecordLine, (uint8_t)level, record,
+							(unsigned int)(TC_LOG_BINARY_LINE_SIZE + length));
+				if (level == TCLogLevelError)
+				{
+					fflush(g_binaryFp);
+				}
+				deferred = 1;
+			}
+			(void)pthread_mutex_unlock(&g_binaryMutex);
+		}
+
+		if (deferred == 0)
+		{
+			// no binary file, or a format the decoder could not replay
+			printLog = TCLogV(level, format, va);
+		}
+		va_end(va);
+	}
+
+	return printLog;
+}
+
+int TCLogBinaryWriteEvent(TCLogLevel level, const void *record, unsigned int length)
+{
+	int written = -1;
+
+	if (__atomic_load_n(&g_binaryFp, __ATOMIC_RELAXED) != NULL)
+	{
+		(void)pthread_mutex_lock(&g_binaryMutex);
+		if (g_binaryFp != NULL)
+		{
+			WriteRecord(TCLogRecordEvent, (uint8_t)level, record, length);
+			if (level == TCLogLevelError)
+			{
+				fflush(g_binaryFp);
+			}
+			written = 1;
+		}
+		(void)pthread_mutex_unlock(&g_binaryMutex);
+	}
+
+	return written;
+}
+
+static const FormatSignature *LookupSignature(const char *format)
+{
+	const FormatSignature *found = NULL;
+	uintptr_t hash = ((uintptr_t)format >> 3) * 2654435761u;
+	unsigned int index;
+	unsigned int probe;
+
+	for (probe = 0; probe < FORMAT_TABLE_SIZE; probe++)
+	{
+		FormatSignature *signature;
+
+		index = (unsigned int)(hash + probe) & (FORMAT_TABLE_SIZE - 1);
+		signature = &g_formatTable[index];
+
+		if (signature->format == format)
+		{
+			found = signature;
+			break;
+		}
+		else if (signature->format == NULL)
+		{
+			ParseSignature(signature, format);
+			if (signature->supported != 0)
+			{
+				uint8_t payload[TC_LOG_BINARY_RECORD_SIZE];
+				uint64_t id = (uint64_t)(uintptr_t)format;
+				size_t length = strlen(format);
+
+				if (length > sizeof(payload) - 8)
+				{
+					signature->supported = 0;
+				}
+				else
+				{
+					memcpy(&payload[0], &id, 8);
+					memcpy(&payload[8], format, length);
+					WriteRecord(TCLogRecordFormat, 0, payload, (unsigned int)(8 + length));
+				}
+			}
+			found = signature;
+			break;
+		}
+	}
+
+	return found;
+}
+
+static void ParseSignature(FormatSignature *signature, const char *format)
+{
+	const char *p = format;
+
+	signature->format = format;
+	signature->supported = 1;
+	signature->count = 0;
+
+	while (*p != '\0' && signature->supported != 0)
+	{
+		if (*p == '%')
+		{
+			TCLogConversion conversion;
+
+			p += TCLogParseConversion(p, &conversion);
+			if (conversion.type == TCLogArgUnsupported ||
+				signature->count + conversion.widthStar + conversion.precisionStar + 1 > MAX_FORMAT_ARGUMENTS)
+			{
+				signature->supported = 0;
+			}
+			else if (conversion.type != TCLogArgNone)
+			{
+				if (conversion.widthStar != 0)
+				{
+					signature->precisions[signature->count] = -1;
+					signature->specifiers[signature->count] = '*';
+					signature->types[signature->count++] = TCLogArgInt;
+				}
+				if (conversion.precisionStar != 0)
+				{
+					signature->precisions[signature->count] = -1;
+					signature->specifiers[signature->count] = '*';
+					signature->types[signature->count++] = TCLogArgInt;
+				}
+				signature->precisions[signature->count] = (conversion.precisionStar != 0) ? -2 :
+															(short)conversion.precision;
+				signature->specifiers[signature->count] = conversion.specifier;
+				signature->types[signature->count++] = (unsigned char)conversion.type;
+			}
+		}
+		else
+		{
+			p++;
+		}
+	}
+}
+
+static int EncodeArguments(uint8_t *buffer, int size, const FormatSignature *signature, va_list va)
+{
+	int used = 0;
+	int previous = -1;
+	int i;
+
+	for (i = 0; i < signature->count; i++)
+	{
+		// unsigned conversions are zero extended so 32-bit values decode correctly
+		int isUnsigned = (strchr("ouxX", signature->specifiers[i]) != NULL);
+		int64_t integer = 0;
+		double real = 0.0;
+		uint64_t pointer = 0;
+		const char *string = NULL;
+		uint16_t length;
+		size_t limit;
+
+		switch (signature->types[i])
+		{
+			case TCLogArgInt:
+				if (isUnsigned != 0)
+					integer = va_arg(va, unsigned int);
+				else
+					integer = va_arg(va, int);
+				previous = (int)integer;
+				break;
+			case TCLogArgLong:
+				if (isUnsigned != 0)
+					integer = (int64_t)va_arg(va, unsigned long);
+				else
+					integer = va_arg(va, long);
+				break;
+			case TCLogArgLongLong:
+				integer = va_arg(va, long long);
+				break;
+			case TCLogArgDouble:
+				real = va_arg(va, double);
+				break;
+			case TCLogArgLongDouble:
+				real = (double)va_arg(va, long double);
+				break;
+			case TCLogArgPointer:
+				pointer = (uint64_t)(uintptr_t)va_arg(va, void *);
+				break;
+			default:
+				string = va_arg(va, const char *);
+				break;
+		}
+
+		// arguments that do not fit are dropped, the decoder prints them as missing
+		if (signature->types[i] == TCLogArgString)
+		{
+			if (used + 2 > size)
+				break;
+
+			if (string != NULL)
+			{
+				limit = MAX_STRING_ARGUMENT;
+				if (signature->precisions[i] >= 0 && (size_t)signature->precisions[i] < limit)
+					limit = (size_t)signature->precisions[i];
+				else if (signature->precisions[i] == -2 && previous >= 0 && (size_t)previous < limit)
+					limit = (size_t)previous;
+				if (limit > (size_t)(size - used - 2))
+					limit = (size_t)(size - used - 2);
+
+				length = (uint16_t)strnlen(string, limit);
+				memcpy(&buffer[used], &length, 2);
+				memcpy(&buffer[used + 2], string, length);
+				used += 2 + length;
+			}
+			else
+			{
+				length = TC_LOG_BINARY_NULL_STRING;
+				memcpy(&buffer[used], &length, 2);
+				used += 2;
+			}
+		}
+		else
+		{
+			if (used + 8 > size)
+				break;
+
+			if (signature->types[i] == TCLogArgDouble || signature->types[i] == TCLogArgLongDouble)
+				memcpy(&buffer[used], &real, 8);
+			else if (signature->types[i] == TCLogArgPointer)
+				memcpy(&buffer[used], &pointer, 8);
+			else
+				memcpy(&buffer[used], &integer, 8);
+			used += 8;
+		}
+	}
+
+	return used;
+}
+
+static void WriteRecord(uint8_t type, uint8_t level, const void *payload, unsigned int length)
+{
+	TCLogRecordHead head;
+
+	head.type = type;
+	head.level = level;
+	head.length = (uint16_t)length;
+	(void)fwrite(&head, sizeof(head), 1, g_binaryFp);
+	(void)fwrite(payload, 1, length, g_binaryFp);
+}
+
+static void WriteHeaderRecord(void)
+{
+	uint8_t payload[8 + 2 * 258];
+	const char *prefix;
+	const char *subPrefix;
+	int useTime;
+	uint16_t value;
+	unsigned int used = 0;
+	size_t length;
+
+	TCLogGetPrefixes(&prefix, &subPrefix, &useTime);
+
+	memcpy(&payload[used], TC_LOG_BINARY_MAGIC, 4);
+	payload[4] = TC_LOG_BINARY_VERSION;
+	payload[5] = (uint8_t)useTime;
+	value = TC_LOG_BINARY_BYTE_ORDER;
+	memcpy(&payload[6], &value, 2);
+	used = 8;
+
+	length = (prefix != NULL) ? strnlen(prefix, 256) : 0;
+	value = (prefix != NULL) ? (uint16_t)length : TC_LOG_BINARY_NULL_STRING;
+	memcpy(&payload[used], &value, 2);
+	if (length > 0)
+	{
+		memcpy(&payload[used + 2], prefix, length);
+	}
+	used += 2 + (unsigned int)length;
+
+	length = (subPrefix != NULL) ? strnlen(subPrefix, 256) : 0;
+	value = (subPrefix != NULL) ? (uint16_t)length : TC_LOG_BINARY_NULL_STRING;
+	memcpy(&payload[used], &value, 2);
+	if (length > 0)
+	{
+		memcpy(&payload[used + 2], subPrefix, length);
+	}
+	used += 2 + (unsigned int)length;
+
+	WriteRecord(TCLogRecordHeader, 0, payload, used);
+}
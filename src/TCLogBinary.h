@@ -0,0 +1,75 @@
+/****************************************************************************************
+ *   FileName    : TCLogBinary.h
+ *   Description : Record layout of the binary deferred-format log
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#ifndef _TC_LOG_BINARY_H
+#define _TC_LOG_BINARY_H
+
+#include <stdint.h>
+
+/*
+ * A binary log is a sequence of records, each starting with TCLogRecordHead
+ * followed by 'length' payload bytes. Values are stored in the byte order of
+ * the writer, TCLogRecordHeader carries TC_LOG_BINARY_BYTE_ORDER to check it.
+ *
+ * TCLogRecordHeader : magic[4], version(u8), useTime(u8), byteOrder(u16),
+ *                     prefixLength(u16), prefix, subPrefixLength(u16), subPrefix
+ * TCLogRecordFormat : id(u64), format string without terminating NUL
+ * TCLogRecordLine   : id(u64), epoch(i64), stampSec(i64), stampMs(u16),
+ *                     monotonic(u8), reserved(u8), arguments
+ * TCLogRecordEvent  : epoch(i64), stampSec(i64), stampMs(u16), monotonic(u8),
+ *                     fieldCount(u8), name, fields
+ *
+ * Arguments follow the conversions of the format in order, '*' width and
+ * precision first. Integers, longs and long longs are stored as i64, doubles
+ * and long doubles as double, pointers as u64 and strings as length(u16)
+ * followed by the bytes, TC_LOG_BINARY_NULL_STRING for a NULL pointer.
+ *
+ * Event names and field keys are length(u8) followed by the bytes. A field is
+ * type(u8) of TCLogFieldType, key, then i64 for integers, double for doubles
+ * and length(u16) followed by the bytes for strings and byte arrays.
+ */
+
+#define TC_LOG_BINARY_MAGIC			"TCLB"
+#define TC_LOG_BINARY_VERSION		1
+#define TC_LOG_BINARY_BYTE_ORDER	0x0102
+#define TC_LOG_BINARY_NULL_STRING	0xFFFF
+#define TC_LOG_BINARY_RECORD_SIZE	2048
+#define TC_LOG_BINARY_LINE_SIZE		28
+#define TC_LOG_BINARY_EVENT_SIZE	20
+
+typedef enum {
+	TCLogRecordHeader = 1,
+	TCLogRecordFormat,
+	TCLogRecordLine,
+	TCLogRecordEvent
+} TCLogRecordType;
+
+typedef struct {
+	uint8_t type;
+	uint8_t level;
+	uint16_t length;
+} TCLogRecordHead;
+
+#endif // _TC_LOG_BINARY_H
@@ -0,0 +1,352 @@
+/****************************************************************************************
+ *   FileName    : TCLogBudget.c
+ *   Description : Background disk budget manager for the TCLog file output
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+#include "TCLogIndex.h"
+
+#define MAX_PATH_SIZE			256
+#define DEFAULT_INTERVAL_SEC	10
+#define DEFAULT_MIN_FREE		5
+
+typedef struct {
+	char path[MAX_PATH_SIZE + 1];
+	unsigned long long bytes;
+	unsigned long hour;		// YYYYMMDDHH of the name
+	unsigned long index;
+} SegmentFile;
+
+static int CollectSegments(const char *fileName, SegmentFile **segments, unsigned int *count);
+static int CompareSegments(const void *a, const void *b);
+static int IsActive(const SegmentFile *segment, const char *activePath);
+static int IsSpaceShort(const char *path);
+static int RemoveSegment(const char *path);
+static int EnforceBudget(void);
+static void *BudgetThread(void *arg);
+
+static unsigned long long g_maxBytes = 0;
+static unsigned int g_maxFiles = 0;
+static unsigned int g_minFreePercent = DEFAULT_MIN_FREE;
+static unsigned int g_intervalSec = DEFAULT_INTERVAL_SEC;
+static int g_mayWrite = 1;
+static int g_budgetRun = 0;
+static int g_budgetKick = 0;
+static pthread_t g_budgetThread;
+static pthread_mutex_t g_budgetControlMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_budgetMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_budgetCond = PTHREAD_COND_INITIALIZER;
+
+int TCLogSetDiskBudget(unsigned long long maxBytes, unsigned int maxFiles,
+					   unsigned int minFreePercent, unsigned int intervalSec)
+{
+	int started = 1;
+
+	TCLogStopDiskBudget();
+
+	(void)pthread_mutex_lock(&g_budgetControlMutex);
+	g_maxBytes = maxBytes;
+	g_maxFiles = maxFiles;
+	g_minFreePercent = (minFreePercent < 100U) ? minFreePercent : DEFAULT_MIN_FREE;
+	g_intervalSec = (intervalSec != 0U) ? intervalSec : DEFAULT_INTERVAL_SEC;
+
+	g_budgetRun = 1;
+	if (pthread_create(&g_budgetThread, NULL, BudgetThread, NULL) != 0)
+	{
+		fprintf(stderr, "%s: create budget thread failed\n", __func__);
+		g_budgetRun = 0;
+		started = 0;
+	}
+	(void)pthread_mutex_unlock(&g_budgetControlMutex);
+
+	return started;
+}
+
+void TCLogStopDiskBudget(void)
+{
+	(void)pthread_mutex_lock(&g_budgetControlMutex);
+	if (g_budgetRun != 0)
+	{
+		(void)pthread_mutex_lock(&g_budgetMutex);
+		g_budgetRun = 0;
+		(void)pthread_cond_signal(&g_budgetCond);
+		(void)pthread_mutex_unlock(&g_budgetMutex);
+
+		(void)pthread_join(g_budgetThread, NULL);
+		__atomic_store_n(&g_mayWrite, 1, __ATOMIC_RELEASE);
+	}
+	(void)pthread_mutex_unlock(&g_budgetControlMutex);
+}
+
+int TCLogBudgetMayWrite(void)
+{
+	return __atomic_load_n(&g_mayWrite, __ATOMIC_ACQUIRE);
+}
+
+void TCLogBudgetKick(void)
+{
+	// called with the log mutex held, a missed wake up only delays the check to the next interval
+	if (__atomic_load_n(&g_budgetRun, __ATOMIC_RELAXED) != 0)
+	{
+		__atomic_store_n(&g_budgetKick, 1, __ATOMIC_RELEASE);
+		if (pthread_mutex_trylock(&g_budgetMutex) == 0)
+		{
+			(void)pthread_cond_signal(&g_budgetCond);
+			(void)pthread_mutex_unlock(&g_budgetMutex);
+		}
+	}
+}
+
+static int CollectSegments(const char *fileName, SegmentFile **segments, unsigned int *count)
+{
+	char copy[MAX_PATH_SIZE];
+	char directory[MAX_PATH_SIZE];
+	char prefix[MAX_PATH_SIZE];
+	size_t prefixLength;
+	unsigned int capacity = 0;
+	struct dirent *entry;
+	DIR *dir;
+
+	*segments = NULL;
+	*count = 0;
+
+	snprintf(copy, sizeof(copy), "%s", fileName);
+	snprintf(directory, sizeof(directory), "%s", dirname(copy));
+	snprintf(copy, sizeof(copy), "%s", fileName);
+	snprintf(prefix, sizeof(prefix), "%s-", basename(copy));
+	prefixLength = strlen(prefix);
+
+	dir = opendir(directory);
+	if (dir == NULL)
+	{
+		return 0;
+	}
+
+	while ((entry = readdir(dir)) != NULL)
+	{
+		size_t length = strlen(entry->d_name);
+		SegmentFile *segment;
+		struct stat st;
+		int pathLength;
+
+		// rotated segments are "<name>-YYYYMMDDHH_<index>.log", optionally compressed to ".log.gz"
+		if (strncmp(entry->d_name, prefix, prefixLength) != 0 ||
+			!((length > 4 && strcmp(entry->d_name + length - 4, ".log") == 0) ||
+			  (length > 7 && strcmp(entry->d_name + length - 7, ".log.gz") == 0)))
+		{
+			continue;
+		}
+
+		if (*count == capacity)
+		{
+			SegmentFile *grown;
+
+			capacity = (capacity != 0U) ? capacity * 2 : 64;
+			grown = (SegmentFile *)realloc(*segments, capacity * sizeof(SegmentFile));
+			if (grown == NULL)
+			{
+				break;
+			}
+			*segments = grown;
+		}
+
+		// a cut off path could name another segment, "x.log.gz" without ".gz" is the open "x.log"
+		segment = &(*segments)[*count];
+		pathLength = snprintf(segment->path, sizeof(segment->path), "%s/%s", directory, entry->d_name);
+		if (pathLength < 0 || (size_t)pathLength >= sizeof(segment->path))
+		{
+			fprintf(stderr, "%s: path of %s is too long, skipped\n", __func__, entry->d_name);
+			continue;
+		}
+		if (sscanf(entry->d_name + prefixLength, "%lu_%lu", &segment->hour, &segment->index) == 2 &&
+			stat(segment->path, &st) == 0 && S_ISREG(st.st_mode))
+		{
+			segment->bytes = (unsigned long long)st.st_size;
+			(*count)++;
+		}
+	}
+	closedir(dir);
+
+	return 1;
+}
+
+static int CompareSegments(const void *a, const void *b)
+{
+	const SegmentFile *left = (const SegmentFile *)a;
+	const SegmentFile *right = (const SegmentFile *)b;
+	int result;
+
+	// by name like tclog-query, a late compression makes an archive newer by mtime than the open segment
+	if (left->hour != right->hour)
+	{
+		result = (left->hour < right->hour) ? -1 : 1;
+	}
+	else if (left->index != right->index)
+	{
+		result = (left->index < right->index) ? -1 : 1;
+	}
+	else
+	{
+		result = strcmp(left->path, right->path);
+	}
+
+	return result;
+}
+
+// TCLog may name the open segment relative to the directory listed here, compare the names only
+static int IsActive(const SegmentFile *segment, const char *activePath)
+{
+	const char *name = strrchr(segment->path, '/');
+	const char *activeName = strrchr(activePath, '/');
+
+	name = (name != NULL) ? name + 1 : segment->path;
+	activeName = (activeName != NULL) ? activeName + 1 : activePath;
+
+	return (strcmp(name, activeName) == 0) ? 1 : 0;
+}
+
+static int IsSpaceShort(const char *path)
+{
+	struct statfs stfs;
+	int isShort = 0;
+
+	if (statfs(path, &stfs) == 0 && stfs.f_blocks > 0)
+	{
+		isShort = (stfs.f_bavail * 100ULL < (unsigned long long)stfs.f_blocks * g_minFreePercent) ? 1 : 0;
+	}
+
+	return isShort;
+}
+
+static int RemoveSegment(const char *path)
+{
+	char indexPath[MAX_PATH_SIZE];
+	int ret = unlink(path);
+
+	// the sidecar index goes with its segment, it is not counted in the budget
+	if (ret == 0 && TCLogIndexPath(path, indexPath, sizeof(indexPath)) != 0)
+	{
+		(void)unlink(indexPath);
+	}
+
+	return ret;
+}
+
+static int EnforceBudget(void)
+{
+	char fileName[MAX_PATH_SIZE];
+	char activePath[MAX_PATH_SIZE + 1];
+	SegmentFile *segments;
+	unsigned long long totalBytes = 0;
+	unsigned int count;
+	unsigned int first = 0;
+	unsigned int i;
+	int mayWrite = 1;
+
+	TCLogGetFileName(fileName, sizeof(fileName));
+	TCLogGetFilePath(activePath, sizeof(activePath));
+
+	if (fileName[0] != '\0' && CollectSegments(fileName, &segments, &count) != 0)
+	{
+		qsort(segments, count, sizeof(SegmentFile), CompareSegments);
+		for (i = 0; i < count; i++)
+		{
+			totalBytes += segments[i].bytes;
+		}
+
+		// neither the segment being written nor the newest one is ever removed
+		while (first + 1 < count &&
+			   ((g_maxBytes != 0ULL && totalBytes > g_maxBytes) || (g_maxFiles != 0U && count - first > g_maxFiles)))
+		{
+			if (IsActive(&segments[first], activePath) == 0 &&
+				(RemoveSegment(segments[first].path) == 0 || errno == ENOENT))
+			{
+				totalBytes -= segments[first].bytes;
+			}
+			first++;
+		}
+
+		// free space still short, give up old history before giving up new logs
+		while (first + 1 < count && IsSpaceShort(segments[first].path) != 0)
+		{
+			if (IsActive(&segments[first], activePath) == 0)
+			{
+				(void)RemoveSegment(segments[first].path);
+			}
+			first++;
+		}
+
+		mayWrite = (IsSpaceShort((count > 0U) ? segments[count - 1].path : fileName) != 0) ? 0 : 1;
+		free(segments);
+	}
+
+	return mayWrite;
+}
+
+static void *BudgetThread(void *arg)
+{
+	struct timespec ts;
+	int mayWrite;
+
+	(void)arg;
+
+	(void)pthread_mutex_lock(&g_budgetMutex);
+	while (g_budgetRun != 0)
+	{
+		(void)pthread_mutex_unlock(&g_budgetMutex);
+
+		__atomic_store_n(&g_budgetKick, 0, __ATOMIC_RELAXED);
+		mayWrite = EnforceBudget();
+		if (mayWrite != __atomic_load_n(&g_mayWrite, __ATOMIC_RELAXED))
+		{
+			fprintf(stderr, "%s: log output %s, free space %s %u percents\n", __func__,
+					(mayWrite != 0) ? "resumed" : "suspended", (mayWrite != 0) ? "above" : "below",
+					g_minFreePercent);
+			__atomic_store_n(&g_mayWrite, mayWrite, __ATOMIC_RELEASE);
+		}
+
+		(void)pthread_mutex_lock(&g_budgetMutex);
+		if (g_budgetRun != 0 && __atomic_load_n(&g_budgetKick, __ATOMIC_ACQUIRE) == 0)
+		{
+			(void)clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += (time_t)g_intervalSec;
+			(void)pthread_cond_timedwait(&g_budgetCond, &g_budgetMutex, &ts);
+		}
+	}
+	(void)pthread_mutex_unlock(&g_budgetMutex);
+
+	return NULL;
+}
@@ -0,0 +1,479 @@
+/****************************************************************************************
+ *   FileName    : TCLogCategory.c
+ *   Description : Named TCLog categories with independent, live reloadable levels
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define MAX_CATEGORIES			64
+#define MAX_CATEGORY_NAME		32
+#define MAX_CONFIG_SIZE			4096
+#define WATCH_POLL_TIMEOUT_MS	500
+#define LEVEL_ENVIRONMENT		"TCLOG_LEVELS"
+#define INHERIT_LEVEL			-1
+#define NO_ASSIGNMENT			(INHERIT_LEVEL - 1)
+
+typedef struct {
+	char name[MAX_CATEGORY_NAME];
+	int level;			// INHERIT_LEVEL follows TCLogSetLevel()
+	int baseLevel;		// the TCLOG_LEVELS value a file assignment falls back to once removed
+	int fromFile;		// level was set by the watched config file
+	int fromApi;		// level was set by TCLogSetCategoryLevel(), the config file no longer changes it
+} Category;
+
+static TCLogCategory FindOrAddCategory(const char *name, size_t length);
+static void ParseAssignments(char *text, int *levels);
+static int ParseLevel(const char *value);
+static void ApplyEnvironment(void);
+static int LoadConfigFile(const char *path);
+static void *WatchThread(void *arg);
+
+static Category g_categories[MAX_CATEGORIES];
+static int g_categoryCount = 0;
+static pthread_mutex_t g_categoryMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_environmentOnce = PTHREAD_ONCE_INIT;
+static char g_configPath[PATH_MAX];
+static char g_configDir[PATH_MAX];
+static char g_configName[NAME_MAX + 1];
+static int g_watchFd = -1;
+static int g_watchRun = 0;
+static pthread_t g_watchThread;
+
+TCLogCategory TCLogRegisterCategory(const char *name)
+{
+	TCLogCategory category = -1;
+
+	if (name != NULL && name[0] != '\0')
+	{
+		(void)pthread_once(&g_environmentOnce, ApplyEnvironment);
+
+		(void)pthread_mutex_lock(&g_categoryMutex);
+		category = FindOrAddCategory(name, strlen(name));
+		(void)pthread_mutex_unlock(&g_categoryMutex);
+	}
+	else
+	{
+		fprintf(stderr, "%s: invalid category name\n", __func__);
+	}
+
+	return category;
+}
+
+int TCLogSetCategoryLevel(const char *name, int level)
+{
+	TCLogCategory category;
+	int set = 0;
+
+	if (level >= INHERIT_LEVEL && level < TotalTCLogLevels)
+	{
+		category = TCLogRegisterCategory(name);
+		if (category >= 0)
+		{
+			(void)pthread_mutex_lock(&g_categoryMutex);
+			g_categories[category].fromFile = 0;
+			g_categories[category].fromApi = 1;
+			__atomic_store_n(&g_categories[category].level, level, __ATOMIC_RELAXED);
+			(void)pthread_mutex_unlock(&g_categoryMutex);
+			set = 1;
+		}
+	}
+	else
+	{
+		fprintf(stderr, "%s: set category level failed\n", __func__);
+	}
+
+	return set;
+}
+
+int TCLogCategoryEnabled(TCLogCategory category, TCLogLevel level)
+{
+	int enabled = 0;
+
+	if (category >= 0 && category < MAX_CATEGORIES && level >= TCLogLevelError && level < TotalTCLogLevels)
+	{
+		int threshold = __atomic_load_n(&g_categories[category].level, __ATOMIC_RELAXED);
+
+		if (threshold == INHERIT_LEVEL)
+		{
+			threshold = TCLogGetLevel();
+		}
+		enabled = ((int)level <= threshold) ? 1 : 0;
+	}
+
+	return enabled;
+}
+
+int TCLogC(TCLogCategory category, TCLogLevel level, const char *format, ...)
+{
+	int printLog = TCLogCategoryEnabled(category, level);
+
+	if (printLog != 0)
+	{
+		va_list va;
+
+		va_start(va, format);
+		printLog = TCLogTagV(level, g_categories[category].name, format, va);
+		va_end(va);
+	}
+	else if (category >= 0 && category < MAX_CATEGORIES && TCLogFlightEnabled() != 0)
+	{
+		va_list va;
+
+		va_start(va, format);
+		TCLogRecordV(level, g_categories[category].name, format, va);
+		va_end(va);
+	}
+
+	return printLog;
+}
+
+int TCLogWatchCategoryConfig(const char *path)
+{
+	int watching = 0;
+
+	if (path != NULL && strlen(path) < sizeof(g_configPath))
+	{
+		char copy[PATH_MAX];
+
+		TCLogUnwatchCategoryConfig();
+
+		strncpy(g_configPath, path, sizeof(g_configPath) - 1);
+		strncpy(copy, path, sizeof(copy) - 1);
+		copy[sizeof(copy) - 1] = '\0';
+		strncpy(g_configDir, dirname(copy), sizeof(g_configDir) - 1);
+		strncpy(copy, path, sizeof(copy) - 1);
+		strncpy(g_configName, basename(copy), sizeof(g_configName) - 1);
+
+		(void)LoadConfigFile(g_configPath);
+
+		// watch the directory, editors and deployment scripts replace the file
+		g_watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (g_watchFd >= 0 &&
+			inotify_add_watch(g_watchFd, g_configDir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) >= 0)
+		{
+			g_watchRun = 1;
+			if (pthread_create(&g_watchThread, NULL, WatchThread, NULL) == 0)
+			{
+				watching = 1;
+			}
+			else
+			{
+				g_watchRun = 0;
+			}
+		}
+
+		if (watching == 0)
+		{
+			fprintf(stderr, "%s: watch %s failed\n", __func__, g_configDir);
+			if (g_watchFd >= 0)
+			{
+				close(g_watchFd);
+				g_watchFd = -1;
+			}
+		}
+	}
+	else
+	{
+		fprintf(stderr, "%s: invalid path\n", __func__);
+	}
+
+	return watching;
+}
+
+void TCLogUnwatchCategoryConfig(void)
+{
+	if (g_watchRun != 0)
+	{
+		__atomic_store_n(&g_watchRun, 0, __ATOMIC_RELAXED);
+		(void)pthread_join(g_watchThread, NULL);
+	}
+
+	if (g_watchFd >= 0)
+	{
+		close(g_watchFd);
+		g_watchFd = -1;
+	}
+}
+
+static TCLogCategory FindOrAddCategory(const char *name, size_t length)
+{
+	TCLogCategory category = -1;
+	int i;
+
+	if (length >= MAX_CATEGORY_NAME)
+	{
+		length = MAX_CATEGORY_NAME - 1;
+	}
+
+	for (i = 0; i < g_categoryCount; i++)
+	{
+		if (strncmp(g_categories[i].name, name, length) == 0 && g_categories[i].name[length] == '\0')
+		{
+			category = i;
+			break;
+		}
+	}
+
+	if (category < 0)
+	{
+		if (g_categoryCount < MAX_CATEGORIES)
+		{
+			category = g_categoryCount;
+			memcpy(g_categories[category].name, name, length);
+			g_categories[category].name[length] = '\0';
+			g_categories[category].level = INHERIT_LEVEL;
+			g_categories[category].baseLevel = INHERIT_LEVEL;
+			g_categories[category].fromFile = 0;
+			g_categories[category].fromApi = 0;
+			__atomic_store_n(&g_categoryCount, g_categoryCount + 1, __ATOMIC_RELEASE);
+		}
+		else
+		{
+			fprintf(stderr, "%s: too many categories\n", __func__);
+		}
+	}
+
+	return category;
+}
+
+// "name=level" assignments separated by commas or new lines, '#' starts a comment.
+// levels gets the assigned level per category, NO_ASSIGNMENT for the others.
+static void ParseAssignments(char *text, int *levels)
+{
+	char *save = NULL;
+	char *token;
+	int i;
+
+	for (i = 0; i < MAX_CATEGORIES; i++)
+	{
+		levels[i] = NO_ASSIGNMENT;
+	}
+
+	for (token = strtok_r(text, ",\n", &save); token != NULL; token = strtok_r(NULL, ",\n", &save))
+	{
+		char *comment = strchr(token, '#');
+		char *value = strchr(token, '=');
+		char *name = token;
+		char *end;
+		int level;
+
+		if (comment != NULL)
+		{
+			*comment = '\0';
+		}
+
+		if (value == NULL || (comment != NULL && value > comment))
+		{
+			continue;
+		}
+		*value++ = '\0';
+
+		while (isspace((unsigned char)*name))
+			name++;
+		end = name + strlen(name);
+		while (end > name && isspace((unsigned char)end[-1]))
+			*--end = '\0';
+		while (isspace((unsigned char)*value))
+			value++;
+		end = value + strlen(value);
+		while (end > value && isspace((unsigned char)end[-1]))
+			*--end = '\0';
+
+		level = ParseLevel(value);
+		if (name[0] != '\0' && level >= INHERIT_LEVEL)
+		{
+			TCLogCategory category;
+
+			(void)pthread_mutex_lock(&g_categoryMutex);
+			category = FindOrAddCategory(name, strlen(name));
+			(void)pthread_mutex_unlock(&g_categoryMutex);
+
+			if (category >= 0)
+			{
+				levels[category] = level;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "TCLog: invalid category level '%s=%s'\n", name, value);
+		}
+	}
+}
+
+static int ParseLevel(const char *value)
+{
+	static const char *names[TotalTCLogLevels] = { "error", "warn", "info", "debug" };
+	int level = NO_ASSIGNMENT;
+	int i;
+
+	if (value[0] >= '0' && value[0] <= '3' && value[1] == '\0')
+	{
+		level = value[0] - '0';
+	}
+	else if (strcasecmp(value, "default") == 0)
+	{
+		level = INHERIT_LEVEL;
+	}
+	else
+	{
+		for (i = 0; i < TotalTCLogLevels; i++)
+		{
+			if (strcasecmp(value, names[i]) == 0)
+			{
+				level = i;
+				break;
+			}
+		}
+	}
+
+	return level;
+}
+
+static void ApplyEnvironment(void)
+{
+	const char *environment = getenv(LEVEL_ENVIRONMENT);
+
+	if (environment != NULL)
+	{
+		char *text = strdup(environment);
+		int levels[MAX_CATEGORIES];
+		int i;
+
+		if (text != NULL)
+		{
+			ParseAssignments(text, levels);
+			free(text);
+
+			(void)pthread_mutex_lock(&g_categoryMutex);
+			for (i = 0; i < MAX_CATEGORIES; i++)
+			{
+				if (levels[i] != NO_ASSIGNMENT)
+				{
+					g_categories[i].baseLevel = levels[i];
+					__atomic_store_n(&g_categories[i].level, levels[i], __ATOMIC_RELAXED);
+				}
+			}
+			(void)pthread_mutex_unlock(&g_categoryMutex);
+		}
+	}
+}
+
+static int LoadConfigFile(const char *path)
+{
+	char text[MAX_CONFIG_SIZE];
+	int levels[MAX_CATEGORIES];
+	int loaded = 0;
+	int fd;
+	int i;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd >= 0)
+	{
+		ssize_t length = read(fd, text, sizeof(text) - 1);
+		if (length >= 0)
+		{
+			text[length] = '\0';
+			(void)pthread_once(&g_environmentOnce, ApplyEnvironment);
+			ParseAssignments(text, levels);
+
+			// a line removed from the file hands its category back to the environment or TCLogSetLevel()
+			(void)pthread_mutex_lock(&g_categoryMutex);
+			for (i = 0; i < MAX_CATEGORIES; i++)
+			{
+				if (g_categories[i].fromApi != 0)
+				{
+					continue;
+				}
+				if (levels[i] != NO_ASSIGNMENT)
+				{
+					g_categories[i].fromFile = 1;
+					__atomic_store_n(&g_categories[i].level, levels[i], __ATOMIC_RELAXED);
+				}
+				else if (g_categories[i].fromFile != 0)
+				{
+					g_categories[i].fromFile = 0;
+					__atomic_store_n(&g_categories[i].level, g_categories[i].baseLevel, __ATOMIC_RELAXED);
+				}
+			}
+			(void)pthread_mutex_unlock(&g_categoryMutex);
+			loaded = 1;
+		}
+		close(fd);
+	}
+
+	return loaded;
+}
+
+static void *WatchThread(void *arg)
+{
+	char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd pfd;
+
+	(void)arg;
+	pfd.fd = g_watchFd;
+	pfd.events = POLLIN;
+
+	while (__atomic_load_n(&g_watchRun, __ATOMIC_RELAXED) != 0)
+	{
+		if (poll(&pfd, 1, WATCH_POLL_TIMEOUT_MS) > 0)
+		{
+			ssize_t length = read(g_watchFd, events, sizeof(events));
+			ssize_t offset = 0;
+			int reload = 0;
+
+			while (length > 0 && offset < length)
+			{
+				const struct inotify_event *event = (const struct inotify_event *)&events[offset];
+
+				if (event->len > 0 && strcmp(event->name, g_configName) == 0)
+				{
+					reload = 1;
+				}
+				offset += (ssize_t)sizeof(struct inotify_event) + event->len;
+			}
+
+			if (reload != 0)
+			{
+				(void)LoadConfigFile(g_configPath);
+			}
+		}
+	}
+
+	return NULL;
+}
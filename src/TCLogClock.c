@@ -0,0 +1,150 @@
+/****************************************************************************************
+ *   FileName    : TCLogClock.c
+ *   Description : Clock source and cached timestamp formatting for TCLog
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define TIME_PREFIX_SIZE	32
+
+typedef struct {
+	time_t second;
+	struct tm tmData;
+	char prefix[TIME_PREFIX_SIZE];	// "[YYYY-MM-DD HH:MM:SS."
+	int length;
+} TimeCache;
+
+static const TimeCache *UpdateTimeCache(time_t second);
+
+static TCLogClock g_clock = TCLogClockRealtime;
+static __thread TimeCache g_timeCache = { .second = (time_t)-1 };
+
+void TCLogSetClock(TCLogClock clock)
+{
+	if (clock >= TCLogClockRealtime && clock < TotalTCLogClocks)
+	{
+		__atomic_store_n(&g_clock, clock, __ATOMIC_RELAXED);
+	}
+	else
+	{
+		fprintf(stderr, "%s: set log clock failed\n", __func__);
+	}
+}
+
+void TCLogGetTime(TCLogTime *logTime)
+{
+	TCLogClock clock = __atomic_load_n(&g_clock, __ATOMIC_RELAXED);
+	const TimeCache *cache;
+	struct timespec ts;
+
+#ifdef CLOCK_REALTIME_COARSE
+	(void)clock_gettime((clock == TCLogClockRealtime) ? CLOCK_REALTIME : CLOCK_REALTIME_COARSE, &ts);
+#else
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+
+	// localtime_r() only runs once a second per thread
+	cache = UpdateTimeCache(ts.tv_sec);
+
+	logTime->epoch = (long)ts.tv_sec;
+	logTime->year = cache->tmData.tm_year + 1900;
+	logTime->month = cache->tmData.tm_mon + 1;
+	logTime->day = cache->tmData.tm_mday;
+	logTime->hour = cache->tmData.tm_hour;
+
+	if (clock == TCLogClockMonotonic)
+	{
+		(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	}
+	logTime->stampSec = (long)ts.tv_sec;
+	logTime->stampMs = (int)(ts.tv_nsec / 1000000);
+	logTime->monotonic = (clock == TCLogClockMonotonic);
+}
+
+void TCLogTimeFromEpoch(TCLogTime *logTime, long epoch, int stampMs)
+{
+	const TimeCache *cache = UpdateTimeCache((time_t)epoch);
+
+	logTime->epoch = epoch;
+	logTime->year = cache->tmData.tm_year + 1900;
+	logTime->month = cache->tmData.tm_mon + 1;
+	logTime->day = cache->tmData.tm_mday;
+	logTime->hour = cache->tmData.tm_hour;
+	logTime->stampSec = epoch;
+	logTime->stampMs = stampMs;
+	logTime->monotonic = 0;
+}
+
+int TCLogFormatTime(char *buffer, size_t size, const TCLogTime *logTime)
+{
+	int length;
+
+	if (logTime->monotonic != 0)
+	{
+		length = snprintf(buffer, size, "[%5ld.%03d]", logTime->stampSec, logTime->stampMs);
+	}
+	else
+	{
+		const TimeCache *cache = UpdateTimeCache((time_t)logTime->epoch);
+		int ms = logTime->stampMs;
+
+		length = cache->length + 4;
+		if ((size_t)length < size)
+		{
+			memcpy(buffer, cache->prefix, (size_t)cache->length);
+			buffer[cache->length] = (char)('0' + ms / 100);
+			buffer[cache->length + 1] = (char)('0' + ms / 10 % 10);
+			buffer[cache->length + 2] = (char)('0' + ms % 10);
+			buffer[cache->length + 3] = ']';
+			buffer[length] = '\0';
+		}
+		else if (size > 0)
+		{
+			buffer[0] = '\0';
+		}
+	}
+
+	return length;
+}
+
+static const TimeCache *UpdateTimeCache(time_t second)
+{
+	TimeCache *cache = &g_timeCache;
+
+	if (cache->second != second)
+	{
+		(void)localtime_r(&second, &cache->tmData);
+		cache->length = snprintf(cache->prefix, sizeof(cache->prefix), "[%d-%02d-%02d %02d:%02d:%02d.",
+								 cache->tmData.tm_year + 1900, cache->tmData.tm_mon + 1,
+								 cache->tmData.tm_mday, cache->tmData.tm_hour,
+								 cache->tmData.tm_min, cache->tmData.tm_sec);
+		cache->second = second;
+	}
+
+	return cache;
+}
@@ -0,0 +1,184 @@
+/****************************************************************************************
+ *   FileName    : TCLogCollector.c
+ *   Description : tclog-collector, reference collector for TCLogAddShippingSink
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_CLIENTS			64
+#define RECEIVE_SIZE		(256 * 1024)
+
+static void Stop(int signo);
+
+static volatile sig_atomic_t g_stop = 0;
+
+int main(int argc, char *argv[])
+{
+	struct pollfd fds[MAX_CLIENTS + 1];
+	struct sockaddr_un address;
+	struct sigaction action;
+	const char *output = NULL;
+	FILE *out = stdout;
+	char *buffer;
+	unsigned long clients = 0;
+	unsigned long packets = 0;
+	unsigned long long bytes = 0;
+	unsigned long long lines = 0;
+	int count = 1;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "o:h")) != -1)
+	{
+		if (opt == 'o')
+		{
+			output = optarg;
+		}
+		else
+		{
+			printf("usage: %s [-o FILE] SOCKET\n", argv[0]);
+			printf("collect the batches of TCLogAddShippingSink() on a SOCK_SEQPACKET socket,\n");
+			printf("append them to FILE or stdout and print the totals on SIGINT or SIGTERM\n");
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if (optind >= argc || strlen(argv[optind]) >= sizeof(address.sun_path))
+	{
+		fprintf(stderr, "%s: a socket path is required\n", argv[0]);
+		return 1;
+	}
+
+	buffer = (char *)malloc(RECEIVE_SIZE);
+	out = (output != NULL) ? fopen(output, "a") : stdout;
+	if (buffer == NULL || out == NULL)
+	{
+		fprintf(stderr, "%s: open output failed\n", argv[0]);
+		return 1;
+	}
+
+	memset(&address, 0x00, sizeof(address));
+	address.sun_family = AF_UNIX;
+	(void)strcpy(address.sun_path, argv[optind]);
+	(void)unlink(address.sun_path);
+
+	fds[0].fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	fds[0].events = POLLIN;
+	if (fds[0].fd < 0 || bind(fds[0].fd, (const struct sockaddr *)&address, sizeof(address)) != 0 ||
+		listen(fds[0].fd, 16) != 0)
+	{
+		fprintf(stderr, "%s: listen on %s failed, %s\n", argv[0], address.sun_path, strerror(errno));
+		return 1;
+	}
+
+	memset(&action, 0x00, sizeof(action));
+	action.sa_handler = Stop;
+	(void)sigaction(SIGINT, &action, NULL);
+	(void)sigaction(SIGTERM, &action, NULL);
+
+	while (g_stop == 0)
+	{
+		if (poll(fds, (nfds_t)count, -1) < 0)
+		{
+			continue;
+		}
+
+		for (i = count - 1; i > 0; i--)
+		{
+			ssize_t received;
+			ssize_t j;
+
+			if (fds[i].revents == 0)
+			{
+				continue;
+			}
+
+			received = recv(fds[i].fd, buffer, RECEIVE_SIZE, MSG_TRUNC);
+			if (received > 0)
+			{
+				if (received > RECEIVE_SIZE)
+				{
+					fprintf(stderr, "%s: packet of %zd bytes truncated\n", argv[0], received);
+					received = RECEIVE_SIZE;
+				}
+				(void)fwrite(buffer, 1, (size_t)received, out);
+				packets++;
+				bytes += (unsigned long long)received;
+				for (j = 0; j < received; j++)
+				{
+					lines += (buffer[j] == '\n') ? 1ULL : 0ULL;
+				}
+			}
+			else if (received == 0 || errno != EINTR)
+			{
+				close(fds[i].fd);
+				fds[i] = fds[--count];
+			}
+		}
+
+		if ((fds[0].revents & POLLIN) != 0)
+		{
+			int fd = accept(fds[0].fd, NULL, NULL);
+
+			if (fd >= 0 && count <= MAX_CLIENTS)
+			{
+				fds[count].fd = fd;
+				fds[count].events = POLLIN;
+				fds[count].revents = 0;
+				count++;
+				clients++;
+			}
+			else if (fd >= 0)
+			{
+				close(fd);
+			}
+		}
+		fflush(out);
+	}
+
+	fprintf(stderr, "clients %lu packets %lu bytes %llu lines %llu lines_per_packet %.1f\n", clients, packets,
+			bytes, lines, (packets != 0UL) ? (double)lines / (double)packets : 0.0);
+
+	(void)unlink(address.sun_path);
+	if (out != stdout)
+	{
+		fclose(out);
+	}
+	free(buffer);
+
+	return 0;
+}
+
+static void Stop(int signo)
+{
+	(void)signo;
+	g_stop = 1;
+}
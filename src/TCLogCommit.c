@@ -0,0 +1,297 @@
+/****************************************************************************************
+ *   FileName    : TCLogCommit.c
+ *   Description : Durability policy and group commit of TCLog lines
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define COMMIT_ARENA_SIZE		65536
+#define COMMIT_MAX_LINES		256		// well below IOV_MAX
+#define DEFAULT_SYNC_INTERVAL	1000
+
+typedef struct {
+	char arena[COMMIT_ARENA_SIZE];
+	struct iovec iov[COMMIT_MAX_LINES];
+	TCLogTime time;					// of the first line, selects the output file
+	unsigned int used;
+	unsigned int count;
+	int sync;
+	unsigned long sequence;
+} CommitBatch;
+
+static void CommitBatches(void);
+static void CommitLongLine(const TCLogTime *logTime, const char *text, unsigned int length, TCLogDurability policy);
+static unsigned long long GetMonotonicMs(void);
+static void *SyncThread(void *arg);
+
+static CommitBatch g_batches[2];
+static CommitBatch *g_filling = &g_batches[0];
+static unsigned long g_committedSequence = 0;
+static int g_leaderActive = 0;
+static int g_commitEnabled = 0;
+static TCLogDurability g_policies[TotalTCLogLevels] = {
+	TCLogDurabilityNone,
+	TCLogDurabilityNone,
+	TCLogDurabilityNone,
+	TCLogDurabilityNone
+};
+static unsigned int g_syncIntervalMs = DEFAULT_SYNC_INTERVAL;
+static int g_periodicDirty = 0;
+static int g_syncRun = 0;
+static pthread_t g_syncThread;
+static pthread_mutex_t g_commitMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_commitCond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t g_syncControlMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_syncCond = PTHREAD_COND_INITIALIZER;
+
+int TCLogSetDurability(TCLogLevel level, TCLogDurability policy, unsigned int syncIntervalMs)
+{
+	int set = 0;
+	int periodic = 0;
+	int i;
+
+	if (level >= TCLogLevelError && level < TotalTCLogLevels &&
+		policy >= TCLogDurabilityNone && policy < TotalTCLogDurabilities)
+	{
+		(void)pthread_mutex_lock(&g_syncControlMutex);
+		g_policies[level] = policy;
+		if (syncIntervalMs != 0U)
+		{
+			g_syncIntervalMs = syncIntervalMs;
+		}
+
+		for (i = 0; i < TotalTCLogLevels; i++)
+		{
+			periodic |= (g_policies[i] == TCLogDurabilityPeriodic) ? 1 : 0;
+		}
+
+		// the loss window of periodic levels must hold when the traffic stops
+		if (periodic != 0 && g_syncRun == 0)
+		{
+			g_syncRun = 1;
+			if (pthread_create(&g_syncThread, NULL, SyncThread, NULL) != 0)
+			{
+				fprintf(stderr, "%s: create sync thread failed\n", __func__);
+				g_syncRun = 0;
+			}
+		}
+		else if (periodic == 0 && g_syncRun != 0)
+		{
+			g_syncRun = 0;
+			(void)pthread_cond_signal(&g_syncCond);
+			(void)pthread_mutex_unlock(&g_syncControlMutex);
+			(void)pthread_join(g_syncThread, NULL);
+			(void)pthread_mutex_lock(&g_syncControlMutex);
+		}
+
+		__atomic_store_n(&g_commitEnabled, 1, __ATOMIC_RELEASE);
+		(void)pthread_mutex_unlock(&g_syncControlMutex);
+		set = 1;
+	}
+	else
+	{
+		fprintf(stderr, "%s: invalid durability policy\n", __func__);
+	}
+
+	return set;
+}
+
+int TCLogCommitPush(TCLogLevel level, const TCLogTime *logTime, const char *text, unsigned int length)
+{
+	TCLogDurability policy;
+	unsigned long sequence;
+	int pushed = -1;
+
+	if (__atomic_load_n(&g_commitEnabled, __ATOMIC_ACQUIRE) == 0)
+	{
+		return pushed;
+	}
+
+	policy = __atomic_load_n(&g_policies[level], __ATOMIC_RELAXED);
+	if (length > COMMIT_ARENA_SIZE)
+	{
+		CommitLongLine(logTime, text, length, policy);
+		return 1;
+	}
+
+	(void)pthread_mutex_lock(&g_commitMutex);
+	while (g_filling->count == COMMIT_MAX_LINES || g_filling->used + length > COMMIT_ARENA_SIZE)
+	{
+		if (g_leaderActive == 0)
+		{
+			CommitBatches();
+		}
+		else
+		{
+			(void)pthread_cond_wait(&g_commitCond, &g_commitMutex);
+		}
+	}
+
+	if (g_filling->count == 0U)
+	{
+		g_filling->time = *logTime;
+	}
+	memcpy(g_filling->arena + g_filling->used, text, length);
+	g_filling->iov[g_filling->count].iov_base = g_filling->arena + g_filling->used;
+	g_filling->iov[g_filling->count].iov_len = length;
+	g_filling->used += length;
+	g_filling->count++;
+	g_filling->sync |= (policy == TCLogDurabilitySync) ? 1 : 0;
+	if (policy == TCLogDurabilityPeriodic)
+	{
+		__atomic_store_n(&g_periodicDirty, 1, __ATOMIC_RELAXED);
+	}
+	sequence = g_filling->sequence;
+
+	if (g_leaderActive == 0)
+	{
+		// the first thread in writes for everybody queued behind it
+		CommitBatches();
+	}
+	else if (policy == TCLogDurabilitySync)
+	{
+		while (g_committedSequence < sequence)
+		{
+			(void)pthread_cond_wait(&g_commitCond, &g_commitMutex);
+		}
+	}
+	(void)pthread_mutex_unlock(&g_commitMutex);
+
+	pushed = 1;
+
+	return pushed;
+}
+
+// called with g_commitMutex held, returns once nothing is left to write
+static void CommitBatches(void)
+{
+	CommitBatch *batch;
+	pthread_mutex_t *logMutex = TCLogMutex();
+
+	g_leaderActive = 1;
+	while (g_filling->count > 0U)
+	{
+		batch = g_filling;
+		g_filling = (batch == &g_batches[0]) ? &g_batches[1] : &g_batches[0];
+		g_filling->used = 0;
+		g_filling->count = 0;
+		g_filling->sync = 0;
+		g_filling->sequence = batch->sequence + 1;
+		(void)pthread_mutex_unlock(&g_commitMutex);
+
+		(void)pthread_mutex_lock(logMutex);
+		(void)TCLogWriteVector(&batch->time, batch->iov, (int)batch->count, batch->used, batch->sync);
+		(void)pthread_mutex_unlock(logMutex);
+
+		(void)pthread_mutex_lock(&g_commitMutex);
+		g_committedSequence = batch->sequence;
+		(void)pthread_cond_broadcast(&g_commitCond);
+	}
+	g_leaderActive = 0;
+	(void)pthread_cond_broadcast(&g_commitCond);
+}
+
+// a line larger than the arena is written on its own, in order and with its level's policy
+static void CommitLongLine(const TCLogTime *logTime, const char *text, unsigned int length, TCLogDurability policy)
+{
+	pthread_mutex_t *logMutex = TCLogMutex();
+	struct iovec iov;
+
+	(void)pthread_mutex_lock(&g_commitMutex);
+	while (g_leaderActive != 0)
+	{
+		(void)pthread_cond_wait(&g_commitCond, &g_commitMutex);
+	}
+	CommitBatches();
+	g_leaderActive = 1;
+	if (policy == TCLogDurabilityPeriodic)
+	{
+		__atomic_store_n(&g_periodicDirty, 1, __ATOMIC_RELAXED);
+	}
+	(void)pthread_mutex_unlock(&g_commitMutex);
+
+	iov.iov_base = (void *)text;
+	iov.iov_len = length;
+	(void)pthread_mutex_lock(logMutex);
+	(void)TCLogWriteVector(logTime, &iov, 1, length, (policy == TCLogDurabilitySync) ? 1 : 0);
+	(void)pthread_mutex_unlock(logMutex);
+
+	// the lines queued meanwhile have no leader waiting for them
+	(void)pthread_mutex_lock(&g_commitMutex);
+	CommitBatches();
+	(void)pthread_mutex_unlock(&g_commitMutex);
+}
+
+static unsigned long long GetMonotonicMs(void)
+{
+	struct timespec now;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (unsigned long long)now.tv_sec * 1000ULL + (unsigned long long)now.tv_nsec / 1000000ULL;
+}
+
+static void *SyncThread(void *arg)
+{
+	pthread_mutex_t *logMutex = TCLogMutex();
+	unsigned long long deadline;
+	struct timespec ts;
+
+	(void)arg;
+
+	(void)pthread_mutex_lock(&g_syncControlMutex);
+	while (g_syncRun != 0)
+	{
+		deadline = GetMonotonicMs() + g_syncIntervalMs;
+		(void)clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += (time_t)(g_syncIntervalMs / 1000U);
+		ts.tv_nsec += (long)(g_syncIntervalMs % 1000U) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		(void)pthread_cond_timedwait(&g_syncCond, &g_syncControlMutex, &ts);
+
+		if (g_syncRun != 0 && GetMonotonicMs() >= deadline &&
+			__atomic_exchange_n(&g_periodicDirty, 0, __ATOMIC_ACQ_REL) != 0)
+		{
+			(void)pthread_mutex_unlock(&g_syncControlMutex);
+			(void)pthread_mutex_lock(logMutex);
+			TCLogSyncOutput();
+			(void)pthread_mutex_unlock(logMutex);
+			(void)pthread_mutex_lock(&g_syncControlMutex);
+		}
+	}
+	(void)pthread_mutex_unlock(&g_syncControlMutex);
+
+	return NULL;
+}
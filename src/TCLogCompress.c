@@ -0,0 +1,292 @@
+/****************************************************************************************
+ *   FileName    : TCLogCompress.c
+ *   Description : Background gzip compression of rotated TCLog files
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <zlib.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define MAX_PENDING_FILES		32
+#define MAX_PATH_SIZE			256
+#define COPY_BUFFER_SIZE		65536
+#define IOPRIO_CLASS_SHIFT		13
+#define IOPRIO_CLASS_IDLE		3
+#define IOPRIO_WHO_PROCESS		1
+
+static int CompressFile(const char *path, int level);
+static int PublishArchive(const char *temporary, const char *target);
+static int SyncPath(const char *path, int directory);
+static void LowerPriority(void);
+static void *CompressThread(void *arg);
+
+static char g_pendingFiles[MAX_PENDING_FILES][MAX_PATH_SIZE];
+static unsigned int g_pendingHead = 0;
+static unsigned int g_pendingCount = 0;
+static int g_compressLevel = 1;
+static int g_compressEnabled = 0;
+static int g_compressRun = 0;
+static pthread_t g_compressThread;
+static pthread_mutex_t g_compressControlMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_compressMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_compressCond = PTHREAD_COND_INITIALIZER;
+
+int TCLogEnableCompression(int level)
+{
+	int enabled = 1;
+
+	(void)pthread_mutex_lock(&g_compressControlMutex);
+	__atomic_store_n(&g_compressLevel, (level >= Z_BEST_SPEED && level <= Z_BEST_COMPRESSION) ? level : Z_BEST_SPEED,
+					 __ATOMIC_RELAXED);
+	if (g_compressRun == 0)
+	{
+		g_compressRun = 1;
+		if (pthread_create(&g_compressThread, NULL, CompressThread, NULL) == 0)
+		{
+			__atomic_store_n(&g_compressEnabled, 1, __ATOMIC_RELEASE);
+		}
+		else
+		{
+			fprintf(stderr, "%s: create compression thread failed\n", __func__);
+			g_compressRun = 0;
+			enabled = 0;
+		}
+	}
+	(void)pthread_mutex_unlock(&g_compressControlMutex);
+
+	return enabled;
+}
+
+void TCLogDisableCompression(void)
+{
+	(void)pthread_mutex_lock(&g_compressControlMutex);
+	if (g_compressRun != 0)
+	{
+		__atomic_store_n(&g_compressEnabled, 0, __ATOMIC_RELEASE);
+
+		// files already queued are still compressed before the thread ends
+		(void)pthread_mutex_lock(&g_compressMutex);
+		g_compressRun = 0;
+		(void)pthread_cond_signal(&g_compressCond);
+		(void)pthread_mutex_unlock(&g_compressMutex);
+
+		(void)pthread_join(g_compressThread, NULL);
+	}
+	(void)pthread_mutex_unlock(&g_compressControlMutex);
+}
+
+void TCLogCompressClosedFile(const char *path)
+{
+	if (__atomic_load_n(&g_compressEnabled, __ATOMIC_ACQUIRE) != 0 && path[0] != '\0')
+	{
+		(void)pthread_mutex_lock(&g_compressMutex);
+		if (g_pendingCount < MAX_PENDING_FILES)
+		{
+			char *slot = g_pendingFiles[(g_pendingHead + g_pendingCount) % MAX_PENDING_FILES];
+
+			strncpy(slot, path, MAX_PATH_SIZE - 1);
+			slot[MAX_PATH_SIZE - 1] = '\0';
+			g_pendingCount++;
+			(void)pthread_cond_signal(&g_compressCond);
+		}
+		else
+		{
+			// never wait for the compressor, the file is just left uncompressed
+			fprintf(stderr, "%s: queue full, %s left uncompressed\n", __func__, path);
+		}
+		(void)pthread_mutex_unlock(&g_compressMutex);
+	}
+}
+
+static int CompressFile(const char *path, int level)
+{
+	char target[MAX_PATH_SIZE + 8];
+	char temporary[MAX_PATH_SIZE + 16];
+	char mode[4];
+	char *buffer;
+	gzFile out;
+	ssize_t length;
+	int compressed = 0;
+	int fd;
+
+	snprintf(target, sizeof(target), "%s.gz", path);
+	snprintf(temporary, sizeof(temporary), "%s.gz.tmp", path);
+	snprintf(mode, sizeof(mode), "wb%d", level);
+
+	buffer = (char *)malloc(COPY_BUFFER_SIZE);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (buffer != NULL && fd >= 0)
+	{
+		out = gzopen(temporary, mode);
+		if (out != NULL)
+		{
+			compressed = 1;
+			while ((length = read(fd, buffer, COPY_BUFFER_SIZE)) > 0)
+			{
+				if (gzwrite(out, buffer, (unsigned int)length) != (int)length)
+				{
+					compressed = 0;
+					break;
+				}
+			}
+			if (length < 0)
+			{
+				compressed = 0;
+			}
+
+			if (gzclose(out) != Z_OK)
+			{
+				compressed = 0;
+			}
+
+			// the original is only removed once the complete archive and its name are on the disk
+			if (compressed != 0 && SyncPath(temporary, 0) != 0 && PublishArchive(temporary, target) != 0 &&
+				SyncPath(target, 1) != 0)
+			{
+				(void)unlink(path);
+			}
+			else
+			{
+				fprintf(stderr, "%s: compress %s failed, left uncompressed\n", __func__, path);
+				(void)unlink(temporary);
+				compressed = 0;
+			}
+		}
+	}
+	else if (fd < 0 && errno != ENOENT)
+	{
+		fprintf(stderr, "%s: open %s failed\n", __func__, path);
+	}
+
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	free(buffer);
+
+	return compressed;
+}
+
+// never replace an existing archive, it holds older lines of a reused segment name
+static int PublishArchive(const char *temporary, const char *target)
+{
+	int published = 0;
+
+	if (link(temporary, target) == 0)
+	{
+		(void)unlink(temporary);
+		published = 1;
+	}
+	else if (errno == EEXIST)
+	{
+		fprintf(stderr, "%s: %s already exists\n", __func__, target);
+	}
+	else if ((errno == EPERM || errno == EOPNOTSUPP || errno == ENOSYS) && access(target, F_OK) != 0)
+	{
+		// the file system has no hard links
+		published = (rename(temporary, target) == 0) ? 1 : 0;
+	}
+
+	return published;
+}
+
+static int SyncPath(const char *path, int directory)
+{
+	char copy[MAX_PATH_SIZE + 8];
+	int synced = 0;
+	int fd;
+
+	if (directory != 0)
+	{
+		snprintf(copy, sizeof(copy), "%s", path);
+		path = dirname(copy);
+	}
+
+	fd = open(path, O_RDONLY | O_CLOEXEC | ((directory != 0) ? O_DIRECTORY : 0));
+	if (fd >= 0)
+	{
+		synced = (fsync(fd) == 0) ? 1 : 0;
+		close(fd);
+	}
+
+	if (synced == 0)
+	{
+		fprintf(stderr, "%s: sync %s failed\n", __func__, path);
+	}
+
+	return synced;
+}
+
+static void LowerPriority(void)
+{
+	pid_t tid = (pid_t)syscall(SYS_gettid);
+
+	// both apply to the calling thread only, TCLog callers keep their priority
+	(void)setpriority(PRIO_PROCESS, (id_t)tid, 19);
+#ifdef SYS_ioprio_set
+	(void)syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+}
+
+static void *CompressThread(void *arg)
+{
+	char path[MAX_PATH_SIZE];
+	int level;
+
+	(void)arg;
+	LowerPriority();
+
+	(void)pthread_mutex_lock(&g_compressMutex);
+	while (g_compressRun != 0 || g_pendingCount > 0U)
+	{
+		if (g_pendingCount == 0U)
+		{
+			(void)pthread_cond_wait(&g_compressCond, &g_compressMutex);
+			continue;
+		}
+
+		memcpy(path, g_pendingFiles[g_pendingHead], sizeof(path));
+		g_pendingHead = (g_pendingHead + 1) % MAX_PENDING_FILES;
+		g_pendingCount--;
+		level = __atomic_load_n(&g_compressLevel, __ATOMIC_RELAXED);
+		(void)pthread_mutex_unlock(&g_compressMutex);
+
+		(void)CompressFile(path, level);
+
+		(void)pthread_mutex_lock(&g_compressMutex);
+	}
+	(void)pthread_mutex_unlock(&g_compressMutex);
+
+	return NULL;
+}
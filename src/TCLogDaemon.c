@@ -0,0 +1,396 @@
+/****************************************************************************************
+ *   FileName    : TCLogDaemon.c
+ *   Description : Client side of the tclogd shared memory ring
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+#include "TCLogDaemon.h"
+
+#define DEFAULT_RING_SIZE	(1024 * 1024)
+#define MIN_RING_SIZE		65536
+#define HELLO_TIMEOUT_SEC	2
+#define BLOCK_WAIT_NS		1000000L
+
+static int CreateRing(uint32_t size);
+static int SendHello(int memfd, uint32_t size);
+static int WriteRecord(TCLogLevel level, const TCLogTime *logTime, const char *text, unsigned int length);
+static int IsDaemonGone(void);
+static void Kick(void);
+static void ReleaseRing(void);
+static void RegisterAtfork(void);
+static void ForgetInChild(void);
+
+static pthread_mutex_t g_daemonMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_atforkOnce = PTHREAD_ONCE_INIT;
+static TCLogDaemonRing *g_ring = NULL;
+static char *g_data = NULL;
+static uint32_t g_size = 0;
+static int g_socket = -1;
+static int g_connected = 0;
+static int g_kicked = 0;
+static TCLogAsyncPolicy g_policy = TCLogAsyncDropNewest;
+
+int TCLogConnectDaemon(const char *path, unsigned int ringBytes, TCLogAsyncPolicy policy)
+{
+	struct sockaddr_un address;
+	uint32_t size;
+	int memfd;
+	int connected = 0;
+
+	if (path == NULL)
+	{
+		path = TC_LOG_DAEMON_SOCKET;
+	}
+	if (strlen(path) >= sizeof(address.sun_path))
+	{
+		fprintf(stderr, "%s: invalid socket path\n", __func__);
+		return 0;
+	}
+	if (policy != TCLogAsyncBlock && policy != TCLogAsyncDropNewest)
+	{
+		fprintf(stderr, "%s: only the block and drop newest policies apply to the daemon ring\n", __func__);
+		return 0;
+	}
+	if (TCLogMutex() == NULL)
+	{
+		fprintf(stderr, "%s: TCLogInitialize must be called first\n", __func__);
+		return 0;
+	}
+
+	size = (ringBytes != 0U) ? ringBytes : DEFAULT_RING_SIZE;
+	size = (size < MIN_RING_SIZE) ? MIN_RING_SIZE : size;
+	size -= size % TC_LOG_DAEMON_ALIGN;
+
+	(void)pthread_once(&g_atforkOnce, RegisterAtfork);
+	(void)pthread_mutex_lock(&g_daemonMutex);
+	if (g_connected != 0)
+	{
+		fprintf(stderr, "%s: already connected\n", __func__);
+	}
+	else
+	{
+		memset(&address, 0x00, sizeof(address));
+		address.sun_family = AF_UNIX;
+		(void)strcpy(address.sun_path, path);
+
+		g_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (g_socket < 0 || connect(g_socket, (const struct sockaddr *)&address, sizeof(address)) != 0)
+		{
+			fprintf(stderr, "%s: connect %s failed, %s\n", __func__, path, strerror(errno));
+		}
+		else if ((memfd = CreateRing(size)) >= 0)
+		{
+			connected = SendHello(memfd, size);
+			close(memfd);
+		}
+
+		if (connected != 0)
+		{
+			g_policy = policy;
+			g_kicked = 0;
+			__atomic_store_n(&g_connected, 1, __ATOMIC_RELEASE);
+		}
+		else
+		{
+			ReleaseRing();
+		}
+	}
+	(void)pthread_mutex_unlock(&g_daemonMutex);
+
+	return connected;
+}
+
+void TCLogDisconnectDaemon(void)
+{
+	unsigned long long dropped = 0;
+
+	(void)pthread_mutex_lock(&g_daemonMutex);
+	if (g_connected != 0)
+	{
+		// tclogd drains what is left once the socket is closed, the memfd lives on in its mapping
+		dropped = __atomic_load_n(&g_ring->dropped, __ATOMIC_RELAXED);
+		__atomic_store_n(&g_connected, 0, __ATOMIC_RELEASE);
+		ReleaseRing();
+	}
+	(void)pthread_mutex_unlock(&g_daemonMutex);
+
+	if (dropped != 0ULL)
+	{
+		fprintf(stderr, "%s: %llu lines dropped on a full ring\n", __func__, dropped);
+	}
+}
+
+int TCLogDaemonConnected(void)
+{
+	return __atomic_load_n(&g_connected, __ATOMIC_ACQUIRE);
+}
+
+int TCLogDaemonPush(TCLogLevel level, const TCLogTime *logTime, const char *text, unsigned int length)
+{
+	int pushed = -1;
+
+	if (__atomic_load_n(&g_connected, __ATOMIC_ACQUIRE) != 0)
+	{
+		(void)pthread_mutex_lock(&g_daemonMutex);
+		if (g_connected != 0)
+		{
+			pushed = WriteRecord(level, logTime, text, length);
+		}
+		(void)pthread_mutex_unlock(&g_daemonMutex);
+	}
+
+	return pushed;
+}
+
+static int CreateRing(uint32_t size)
+{
+	size_t mapSize = TC_LOG_DAEMON_DATA_OFFSET + (size_t)size;
+	void *map;
+	int memfd = -1;
+
+#ifdef SYS_memfd_create
+	memfd = (int)syscall(SYS_memfd_create, "tclog-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+	if (memfd < 0)
+	{
+		fprintf(stderr, "%s: memfd_create failed\n", __func__);
+		return -1;
+	}
+
+	// tclogd maps the ring too, a sealed size can not be cut under its feet
+	if (ftruncate(memfd, (off_t)mapSize) != 0 ||
+		fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0)
+	{
+		fprintf(stderr, "%s: size the ring failed\n", __func__);
+		close(memfd);
+		return -1;
+	}
+
+	map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	if (map == MAP_FAILED)
+	{
+		fprintf(stderr, "%s: mmap the ring failed\n", __func__);
+		close(memfd);
+		return -1;
+	}
+
+	g_ring = (TCLogDaemonRing *)map;
+	g_data = (char *)map + TC_LOG_DAEMON_DATA_OFFSET;
+	g_size = size;
+	memcpy(g_ring->magic, TC_LOG_DAEMON_MAGIC, 4);
+	g_ring->version = TC_LOG_DAEMON_VERSION;
+	g_ring->size = size;
+
+	return memfd;
+}
+
+static int SendHello(int memfd, uint32_t size)
+{
+	TCLogDaemonHello hello;
+	struct msghdr message;
+	struct iovec iov;
+	struct cmsghdr *control;
+	struct timeval timeout;
+	char buffer[CMSG_SPACE(sizeof(int))];
+	char reply = 0;
+
+	memset(&hello, 0x00, sizeof(hello));
+	memcpy(hello.magic, TC_LOG_DAEMON_MAGIC, 4);
+	hello.version = TC_LOG_DAEMON_VERSION;
+	hello.pid = (int32_t)getpid();
+	hello.size = size;
+
+	memset(&message, 0x00, sizeof(message));
+	memset(buffer, 0x00, sizeof(buffer));
+	iov.iov_base = &hello;
+	iov.iov_len = sizeof(hello);
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	message.msg_control = buffer;
+	message.msg_controllen = sizeof(buffer);
+	control = CMSG_FIRSTHDR(&message);
+	control->cmsg_level = SOL_SOCKET;
+	control->cmsg_type = SCM_RIGHTS;
+	control->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(control), &memfd, sizeof(int));
+
+	// the ring only counts once tclogd has mapped it
+	timeout.tv_sec = HELLO_TIMEOUT_SEC;
+	timeout.tv_usec = 0;
+	(void)setsockopt(g_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	if (sendmsg(g_socket, &message, MSG_NOSIGNAL) != (ssize_t)sizeof(hello) || recv(g_socket, &reply, 1, 0) != 1 ||
+		reply != 'K')
+	{
+		fprintf(stderr, "%s: tclogd refused the ring\n", __func__);
+		return 0;
+	}
+
+	return 1;
+}
+
+// called with g_daemonMutex held, returns 0 for a dropped line and -1 to write it locally
+static int WriteRecord(TCLogLevel level, const TCLogTime *logTime, const char *text, unsigned int length)
+{
+	const struct timespec wait = { 0, BLOCK_WAIT_NS };
+	TCLogDaemonRecord *record;
+	uint32_t need = (uint32_t)((sizeof(TCLogDaemonRecord) + length + TC_LOG_DAEMON_ALIGN - 1) &
+							   ~(size_t)(TC_LOG_DAEMON_ALIGN - 1));
+	uint64_t head = g_ring->head;
+	uint64_t tail;
+	uint32_t position;
+	uint32_t contiguous;
+
+	if (need > g_size / 2)
+	{
+		return -1;
+	}
+
+	for (;;)
+	{
+		tail = __atomic_load_n(&g_ring->tail, __ATOMIC_ACQUIRE);
+		position = (uint32_t)(head % g_size);
+		contiguous = g_size - position;
+		if (head + ((contiguous < need) ? contiguous + need : need) - tail <= g_size)
+		{
+			break;
+		}
+
+		if (IsDaemonGone() != 0)
+		{
+			fprintf(stderr, "%s: tclogd went away, back to the local output\n", __func__);
+			__atomic_store_n(&g_connected, 0, __ATOMIC_RELEASE);
+			ReleaseRing();
+			return -1;
+		}
+		if (g_kicked == 0)
+		{
+			Kick();
+		}
+		if (g_policy == TCLogAsyncDropNewest)
+		{
+			__atomic_store_n(&g_ring->dropped, g_ring->dropped + 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+		(void)nanosleep(&wait, NULL);
+	}
+
+	if (contiguous < need)
+	{
+		*(uint32_t *)(g_data + position) = TC_LOG_DAEMON_WRAP;
+		head += contiguous;
+		position = 0;
+	}
+
+	record = (TCLogDaemonRecord *)(g_data + position);
+	record->length = length;
+	record->stampMs = (uint16_t)logTime->stampMs;
+	record->level = (uint8_t)level;
+	record->monotonic = (uint8_t)logTime->monotonic;
+	record->epoch = (int64_t)logTime->epoch;
+	memcpy(record + 1, text, length);
+	head += need;
+	__atomic_store_n(&g_ring->head, head, __ATOMIC_RELEASE);
+
+	// tclogd drains on its own interval, half a ring waiting is worth waking it up
+	if (head - tail > g_size / 2)
+	{
+		if (g_kicked == 0)
+		{
+			Kick();
+		}
+	}
+	else
+	{
+		g_kicked = 0;
+	}
+
+	return 1;
+}
+
+static int IsDaemonGone(void)
+{
+	struct pollfd pfd;
+	char scratch[16];
+
+	pfd.fd = g_socket;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	return (poll(&pfd, 1, 0) > 0 &&
+			((pfd.revents & (POLLHUP | POLLERR)) != 0 || recv(g_socket, scratch, sizeof(scratch), MSG_DONTWAIT) == 0)) ? 1 : 0;
+}
+
+static void Kick(void)
+{
+	char kick = 'k';
+
+	(void)send(g_socket, &kick, 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+	g_kicked = 1;
+}
+
+static void ReleaseRing(void)
+{
+	if (g_ring != NULL)
+	{
+		(void)munmap(g_ring, TC_LOG_DAEMON_DATA_OFFSET + (size_t)g_size);
+		g_ring = NULL;
+		g_data = NULL;
+		g_size = 0;
+	}
+	if (g_socket >= 0)
+	{
+		close(g_socket);
+		g_socket = -1;
+	}
+}
+
+static void RegisterAtfork(void)
+{
+	(void)pthread_atfork(NULL, NULL, ForgetInChild);
+}
+
+static void ForgetInChild(void)
+{
+	// the ring has a single producer, a forked child logs through its own output
+	if (g_connected != 0)
+	{
+		g_connected = 0;
+		ReleaseRing();
+	}
+	(void)pthread_mutex_init(&g_daemonMutex, NULL);
+}
@@ -0,0 +1,93 @@
+/****************************************************************************************
+ *   FileName    : TCLogDaemon.h
+ *   Description : Shared memory ring layout between TCLog clients and tclogd
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#ifndef _TC_LOG_DAEMON_H
+#define _TC_LOG_DAEMON_H
+
+#include <stdint.h>
+
+/*
+ * A client creates a sealed memfd of TC_LOG_DAEMON_DATA_OFFSET + size bytes,
+ * starts it with TCLogDaemonRing and hands it to tclogd with SCM_RIGHTS next
+ * to a TCLogDaemonHello on a SOCK_STREAM socket. The socket stays open for
+ * the life of the client, its end tells tclogd to drain the ring one last
+ * time, a byte sent on it asks for an early drain.
+ *
+ * The ring carries TCLogDaemonRecord headers, each followed by 'length' bytes
+ * of formatted text and padded to TC_LOG_DAEMON_ALIGN. A record never wraps,
+ * the length TC_LOG_DAEMON_WRAP alone marks the rest of the ring as unused.
+ * 'head' and 'tail' count all bytes ever produced and consumed, the client
+ * only writes head and dropped, tclogd only writes tail.
+ */
+
+#define TC_LOG_DAEMON_SOCKET		"/run/tclogd.sock"
+#define TC_LOG_DAEMON_MAGIC			"TCLD"
+#define TC_LOG_DAEMON_VERSION		1
+#define TC_LOG_DAEMON_DATA_OFFSET	256
+#define TC_LOG_DAEMON_ALIGN			8
+#define TC_LOG_DAEMON_WRAP			0xFFFFFFFFU
+
+// older C libraries do not expose the memfd sealing constants
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS					1033
+#define F_GET_SEALS					1034
+#define F_SEAL_SEAL					0x0001
+#define F_SEAL_SHRINK				0x0002
+#define F_SEAL_GROW					0x0004
+#endif
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC					0x0001U
+#define MFD_ALLOW_SEALING			0x0002U
+#endif
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t size;
+	uint32_t reserved;
+	uint64_t dropped;
+	uint8_t padding0[40];
+	uint64_t head;
+	uint8_t padding1[56];
+	uint64_t tail;
+	uint8_t padding2[56];
+} TCLogDaemonRing;
+
+typedef struct {
+	uint32_t length;
+	uint16_t stampMs;
+	uint8_t level;
+	uint8_t monotonic;
+	int64_t epoch;
+} TCLogDaemonRecord;
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	int32_t pid;
+	uint32_t size;
+} TCLogDaemonHello;
+
+#endif // _TC_LOG_DAEMON_H
@@ -0,0 +1,560 @@
+/****************************************************************************************
+ *   FileName    : TCLogDecode.c
+ *   Description : tclog-decode, converts binary TCLog files back to the text layout
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+#include "TCLogBinary.h"
+
+#define FORMAT_HASH_SIZE	4096
+#define MAX_SPEC_SIZE		64
+
+typedef struct FormatEntry {
+	uint64_t id;
+	char *format;
+	struct FormatEntry *next;
+} FormatEntry;
+
+static int DecodeFile(FILE *in, const char *name);
+static int DecodeHeader(const uint8_t *payload, unsigned int length);
+static void AddFormat(const uint8_t *payload, unsigned int length);
+static const char *FindFormat(uint64_t id);
+static void ReleaseFormats(void);
+static void PrintLine(uint8_t level, const uint8_t *payload, unsigned int length);
+static void PrintEvent(uint8_t level, const uint8_t *payload, unsigned int length);
+static const char *ReadName(const uint8_t **p, const uint8_t *end, char **scratch);
+static void PrintMessage(const char *format, const uint8_t *args, unsigned int length);
+static char *ReadString(const uint8_t **args, const uint8_t *end, char *buffer, size_t size);
+
+static FormatEntry *g_formats[FORMAT_HASH_SIZE];
+static char g_prefix[258];
+static char g_subPrefix[258];
+static int g_hasPrefix = 0;
+static int g_hasSubPrefix = 0;
+static int g_useTime = 0;
+static const char *g_logLevelNames[TotalTCLogLevels] = {
+	"ERROR",
+	"WARN",
+	"INFO",
+	"DEBUG"
+};
+
+int main(int argc, char *argv[])
+{
+	int ret = 0;
+	int i;
+
+	if (argc < 2)
+	{
+		ret = DecodeFile(stdin, "stdin");
+	}
+	else
+	{
+		for (i = 1; i < argc; i++)
+		{
+			FILE *in;
+
+			if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+			{
+				printf("usage: %s [FILE]...\n", argv[0]);
+				printf("decode binary logs written with TCLogBinary() and TCLogEvent(), standard input without FILE\n");
+				break;
+			}
+
+			in = fopen(argv[i], "rb");
+			if (in != NULL)
+			{
+				if (DecodeFile(in, argv[i]) != 0)
+				{
+					ret = 1;
+				}
+				fclose(in);
+			}
+			else
+			{
+				fprintf(stderr, "%s: open %s failed\n", argv[0], argv[i]);
+				ret = 1;
+			}
+		}
+	}
+
+	return ret;
+}
+
+static int DecodeFile(FILE *in, const char *name)
+{
+	uint8_t payload[65536];
+	TCLogRecordHead head;
+	int ret = 0;
+
+	while (fread(&head, sizeof(head), 1, in) == 1)
+	{
+		if (fread(payload, 1, head.length, in) != head.length)
+		{
+			fprintf(stderr, "%s: truncated record\n", name);
+			ret = 1;
+			break;
+		}
+
+		if (head.type == TCLogRecordHeader)
+		{
+			ReleaseFormats();
+			if (DecodeHeader(payload, head.length) != 0)
+			{
+				fprintf(stderr, "%s: not a binary log of this byte order or version\n", name);
+				ret = 1;
+				break;
+			}
+		}
+		else if (head.type == TCLogRecordFormat)
+		{
+			AddFormat(payload, head.length);
+		}
+		else if (head.type == TCLogRecordLine)
+		{
+			PrintLine(head.level, payload, head.length);
+		}
+		else if (head.type == TCLogRecordEvent)
+		{
+			PrintEvent(head.level, payload, head.length);
+		}
+		else
+		{
+			fprintf(stderr, "%s: unknown record type %u\n", name, head.type);
+		}
+	}
+	ReleaseFormats();
+
+	return ret;
+}
+
+static int DecodeHeader(const uint8_t *payload, unsigned int length)
+{
+	const uint8_t *p = payload + 8;
+	const uint8_t *end = payload + length;
+	uint16_t byteOrder;
+
+	if (length < 8 || memcmp(payload, TC_LOG_BINARY_MAGIC, 4) != 0 || payload[4] != TC_LOG_BINARY_VERSION)
+	{
+		return -1;
+	}
+
+	memcpy(&byteOrder, &payload[6], 2);
+	if (byteOrder != TC_LOG_BINARY_BYTE_ORDER)
+	{
+		return -1;
+	}
+
+	g_useTime = payload[5];
+	g_hasPrefix = (ReadString(&p, end, g_prefix, sizeof(g_prefix)) != NULL);
+	g_hasSubPrefix = (ReadString(&p, end, g_subPrefix, sizeof(g_subPrefix)) != NULL);
+
+	return 0;
+}
+
+static void AddFormat(const uint8_t *payload, unsigned int length)
+{
+	FormatEntry *entry;
+
+	if (length >= 8)
+	{
+		entry = (FormatEntry *)malloc(sizeof(FormatEntry));
+		if (entry != NULL)
+		{
+			memcpy(&entry->id, payload, 8);
+			entry->format = (char *)malloc(length - 8 + 1);
+			if (entry->format != NULL)
+			{
+				unsigned int index = (unsigned int)((entry->id >> 3) % FORMAT_HASH_SIZE);
+
+				memcpy(entry->format, payload + 8, length - 8);
+				entry->format[length - 8] = '\0';
+				entry->next = g_formats[index];
+				g_formats[index] = entry;
+			}
+			else
+			{
+				free(entry);
+			}
+		}
+	}
+}
+
+static const char *FindFormat(uint64_t id)
+{
+	const FormatEntry *entry = g_formats[(id >> 3) % FORMAT_HASH_SIZE];
+
+	while (entry != NULL && entry->id != id)
+	{
+		entry = entry->next;
+	}
+
+	return (entry != NULL) ? entry->format : NULL;
+}
+
+static void ReleaseFormats(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < FORMAT_HASH_SIZE; i++)
+	{
+		while (g_formats[i] != NULL)
+		{
+			FormatEntry *entry = g_formats[i];
+			g_formats[i] = entry->next;
+			free(entry->format);
+			free(entry);
+		}
+	}
+}
+
+static void PrintLine(uint8_t level, const uint8_t *payload, unsigned int length)
+{
+	TCLogTime logTime;
+	const char *format;
+	uint64_t id;
+	int64_t value;
+	uint16_t ms;
+
+	if (length < TC_LOG_BINARY_LINE_SIZE || level >= TotalTCLogLevels)
+	{
+		return;
+	}
+
+	memcpy(&id, &payload[0], 8);
+	memset(&logTime, 0x00, sizeof(logTime));
+	memcpy(&value, &payload[8], 8);
+	logTime.epoch = (long)value;
+	memcpy(&value, &payload[16], 8);
+	logTime.stampSec = (long)value;
+	memcpy(&ms, &payload[24], 2);
+	logTime.stampMs = ms;
+	logTime.monotonic = payload[26];
+
+	if (g_useTime != 0)
+	{
+		char stamp[64];
+
+		(void)TCLogFormatTime(stamp, sizeof(stamp), &logTime);
+		fputs(stamp, stdout);
+	}
+
+	if (g_hasPrefix != 0 && g_hasSubPrefix != 0)
+	{
+		printf("[%s][%s][%s] ", g_logLevelNames[level], g_prefix, g_subPrefix);
+	}
+	else if (g_hasPrefix != 0)
+	{
+		printf("[%s][%s] ", g_logLevelNames[level], g_prefix);
+	}
+	else
+	{
+		printf("[%s][NO NAME] ", g_logLevelNames[level]);
+	}
+
+	format = FindFormat(id);
+	if (format != NULL)
+	{
+		PrintMessage(format, payload + TC_LOG_BINARY_LINE_SIZE, length - TC_LOG_BINARY_LINE_SIZE);
+	}
+	else
+	{
+		printf("<unknown format 0x%llx>\n", (unsigned long long)id);
+	}
+}
+
+static void PrintEvent(uint8_t level, const uint8_t *payload, unsigned int length)
+{
+	// names and string values are copied out NUL terminated, 2 bytes per record byte is plenty
+	char scratch[TC_LOG_BINARY_RECORD_SIZE * 2];
+	char line[TC_LOG_BINARY_RECORD_SIZE * 4];
+	TCLogField fields[255];
+	TCLogTime logTime;
+	const uint8_t *p = payload + TC_LOG_BINARY_EVENT_SIZE;
+	const uint8_t *end = payload + length;
+	char *next = scratch;
+	const char *event;
+	unsigned int count;
+	unsigned int i;
+	int64_t value;
+	uint16_t ms;
+
+	if (length < TC_LOG_BINARY_EVENT_SIZE || level >= TotalTCLogLevels || length > TC_LOG_BINARY_RECORD_SIZE)
+	{
+		return;
+	}
+
+	memset(&logTime, 0x00, sizeof(logTime));
+	memcpy(&value, &payload[0], 8);
+	logTime.epoch = (long)value;
+	memcpy(&value, &payload[8], 8);
+	logTime.stampSec = (long)value;
+	memcpy(&ms, &payload[16], 2);
+	logTime.stampMs = ms;
+	logTime.monotonic = payload[18];
+	count = payload[19];
+
+	event = ReadName(&p, end, &next);
+	for (i = 0; i < count && event != NULL; i++)
+	{
+		TCLogField *field = &fields[i];
+
+		memset(field, 0x00, sizeof(*field));
+		if (p >= end)
+		{
+			break;
+		}
+		field->type = (TCLogFieldType)*p++;
+		field->key = ReadName(&p, end, &next);
+		if (field->key == NULL)
+		{
+			break;
+		}
+
+		if (field->type == TCLogFieldInt || field->type == TCLogFieldDouble)
+		{
+			if (end - p < 8)
+			{
+				break;
+			}
+			if (field->type == TCLogFieldInt)
+			{
+				memcpy(&value, p, 8);
+				field->i = (long long)value;
+			}
+			else
+			{
+				memcpy(&field->d, p, 8);
+			}
+			p += 8;
+		}
+		else if (field->type == TCLogFieldString || field->type == TCLogFieldBytes)
+		{
+			uint16_t bytes;
+
+			if (end - p < 2)
+			{
+				break;
+			}
+			memcpy(&bytes, p, 2);
+			p += 2;
+			if (bytes == TC_LOG_BINARY_NULL_STRING)
+			{
+				field->p = NULL;
+			}
+			else if (end - p < bytes)
+			{
+				break;
+			}
+			else
+			{
+				memcpy(next, p, bytes);
+				next[bytes] = '\0';
+				field->p = next;
+				field->length = bytes;
+				next += bytes + 1;
+				p += bytes;
+			}
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if (event != NULL)
+	{
+		(void)TCLogEventFormatJson(line, sizeof(line), (TCLogLevel)level, &logTime,
+								   (g_hasPrefix != 0) ? g_prefix : NULL,
+								   (g_hasSubPrefix != 0) ? g_subPrefix : NULL, event, fields, i);
+		fputs(line, stdout);
+	}
+}
+
+static const char *ReadName(const uint8_t **p, const uint8_t *end, char **scratch)
+{
+	const char *name = NULL;
+	unsigned int length;
+
+	if (*p < end)
+	{
+		length = **p;
+		if ((unsigned int)(end - *p) > length)
+		{
+			memcpy(*scratch, *p + 1, length);
+			(*scratch)[length] = '\0';
+			name = *scratch;
+			*scratch += length + 1;
+			*p += length + 1;
+		}
+	}
+
+	return name;
+}
+
+static void PrintMessage(const char *format, const uint8_t *args, unsigned int length)
+{
+	const uint8_t *end = args + length;
+	const char *p = format;
+
+	while (*p != '\0')
+	{
+		TCLogConversion conversion;
+		char spec[MAX_SPEC_SIZE];
+		size_t used = 0;
+		int missing = 0;
+		int64_t integer;
+		double real;
+		int n;
+		int i;
+
+		if (*p != '%')
+		{
+			const char *next = strchr(p, '%');
+			size_t count = (next != NULL) ? (size_t)(next - p) : strlen(p);
+
+			(void)fwrite(p, 1, count, stdout);
+			p += count;
+			continue;
+		}
+
+		n = TCLogParseConversion(p, &conversion);
+		if (conversion.type == TCLogArgNone)
+		{
+			putchar('%');
+			p += n;
+			continue;
+		}
+
+		// rebuild the conversion with '*' resolved and the length modifier normalized
+		for (i = 0; i < n && used < sizeof(spec) - 4; i++)
+		{
+			if (p[i] == '*')
+			{
+				if (args + 8 <= end)
+				{
+					memcpy(&integer, args, 8);
+					args += 8;
+					used += (size_t)snprintf(&spec[used], sizeof(spec) - used, "%d", (int)integer);
+				}
+				else
+				{
+					missing = 1;
+				}
+			}
+			else if (conversion.type != TCLogArgInt && strchr("hlqjzZtL", p[i]) != NULL)
+			{
+				// dropped, added back below for 64-bit integers
+			}
+			else if (i == n - 1 && (conversion.type == TCLogArgLong || conversion.type == TCLogArgLongLong))
+			{
+				spec[used++] = 'l';
+				spec[used++] = 'l';
+				spec[used++] = p[i];
+			}
+			else
+			{
+				spec[used++] = p[i];
+			}
+		}
+		spec[used] = '\0';
+
+		if (conversion.type == TCLogArgString)
+		{
+			char string[1025];
+
+			if (missing == 0 && ReadString(&args, end, string, sizeof(string)) != NULL)
+				printf(spec, string);
+			else if (missing == 0 && args <= end)
+				printf(spec, "(null)");
+		}
+		else if (missing == 0 && args + 8 <= end)
+		{
+			memcpy(&integer, args, 8);
+			memcpy(&real, args, 8);
+			args += 8;
+
+			if (conversion.type == TCLogArgInt)
+				printf(spec, (int)integer);
+			else if (conversion.type == TCLogArgDouble || conversion.type == TCLogArgLongDouble)
+				printf(spec, real);
+			else if (conversion.type == TCLogArgPointer)
+				printf(spec, (void *)(uintptr_t)integer);
+			else
+				printf(spec, (long long)integer);
+		}
+		else
+		{
+			missing = 1;
+		}
+
+		if (missing != 0)
+		{
+			(void)fwrite(p, 1, (size_t)n, stdout);
+		}
+		p += n;
+	}
+}
+
+static char *ReadString(const uint8_t **args, const uint8_t *end, char *buffer, size_t size)
+{
+	char *string = NULL;
+	uint16_t length;
+
+	if (*args + 2 <= end)
+	{
+		memcpy(&length, *args, 2);
+		*args += 2;
+
+		if (length == TC_LOG_BINARY_NULL_STRING)
+		{
+			// NULL pointer argument
+		}
+		else if (*args + length <= end)
+		{
+			size_t count = (length < size - 1) ? length : size - 1;
+
+			memcpy(buffer, *args, count);
+			buffer[count] = '\0';
+			*args += length;
+			string = buffer;
+		}
+		else
+		{
+			*args = end + 1;
+		}
+	}
+	else
+	{
+		// mark the arguments as exhausted
+		*args = end + 1;
+	}
+
+	return string;
+}
@@ -0,0 +1,198 @@
+/****************************************************************************************
+ *   FileName    : TCLogEvent.c
+ *   Description : Structured key-value TCLog events
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+#include "TCLogBinary.h"
+
+static int EncodeTlv(uint8_t *record, unsigned int size, const TCLogTime *logTime, const char *event,
+					 const TCLogField *fields, unsigned int count);
+static unsigned int PutName(uint8_t *p, const uint8_t *end, const char *name);
+
+static TCLogEventFormat g_eventFormat = TCLogEventJson;
+
+int TCLogSetEventFormat(TCLogEventFormat format)
+{
+	int set = 0;
+
+	if (format >= TCLogEventJson && format < TotalTCLogEventFormats)
+	{
+		__atomic_store_n(&g_eventFormat, format, __ATOMIC_RELAXED);
+		set = 1;
+	}
+	else
+	{
+		fprintf(stderr, "%s: invalid event format %d\n", __func__, (int)format);
+	}
+
+	return set;
+}
+
+int TCLogEvent(TCLogLevel level, const char *event, const TCLogField *fields, unsigned int count)
+{
+	int printLog = TCLogIsLevelEnabled(level);
+
+	if (printLog != 0)
+	{
+		TCLogTime logTime;
+
+		TCLogThreadBufferGetTime(&logTime);
+
+		printLog = -1;
+		if (__atomic_load_n(&g_eventFormat, __ATOMIC_RELAXED) == TCLogEventTlv)
+		{
+			uint8_t record[TC_LOG_BINARY_RECORD_SIZE];
+			int length = EncodeTlv(record, sizeof(record), &logTime, event, fields, count);
+
+			// falls back to JSON Lines while no binary log is open
+			printLog = TCLogBinaryWriteEvent(level, record, (unsigned int)length);
+		}
+
+		if (printLog < 0)
+		{
+			char line[TC_LOG_LINE_SIZE];
+			const char *prefix;
+			const char *subPrefix;
+			int useTime;
+			int length;
+
+			TCLogGetPrefixes(&prefix, &subPrefix, &useTime);
+			length = TCLogEventFormatJson(line, sizeof(line), level, &logTime, prefix, subPrefix,
+										  event, fields, count);
+			printLog = TCLogEmit(level, &logTime, line, (unsigned int)length);
+		}
+
+		TCLogThreadBufferDone();
+	}
+
+	return printLog;
+}
+
+static int EncodeTlv(uint8_t *record, unsigned int size, const TCLogTime *logTime, const char *event,
+					 const TCLogField *fields, unsigned int count)
+{
+	const uint8_t *end = record + size;
+	uint8_t *p = record + TC_LOG_BINARY_EVENT_SIZE;
+	uint64_t value;
+	uint16_t length;
+	unsigned int encoded = 0;
+	unsigned int i;
+
+	value = (uint64_t)(int64_t)logTime->epoch;
+	memcpy(&record[0], &value, 8);
+	value = (uint64_t)(int64_t)logTime->stampSec;
+	memcpy(&record[8], &value, 8);
+	length = (uint16_t)logTime->stampMs;
+	memcpy(&record[16], &length, 2);
+	record[18] = (uint8_t)logTime->monotonic;
+
+	p += PutName(p, end, event);
+
+	for (i = 0; i < count && i < 255; i++)
+	{
+		const TCLogField *field = &fields[i];
+		uint8_t *start = p;
+		unsigned int keyLength;
+
+		if (end - p < 2)
+		{
+			break;
+		}
+		*p++ = (uint8_t)field->type;
+		keyLength = PutName(p, end, field->key);
+		if (keyLength == 0)
+		{
+			p = start;
+			break;
+		}
+		p += keyLength;
+
+		if (field->type == TCLogFieldInt || field->type == TCLogFieldDouble)
+		{
+			if (end - p < 8)
+			{
+				p = start;
+				break;
+			}
+			if (field->type == TCLogFieldInt)
+			{
+				value = (uint64_t)field->i;
+				memcpy(p, &value, 8);
+			}
+			else
+			{
+				memcpy(p, &field->d, 8);
+			}
+			p += 8;
+		}
+		else
+		{
+			size_t bytes = 0;
+
+			if (field->p != NULL)
+			{
+				bytes = (field->type == TCLogFieldString) ? strlen((const char *)field->p) : field->length;
+			}
+
+			// a value that does not fit ends the record, the fields before it are kept
+			if (end - p < 2 || (size_t)(end - p - 2) < bytes)
+			{
+				p = start;
+				break;
+			}
+			length = (field->p != NULL) ? (uint16_t)bytes : TC_LOG_BINARY_NULL_STRING;
+			memcpy(p, &length, 2);
+			if (bytes > 0)
+			{
+				memcpy(p + 2, field->p, bytes);
+			}
+			p += 2 + bytes;
+		}
+		encoded++;
+	}
+	record[19] = (uint8_t)encoded;
+
+	return (int)(p - record);
+}
+
+// length(u8) followed by at most 255 bytes, returns 0 when there is no room
+static unsigned int PutName(uint8_t *p, const uint8_t *end, const char *name)
+{
+	size_t length = (name != NULL) ? strnlen(name, 255) : 0;
+	unsigned int used = 0;
+
+	if ((size_t)(end - p) > length)
+	{
+		p[0] = (uint8_t)length;
+		memcpy(p + 1, name, length);
+		used = (unsigned int)length + 1;
+	}
+
+	return used;
+}
@@ -0,0 +1,271 @@
+/****************************************************************************************
+ *   FileName    : TCLogFlight.c
+ *   Description : Crash surviving in-memory flight recorder for TCLog
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+#include "TCLogFlight.h"
+
+#define MIN_FLIGHT_SIZE			4096
+#define MAX_FLIGHT_SIZE			(256 * 1024 * 1024)
+#define DEFAULT_FLIGHT_SIZE		(1024 * 1024)
+#define MAX_PATH_SIZE			256
+
+static void KeepPreviousRecording(const char *path);
+static void InstallCrashHandlers(void);
+static void RestoreCrashHandlers(void);
+static void CrashHandler(int sig, siginfo_t *info, void *context);
+
+static const int g_crashSignals[] = { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL };
+#define CRASH_SIGNAL_COUNT		((int)(sizeof(g_crashSignals) / sizeof(g_crashSignals[0])))
+
+static TCLogFlightHeader *g_header = NULL;
+static char *g_ring = NULL;
+static uint32_t g_ringSize = 0;
+static size_t g_mapSize = 0;
+static int g_flightFd = -1;
+static int g_writers = 0;
+static int g_handlersInstalled = 0;
+static struct sigaction g_previousActions[CRASH_SIGNAL_COUNT];
+static pthread_mutex_t g_flightMutex = PTHREAD_MUTEX_INITIALIZER;
+
+int TCLogOpenFlightRecorder(const char *path, unsigned int size, int crashHandler)
+{
+	TCLogFlightHeader *header;
+	int opened = 0;
+
+	if (path == NULL)
+	{
+		fprintf(stderr, "%s: path is null pointer\n", __func__);
+		return 0;
+	}
+
+	if (size == 0U)
+	{
+		size = DEFAULT_FLIGHT_SIZE;
+	}
+	else if (size < MIN_FLIGHT_SIZE || size > MAX_FLIGHT_SIZE)
+	{
+		fprintf(stderr, "%s: invalid size %u\n", __func__, size);
+		return 0;
+	}
+
+	TCLogCloseFlightRecorder();
+
+	(void)pthread_mutex_lock(&g_flightMutex);
+	KeepPreviousRecording(path);
+
+	g_flightFd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (g_flightFd >= 0)
+	{
+		g_mapSize = TC_LOG_FLIGHT_DATA_OFFSET + (size_t)size;
+		if (posix_fallocate(g_flightFd, 0, (off_t)g_mapSize) == 0)
+		{
+			header = (TCLogFlightHeader *)mmap(NULL, g_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, g_flightFd, 0);
+			if (header != (TCLogFlightHeader *)MAP_FAILED)
+			{
+				memset(header, 0x00, TC_LOG_FLIGHT_DATA_OFFSET);
+				memcpy(header->magic, TC_LOG_FLIGHT_MAGIC, 4);
+				header->version = TC_LOG_FLIGHT_VERSION;
+				header->size = size;
+
+				g_ring = (char *)header + TC_LOG_FLIGHT_DATA_OFFSET;
+				g_ringSize = size;
+				__atomic_store_n(&g_header, header, __ATOMIC_RELEASE);
+				opened = 1;
+
+				if (crashHandler != 0)
+				{
+					InstallCrashHandlers();
+				}
+			}
+		}
+
+		if (opened == 0)
+		{
+			fprintf(stderr, "%s: map %s failed\n", __func__, path);
+			close(g_flightFd);
+			g_flightFd = -1;
+		}
+	}
+	else
+	{
+		fprintf(stderr, "%s: open %s failed\n", __func__, path);
+	}
+	(void)pthread_mutex_unlock(&g_flightMutex);
+
+	// every level reaches the recorder, so the TC_LOG_* macros must not filter any
+	TCLogUpdateThreshold();
+
+	return opened;
+}
+
+void TCLogCloseFlightRecorder(void)
+{
+	TCLogFlightHeader *header;
+
+	(void)pthread_mutex_lock(&g_flightMutex);
+	header = __atomic_exchange_n(&g_header, NULL, __ATOMIC_SEQ_CST);
+	if (header != NULL)
+	{
+		RestoreCrashHandlers();
+
+		// a line being copied keeps the mapping alive until it is done
+		while (__atomic_load_n(&g_writers, __ATOMIC_SEQ_CST) != 0)
+		{
+			sched_yield();
+		}
+
+		(void)msync(header, g_mapSize, MS_ASYNC);
+		(void)munmap(header, g_mapSize);
+		close(g_flightFd);
+		g_flightFd = -1;
+		g_ring = NULL;
+	}
+	(void)pthread_mutex_unlock(&g_flightMutex);
+
+	TCLogUpdateThreshold();
+}
+
+int TCLogFlightEnabled(void)
+{
+	return (__atomic_load_n(&g_header, __ATOMIC_RELAXED) != NULL) ? 1 : 0;
+}
+
+void TCLogFlightWrite(const char *text, unsigned int length)
+{
+	TCLogFlightHeader *header;
+
+	__atomic_add_fetch(&g_writers, 1, __ATOMIC_SEQ_CST);
+	header = __atomic_load_n(&g_header, __ATOMIC_SEQ_CST);
+	if (header != NULL && length < g_ringSize)
+	{
+		uint64_t start = __atomic_fetch_add(&header->head, (uint64_t)length, __ATOMIC_RELAXED);
+		uint32_t offset = (uint32_t)(start % g_ringSize);
+		uint32_t first = (length < g_ringSize - offset) ? length : g_ringSize - offset;
+
+		memcpy(g_ring + offset, text, first);
+		if (first < length)
+		{
+			memcpy(g_ring, text + first, length - first);
+		}
+	}
+	__atomic_sub_fetch(&g_writers, 1, __ATOMIC_RELEASE);
+}
+
+// a recording left by a crashed run is kept as "<path>.1" for tclog-flight
+static void KeepPreviousRecording(const char *path)
+{
+	char previous[MAX_PATH_SIZE + 2];
+	TCLogFlightHeader header;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd >= 0)
+	{
+		if (read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+			memcmp(header.magic, TC_LOG_FLIGHT_MAGIC, 4) == 0 && header.head != 0U)
+		{
+			snprintf(previous, sizeof(previous), "%s.1", path);
+			if (rename(path, previous) != 0)
+			{
+				fprintf(stderr, "%s: keep %s failed\n", __func__, path);
+			}
+		}
+		close(fd);
+	}
+}
+
+static void InstallCrashHandlers(void)
+{
+	struct sigaction action;
+	int i;
+
+	if (g_handlersInstalled == 0)
+	{
+		memset(&action, 0x00, sizeof(action));
+		action.sa_sigaction = CrashHandler;
+		action.sa_flags = SA_SIGINFO;
+		(void)sigemptyset(&action.sa_mask);
+
+		for (i = 0; i < CRASH_SIGNAL_COUNT; i++)
+		{
+			(void)sigaction(g_crashSignals[i], &action, &g_previousActions[i]);
+		}
+		g_handlersInstalled = 1;
+	}
+}
+
+static void RestoreCrashHandlers(void)
+{
+	int i;
+
+	if (g_handlersInstalled != 0)
+	{
+		for (i = 0; i < CRASH_SIGNAL_COUNT; i++)
+		{
+			(void)sigaction(g_crashSignals[i], &g_previousActions[i], NULL);
+		}
+		g_handlersInstalled = 0;
+	}
+}
+
+// only async-signal-safe calls, the recording already sits in the page cache
+static void CrashHandler(int sig, siginfo_t *info, void *context)
+{
+	TCLogFlightHeader *header = __atomic_load_n(&g_header, __ATOMIC_RELAXED);
+	int i;
+
+	(void)info;
+	(void)context;
+
+	if (header != NULL)
+	{
+		header->signal = sig;
+		header->crashEpoch = (int64_t)time(NULL);
+		(void)fsync(g_flightFd);
+	}
+
+	// hand the signal to whoever had it before, it is delivered again once this handler returns
+	for (i = 0; i < CRASH_SIGNAL_COUNT; i++)
+	{
+		if (g_crashSignals[i] == sig)
+		{
+			(void)sigaction(sig, &g_previousActions[i], NULL);
+		}
+	}
+	(void)raise(sig);
+}
@@ -0,0 +1,53 @@
+/****************************************************************************************
+ *   FileName    : TCLogFlight.h
+ *   Description : Flight recorder file layout shared by TCLog and tclog-flight
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#ifndef _TC_LOG_FLIGHT_H
+#define _TC_LOG_FLIGHT_H
+
+#include <stdint.h>
+
+/*
+ * A flight recorder file is a TCLogFlightHeader followed by 'size' bytes of
+ * ring. Formatted lines of every level are copied into the ring at offset
+ * (head % size), head counts all bytes ever written. Once head exceeds size
+ * the oldest line in the ring is usually cut, readers skip to the first
+ * new line. 'signal' is set by the crash handler before it syncs the file.
+ */
+
+#define TC_LOG_FLIGHT_MAGIC			"TCFR"
+#define TC_LOG_FLIGHT_VERSION		1
+#define TC_LOG_FLIGHT_DATA_OFFSET	64
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t size;
+	int32_t signal;
+	int64_t crashEpoch;
+	uint64_t head;
+	uint8_t reserved[32];
+} TCLogFlightHeader;
+
+#endif // _TC_LOG_FLIGHT_H
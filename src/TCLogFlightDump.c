@@ -0,0 +1,143 @@
+/****************************************************************************************
+ *   FileName    : TCLogFlightDump.c
+ *   Description : Prints the lines kept in a TCLog flight recorder file
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "TCLogFlight.h"
+
+static int DumpFile(FILE *in, const char *name);
+
+int main(int argc, char *argv[])
+{
+	int ret = 0;
+	int i;
+
+	if (argc < 2 || strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
+	{
+		printf("usage: %s FILE...\n", argv[0]);
+		printf("print the lines kept by TCLogOpenFlightRecorder(), oldest first\n");
+		ret = (argc < 2) ? 1 : 0;
+	}
+	else
+	{
+		for (i = 1; i < argc; i++)
+		{
+			FILE *in = fopen(argv[i], "rb");
+
+			if (in != NULL)
+			{
+				if (DumpFile(in, argv[i]) != 0)
+				{
+					ret = 1;
+				}
+				fclose(in);
+			}
+			else
+			{
+				fprintf(stderr, "%s: open %s failed\n", argv[0], argv[i]);
+				ret = 1;
+			}
+		}
+	}
+
+	return ret;
+}
+
+static int DumpFile(FILE *in, const char *name)
+{
+	TCLogFlightHeader header;
+	char *ring;
+	uint32_t start;
+	uint32_t length;
+	uint32_t i;
+	int ret = 1;
+
+	if (fread(&header, sizeof(header), 1, in) != 1 || memcmp(header.magic, TC_LOG_FLIGHT_MAGIC, 4) != 0 ||
+		header.version != TC_LOG_FLIGHT_VERSION)
+	{
+		fprintf(stderr, "%s: not a flight recorder file\n", name);
+		return ret;
+	}
+
+	ring = (char *)malloc(header.size);
+	if (ring != NULL && fseek(in, TC_LOG_FLIGHT_DATA_OFFSET, SEEK_SET) == 0 &&
+		fread(ring, 1, header.size, in) == header.size)
+	{
+		if (header.signal != 0)
+		{
+			time_t crash = (time_t)header.crashEpoch;
+			char stamp[32];
+			struct tm tm;
+
+			(void)localtime_r(&crash, &tm);
+			(void)strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+			fprintf(stderr, "%s: recording stopped by signal %d (%s) at %s\n", name,
+					header.signal, strsignal(header.signal), stamp);
+		}
+
+		if (header.head <= header.size)
+		{
+			start = 0;
+			length = (uint32_t)header.head;
+		}
+		else
+		{
+			// the ring wrapped, the oldest line is cut unless it starts right at the head
+			start = (uint32_t)(header.head % header.size);
+			length = header.size;
+			for (i = 0; i < length && ring[(start + i) % header.size] != '\n'; i++)
+			{
+			}
+			if (i < length)
+			{
+				start = (start + i + 1) % header.size;
+				length -= i + 1;
+			}
+		}
+
+		if (start + length <= header.size)
+		{
+			(void)fwrite(ring + start, 1, length, stdout);
+		}
+		else
+		{
+			(void)fwrite(ring + start, 1, header.size - start, stdout);
+			(void)fwrite(ring, 1, length - (header.size - start), stdout);
+		}
+		ret = 0;
+	}
+	else
+	{
+		fprintf(stderr, "%s: truncated file\n", name);
+	}
+	free(ring);
+
+	return ret;
+}
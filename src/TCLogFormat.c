@@ -0,0 +1,449 @@
+/****************************************************************************************
+ *   FileName    : TCLogFormat.c
+ *   Description : printf format string helpers for TCLog
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define MAX_FAST_WIDTH		128
+
+static int FormatConversion(char *buffer, size_t size, const char **format, va_list *args);
+static int FormatDigits(char *end, unsigned long long value, int hex, int upper);
+
+static const char g_decimalPairs[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+int TCLogParseConversion(const char *format, TCLogConversion *conversion)
+{
+	const char *p = format + 1;
+	int longCount = 0;
+	int shortCount = 0;
+	int longDouble = 0;
+	int wide = 0;
+
+	conversion->type = TCLogArgUnsupported;
+	conversion->widthStar = 0;
+	conversion->precisionStar = 0;
+	conversion->precision = -1;
+	conversion->specifier = '\0';
+
+	while (*p != '\0' && strchr("-+ #0'I", *p) != NULL)
+	{
+		p++;
+	}
+
+	if (*p == '*')
+	{
+		conversion->widthStar = 1;
+		p++;
+	}
+	else
+	{
+		while (*p >= '0' && *p <= '9')
+		{
+			p++;
+		}
+
+		if (*p == '$')
+		{
+			// positional arguments can not be replayed in order
+			return (int)(p - format) + 1;
+		}
+	}
+
+	if (*p == '.')
+	{
+		p++;
+		if (*p == '*')
+		{
+			conversion->precisionStar = 1;
+			p++;
+		}
+		else
+		{
+			conversion->precision = 0;
+			while (*p >= '0' && *p <= '9')
+			{
+				conversion->precision = conversion->precision * 10 + (*p - '0');
+				p++;
+			}
+		}
+	}
+
+	for (;;)
+	{
+		if (*p == 'h')
+		{
+			shortCount++;
+		}
+		else if (*p == 'l')
+		{
+			longCount++;
+		}
+		else if (*p == 'q' || *p == 'j')
+		{
+			longCount = 2;
+		}
+		else if (*p == 'L')
+		{
+			longDouble = 1;
+			longCount = 2;
+		}
+		else if (*p == 'z' || *p == 'Z' || *p == 't')
+		{
+			longCount = 1;
+		}
+		else
+		{
+			break;
+		}
+		p++;
+	}
+
+	conversion->specifier = *p;
+	switch (*p)
+	{
+		case '%':
+			conversion->type = TCLogArgNone;
+			break;
+		case 'd':
+		case 'i':
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			if (longCount >= 2)
+				conversion->type = TCLogArgLongLong;
+			else if (longCount == 1)
+				conversion->type = TCLogArgLong;
+			else
+				conversion->type = TCLogArgInt;
+			break;
+		case 'c':
+			wide = (longCount != 0);
+			conversion->type = TCLogArgInt;
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			conversion->type = (longDouble != 0) ? TCLogArgLongDouble : TCLogArgDouble;
+			break;
+		case 'p':
+			conversion->type = TCLogArgPointer;
+			break;
+		case 's':
+			wide = (longCount != 0);
+			conversion->type = TCLogArgString;
+			break;
+		default:
+			break;
+	}
+
+	if (wide != 0 || shortCount > 2)
+	{
+		conversion->type = TCLogArgUnsupported;
+	}
+
+	return (*p != '\0') ? (int)(p - format) + 1 : (int)(p - format);
+}
+
+int TCLogFormatMessage(char *buffer, size_t size, const char *format, va_list va)
+{
+	const char *p = format;
+	size_t length = 0;
+	int fast = (size > 0) ? 1 : 0;
+	va_list args;
+
+	va_copy(args, va);
+	while (fast != 0 && *p != '\0')
+	{
+		if (*p != '%')
+		{
+			if (length + 1 < size)
+			{
+				buffer[length++] = *p++;
+			}
+			else
+			{
+				fast = 0;
+			}
+		}
+		else
+		{
+			int written = FormatConversion(buffer + length, size - length, &p, &args);
+
+			if (written < 0)
+			{
+				fast = 0;
+			}
+			else
+			{
+				length += (size_t)written;
+			}
+		}
+	}
+	va_end(args);
+
+	// anything fancier than flags '-' '0', a width and d i u x X c s, or a line that does not fit
+	if (fast == 0)
+	{
+		return vsnprintf(buffer, size, format, va);
+	}
+
+	buffer[length] = '\0';
+
+	return (int)length;
+}
+
+static int FormatConversion(char *buffer, size_t size, const char **format, va_list *args)
+{
+	const char *p = *format + 1;
+	char digits[24];
+	char *end = digits + sizeof(digits);
+	const char *text = end;
+	int textLength = 0;
+	int leftAlign = 0;
+	int zeroPad = 0;
+	int numeric = 1;
+	int width = 0;
+	int longCount = 0;
+	int shortCount = 0;
+	char sign = '\0';
+	int total;
+	int pad;
+
+	for (;; p++)
+	{
+		if (*p == '-')
+		{
+			leftAlign = 1;
+		}
+		else if (*p == '0')
+		{
+			zeroPad = 1;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	while (*p >= '0' && *p <= '9')
+	{
+		width = width * 10 + (*p - '0');
+		if (width > MAX_FAST_WIDTH)
+		{
+			return -1;
+		}
+		p++;
+	}
+
+	for (;; p++)
+	{
+		if (*p == 'l')
+		{
+			longCount++;
+		}
+		else if (*p == 'z')
+		{
+			longCount = 1;
+		}
+		else if (*p == 'h')
+		{
+			shortCount++;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if (longCount > 2 || shortCount > 2 || (longCount != 0 && shortCount != 0))
+	{
+		return -1;
+	}
+
+	switch (*p)
+	{
+		case '%':
+			if (p != *format + 1)
+			{
+				return -1;
+			}
+			digits[0] = '%';
+			text = digits;
+			textLength = 1;
+			numeric = 0;
+			break;
+		case 'd':
+		case 'i':
+		{
+			long long value;
+			unsigned long long magnitude;
+
+			if (longCount == 2)
+				value = va_arg(*args, long long);
+			else if (longCount == 1)
+				value = va_arg(*args, long);
+			else if (shortCount == 2)
+				value = (signed char)va_arg(*args, int);
+			else if (shortCount == 1)
+				value = (short)va_arg(*args, int);
+			else
+				value = va_arg(*args, int);
+
+			magnitude = (value < 0) ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+			sign = (value < 0) ? '-' : '\0';
+			textLength = FormatDigits(end, magnitude, 0, 0);
+			text = end - textLength;
+			break;
+		}
+		case 'u':
+		case 'x':
+		case 'X':
+		{
+			unsigned long long value;
+
+			if (longCount == 2)
+				value = va_arg(*args, unsigned long long);
+			else if (longCount == 1)
+				value = va_arg(*args, unsigned long);
+			else if (shortCount == 2)
+				value = (unsigned char)va_arg(*args, unsigned int);
+			else if (shortCount == 1)
+				value = (unsigned short)va_arg(*args, unsigned int);
+			else
+				value = va_arg(*args, unsigned int);
+
+			textLength = FormatDigits(end, value, (*p != 'u'), (*p == 'X'));
+			text = end - textLength;
+			break;
+		}
+		case 'c':
+			if (longCount != 0 || shortCount != 0)
+			{
+				return -1;
+			}
+			digits[0] = (char)va_arg(*args, int);
+			text = digits;
+			textLength = 1;
+			numeric = 0;
+			break;
+		case 's':
+			if (longCount != 0 || shortCount != 0)
+			{
+				return -1;
+			}
+			text = va_arg(*args, const char *);
+			if (text == NULL)
+			{
+				text = "(null)";
+			}
+			textLength = (int)strlen(text);
+			numeric = 0;
+			break;
+		default:
+			return -1;
+	}
+
+	total = textLength + ((sign != '\0') ? 1 : 0);
+	pad = (width > total) ? width - total : 0;
+	if ((size_t)(total + pad) >= size)
+	{
+		return -1;
+	}
+
+	if (pad > 0 && leftAlign == 0 && (zeroPad == 0 || numeric == 0))
+	{
+		memset(buffer, ' ', (size_t)pad);
+		buffer += pad;
+	}
+	if (sign != '\0')
+	{
+		*buffer++ = sign;
+	}
+	if (pad > 0 && leftAlign == 0 && zeroPad != 0 && numeric != 0)
+	{
+		memset(buffer, '0', (size_t)pad);
+		buffer += pad;
+	}
+	memcpy(buffer, text, (size_t)textLength);
+	if (pad > 0 && leftAlign != 0)
+	{
+		memset(buffer + textLength, ' ', (size_t)pad);
+	}
+
+	*format = p + 1;
+
+	return total + pad;
+}
+
+// writes backwards from end, returns the number of digits
+static int FormatDigits(char *end, unsigned long long value, int hex, int upper)
+{
+	const char *hexDigits = (upper != 0) ? "0123456789ABCDEF" : "0123456789abcdef";
+	char *p = end;
+
+	if (hex != 0)
+	{
+		do
+		{
+			*--p = hexDigits[value & 0xFU];
+			value >>= 4;
+		} while (value != 0ULL);
+	}
+	else
+	{
+		while (value >= 100ULL)
+		{
+			unsigned int pair = (unsigned int)(value % 100ULL) * 2U;
+
+			value /= 100ULL;
+			*--p = g_decimalPairs[pair + 1];
+			*--p = g_decimalPairs[pair];
+		}
+		if (value >= 10ULL)
+		{
+			*--p = g_decimalPairs[value * 2 + 1];
+			*--p = g_decimalPairs[value * 2];
+		}
+		else
+		{
+			*--p = (char)('0' + value);
+		}
+	}
+
+	return (int)(end - p);
+}
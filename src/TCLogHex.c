@@ -0,0 +1,325 @@
+/****************************************************************************************
+ *   FileName    : TCLogHex.c
+ *   Description : Hex dump row encoder and deferred hex dump worker
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define HEX_ROW_BYTES			16
+#define HEX_OFFSET_SIZE			16		// "\n    XXXXXXXX | "
+#define HEX_BYTES_SIZE			(HEX_ROW_BYTES * 3)
+#define HEX_GUTTER_SIZE			(2 + HEX_ROW_BYTES)	// "| " followed by the printable bytes
+#define MAX_DEFERRED_BYTES		(1024 * 1024)
+
+typedef struct DeferredDump {
+	struct DeferredDump *next;
+	TCLogLevel level;
+	TCLogTime time;
+	unsigned int shown;
+	unsigned int length;
+	char title[64];
+	int hasTitle;
+	unsigned char bytes[];
+} DeferredDump;
+
+static void EncodeBytes(char *out, const unsigned char *bytes);
+static void StopWorker(void);
+static void *WorkerThread(void *arg);
+
+static const char g_hexDigits[16] = "0123456789ABCDEF";
+static unsigned int g_hexLimit = 0;
+static int g_hexAscii = 0;
+static int g_hexDeferred = 0;
+static int g_workerRun = 0;
+static int g_exitHandler = 0;
+static unsigned int g_pendingBytes = 0;
+static DeferredDump *g_pendingHead = NULL;
+static DeferredDump *g_pendingTail = NULL;
+static pthread_t g_workerThread;
+static pthread_mutex_t g_hexControlMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_hexMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_workerCond = PTHREAD_COND_INITIALIZER;
+
+int TCLogSetHexDumpOptions(unsigned int maxBytes, int ascii, int deferred)
+{
+	int set = 1;
+
+	(void)pthread_mutex_lock(&g_hexControlMutex);
+
+	__atomic_store_n(&g_hexLimit, maxBytes, __ATOMIC_RELAXED);
+	__atomic_store_n(&g_hexAscii, (ascii != 0) ? 1 : 0, __ATOMIC_RELAXED);
+
+	if (deferred != 0 && g_workerRun == 0)
+	{
+		g_workerRun = 1;
+		if (pthread_create(&g_workerThread, NULL, WorkerThread, NULL) == 0)
+		{
+			if (g_exitHandler == 0)
+			{
+				g_exitHandler = (atexit(StopWorker) == 0) ? 1 : 0;
+			}
+			__atomic_store_n(&g_hexDeferred, 1, __ATOMIC_RELEASE);
+		}
+		else
+		{
+			fprintf(stderr, "%s: create hex dump thread failed\n", __func__);
+			g_workerRun = 0;
+			set = 0;
+		}
+	}
+	(void)pthread_mutex_unlock(&g_hexControlMutex);
+
+	if (deferred == 0)
+	{
+		StopWorker();
+	}
+
+	return set;
+}
+
+unsigned int TCLogHexShownBytes(unsigned int length)
+{
+	unsigned int limit = __atomic_load_n(&g_hexLimit, __ATOMIC_RELAXED);
+
+	return (limit != 0U && length > limit) ? limit : length;
+}
+
+unsigned int TCLogHexRowSize(void)
+{
+	return HEX_OFFSET_SIZE + HEX_BYTES_SIZE +
+		   ((__atomic_load_n(&g_hexAscii, __ATOMIC_RELAXED) != 0) ? HEX_GUTTER_SIZE : 0);
+}
+
+unsigned int TCLogHexFormatRow(char *out, const unsigned char *bytes, unsigned int count, unsigned int offset)
+{
+	char *p = out;
+	int shift;
+	unsigned int i;
+
+	memcpy(p, "\n    ", 5);
+	p += 5;
+	for (shift = 28; shift >= 0; shift -= 4)
+	{
+		*p++ = g_hexDigits[(offset >> shift) & 0x0FU];
+	}
+	memcpy(p, " | ", 3);
+	p += 3;
+
+	if (count == HEX_ROW_BYTES)
+	{
+		EncodeBytes(p, bytes);
+		p += HEX_BYTES_SIZE;
+	}
+	else
+	{
+		for (i = 0; i < count; i++)
+		{
+			p[0] = g_hexDigits[bytes[i] >> 4];
+			p[1] = g_hexDigits[bytes[i] & 0x0FU];
+			p[2] = ' ';
+			p += 3;
+		}
+	}
+
+	if (__atomic_load_n(&g_hexAscii, __ATOMIC_RELAXED) != 0)
+	{
+		// pad a short last row so the gutter stays aligned
+		for (i = count; i < HEX_ROW_BYTES; i++)
+		{
+			memcpy(p, "   ", 3);
+			p += 3;
+		}
+		memcpy(p, "| ", 2);
+		p += 2;
+		for (i = 0; i < count; i++)
+		{
+			*p++ = (bytes[i] >= 0x20 && bytes[i] < 0x7F) ? (char)bytes[i] : '.';
+		}
+	}
+
+	return (unsigned int)(p - out);
+}
+
+int TCLogHexDefer(TCLogLevel level, const TCLogTime *logTime, const void *buffer,
+				  unsigned int length, const char *title)
+{
+	int deferred = -1;
+
+	if (__atomic_load_n(&g_hexDeferred, __ATOMIC_ACQUIRE) != 0)
+	{
+		unsigned int shown = TCLogHexShownBytes(length);
+		DeferredDump *dump = (DeferredDump *)malloc(sizeof(DeferredDump) + shown);
+
+		if (dump != NULL)
+		{
+			dump->next = NULL;
+			dump->level = level;
+			dump->time = *logTime;
+			dump->shown = shown;
+			dump->length = length;
+			dump->hasTitle = (title != NULL) ? 1 : 0;
+			dump->title[0] = '\0';
+			if (title != NULL)
+			{
+				strncpy(dump->title, title, sizeof(dump->title) - 1);
+				dump->title[sizeof(dump->title) - 1] = '\0';
+			}
+			memcpy(dump->bytes, buffer, shown);
+
+			(void)pthread_mutex_lock(&g_hexMutex);
+			// too much queued already, the caller formats the dump itself
+			if (g_workerRun != 0 && g_pendingBytes + shown <= MAX_DEFERRED_BYTES)
+			{
+				g_pendingBytes += shown;
+				if (g_pendingTail != NULL)
+				{
+					g_pendingTail->next = dump;
+				}
+				else
+				{
+					g_pendingHead = dump;
+				}
+				g_pendingTail = dump;
+				(void)pthread_cond_signal(&g_workerCond);
+				deferred = 1;
+			}
+			(void)pthread_mutex_unlock(&g_hexMutex);
+
+			if (deferred < 0)
+			{
+				free(dump);
+			}
+		}
+	}
+
+	return deferred;
+}
+
+static void EncodeBytes(char *out, const unsigned char *bytes)
+{
+#if defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi8(0x0F);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i zero = _mm_set1_epi8('0');
+	const __m128i letters = _mm_set1_epi8('A' - '0' - 10);
+	__m128i value = _mm_loadu_si128((const __m128i *)bytes);
+	__m128i high = _mm_and_si128(_mm_srli_epi16(value, 4), mask);
+	__m128i low = _mm_and_si128(value, mask);
+	char pairs[HEX_ROW_BYTES * 2];
+	int i;
+
+	high = _mm_add_epi8(_mm_add_epi8(high, zero), _mm_and_si128(_mm_cmpgt_epi8(high, nine), letters));
+	low = _mm_add_epi8(_mm_add_epi8(low, zero), _mm_and_si128(_mm_cmpgt_epi8(low, nine), letters));
+	_mm_storeu_si128((__m128i *)&pairs[0], _mm_unpacklo_epi8(high, low));
+	_mm_storeu_si128((__m128i *)&pairs[HEX_ROW_BYTES], _mm_unpackhi_epi8(high, low));
+
+	for (i = 0; i < HEX_ROW_BYTES; i++)
+	{
+		out[i * 3] = pairs[i * 2];
+		out[i * 3 + 1] = pairs[i * 2 + 1];
+		out[i * 3 + 2] = ' ';
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	const uint8x16_t digits = vld1q_u8((const uint8_t *)g_hexDigits);
+	uint8x16_t value = vld1q_u8(bytes);
+	uint8x16x3_t row;
+
+	row.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(value, 4));
+	row.val[1] = vqtbl1q_u8(digits, vandq_u8(value, vdupq_n_u8(0x0F)));
+	row.val[2] = vdupq_n_u8(' ');
+	vst3q_u8((uint8_t *)out, row);
+#else
+	int i;
+
+	for (i = 0; i < HEX_ROW_BYTES; i++)
+	{
+		out[i * 3] = g_hexDigits[bytes[i] >> 4];
+		out[i * 3 + 1] = g_hexDigits[bytes[i] & 0x0FU];
+		out[i * 3 + 2] = ' ';
+	}
+#endif
+}
+
+static void StopWorker(void)
+{
+	(void)pthread_mutex_lock(&g_hexControlMutex);
+	if (g_workerRun != 0)
+	{
+		__atomic_store_n(&g_hexDeferred, 0, __ATOMIC_RELEASE);
+
+		(void)pthread_mutex_lock(&g_hexMutex);
+		g_workerRun = 0;
+		(void)pthread_cond_signal(&g_workerCond);
+		(void)pthread_mutex_unlock(&g_hexMutex);
+
+		(void)pthread_join(g_workerThread, NULL);
+	}
+	(void)pthread_mutex_unlock(&g_hexControlMutex);
+}
+
+static void *WorkerThread(void *arg)
+{
+	DeferredDump *dump;
+
+	(void)arg;
+
+	(void)pthread_mutex_lock(&g_hexMutex);
+	while (g_workerRun != 0 || g_pendingHead != NULL)
+	{
+		if (g_pendingHead == NULL)
+		{
+			(void)pthread_cond_wait(&g_workerCond, &g_hexMutex);
+			continue;
+		}
+
+		dump = g_pendingHead;
+		g_pendingHead = dump->next;
+		if (g_pendingHead == NULL)
+		{
+			g_pendingTail = NULL;
+		}
+		(void)pthread_mutex_unlock(&g_hexMutex);
+
+		(void)TCLogHexWrite(dump->level, &dump->time, dump->bytes, dump->shown, dump->length,
+							(dump->hasTitle != 0) ? dump->title : NULL);
+
+		(void)pthread_mutex_lock(&g_hexMutex);
+		g_pendingBytes -= dump->shown;
+		free(dump);
+	}
+	(void)pthread_mutex_unlock(&g_hexMutex);
+
+	return NULL;
+}
@@ -0,0 +1,362 @@
+/****************************************************************************************
+ *   FileName    : TCLogIndex.c
+ *   Description : Sidecar time index writer of the text log segments
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+#include "TCLogIndex.h"
+
+#define DEFAULT_INTERVAL	65536
+#define MIN_INTERVAL		4096
+#define MAX_PATH_SIZE		256
+
+static int OpenIndex(long offset);
+static void CloseIndex(void);
+static int AppendEntry(const TCLogIndexEntry *entry);
+static void StartEntry(uint32_t offset);
+static void ScanLines(const char *text, unsigned int length);
+static const char *ParseStamp(const char *p, const char *end, uint64_t *key);
+static const char *ReadNumber(const char *p, const char *end, uint64_t *value);
+
+static const char *g_levelNames[TotalTCLogLevels] = {
+	"ERROR",
+	"WARN",
+	"INFO",
+	"DEBUG"
+};
+
+static unsigned int g_interval = 0;
+static int g_fd = -1;
+static char g_logPath[MAX_PATH_SIZE];
+static off_t g_indexBytes = 0;
+static TCLogIndexEntry g_entry;
+static uint64_t g_lastKey = TC_LOG_INDEX_NO_KEY;
+static int g_lastLevel = -1;
+
+void TCLogSetIndexInterval(unsigned int intervalBytes)
+{
+	unsigned int interval = 0;
+
+	if (intervalBytes != 0)
+	{
+		interval = (intervalBytes < MIN_INTERVAL) ? MIN_INTERVAL : intervalBytes;
+	}
+	__atomic_store_n(&g_interval, interval, __ATOMIC_RELAXED);
+}
+
+void TCLogIndexWrite(const char *logPath, long offset, const char *text, unsigned int length)
+{
+	unsigned int interval = __atomic_load_n(&g_interval, __ATOMIC_RELAXED);
+
+	if (interval == 0)
+	{
+		if (g_fd >= 0 || g_logPath[0] != '\0')
+		{
+			CloseIndex();
+		}
+		return;
+	}
+
+	// a new segment, or the same one reopened after somebody else wrote to it
+	if (strcmp(logPath, g_logPath) != 0 || (g_fd >= 0 && offset != (long)g_entry.offset + (long)g_entry.length))
+	{
+		CloseIndex();
+		snprintf(g_logPath, sizeof(g_logPath), "%s", logPath);
+		(void)OpenIndex(offset);
+	}
+
+	if (g_fd >= 0)
+	{
+		ScanLines(text, length);
+		g_entry.length += length;
+		if (g_entry.length >= interval)
+		{
+			(void)AppendEntry(&g_entry);
+			StartEntry(g_entry.offset + g_entry.length);
+		}
+	}
+}
+
+int TCLogIndexParseLine(const char *line, size_t length, uint64_t *key)
+{
+	const char *end = line + length;
+	const char *p = line;
+	const char *next;
+	int level = -1;
+	int i;
+
+	*key = TC_LOG_INDEX_NO_KEY;
+
+	if (p < end && *p == '[')
+	{
+		next = ParseStamp(p + 1, end, key);
+		if (next != NULL)
+		{
+			p = next;
+		}
+	}
+
+	if (p < end && *p == '[')
+	{
+		p++;
+		for (i = 0; i < TotalTCLogLevels && level < 0; i++)
+		{
+			size_t nameLength = strlen(g_levelNames[i]);
+
+			if ((size_t)(end - p) > nameLength && memcmp(p, g_levelNames[i], nameLength) == 0 && p[nameLength] == ']')
+			{
+				level = i;
+			}
+		}
+	}
+
+	return level;
+}
+
+int TCLogIndexPath(const char *logPath, char *indexPath, size_t size)
+{
+	size_t length = strlen(logPath);
+
+	if (length > 3 && strcmp(logPath + length - 3, ".gz") == 0)
+	{
+		length -= 3;
+	}
+	if (length > 4 && strncmp(logPath + length - 4, ".log", 4) == 0)
+	{
+		length -= 4;
+	}
+
+	return (snprintf(indexPath, size, "%.*s.idx", (int)length, logPath) < (int)size) ? 1 : 0;
+}
+
+static int OpenIndex(long offset)
+{
+	char path[MAX_PATH_SIZE];
+	TCLogIndexHeader header;
+	TCLogIndexEntry last;
+	off_t entries = 0;
+	uint32_t end = 0;
+
+	if (TCLogIndexPath(g_logPath, path, sizeof(path)) == 0)
+	{
+		return 0;
+	}
+
+	g_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (g_fd < 0)
+	{
+		fprintf(stderr, "%s: open %s failed\n", __func__, path);
+		return 0;
+	}
+
+	if (pread(g_fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+		memcmp(header.magic, TC_LOG_INDEX_MAGIC, 4) == 0 && header.version == TC_LOG_INDEX_VERSION &&
+		header.byteOrder == TC_LOG_INDEX_BYTE_ORDER)
+	{
+		entries = (lseek(g_fd, 0, SEEK_END) - (off_t)sizeof(header)) / (off_t)sizeof(TCLogIndexEntry);
+
+		// entries past the current end belong to a segment that was cut short since
+		while (entries > 0)
+		{
+			if (pread(g_fd, &last, sizeof(last), (off_t)sizeof(header) + (entries - 1) * (off_t)sizeof(last)) ==
+				(ssize_t)sizeof(last) && (long)last.offset + (long)last.length <= offset)
+			{
+				end = last.offset + last.length;
+				break;
+			}
+			entries--;
+		}
+	}
+	else
+	{
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, TC_LOG_INDEX_MAGIC, 4);
+		header.version = TC_LOG_INDEX_VERSION;
+		header.byteOrder = TC_LOG_INDEX_BYTE_ORDER;
+		header.interval = __atomic_load_n(&g_interval, __ATOMIC_RELAXED);
+		if (pwrite(g_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+		{
+			fprintf(stderr, "%s: write %s failed\n", __func__, path);
+			close(g_fd);
+			g_fd = -1;
+			return 0;
+		}
+	}
+
+	g_indexBytes = (off_t)sizeof(header) + entries * (off_t)sizeof(TCLogIndexEntry);
+	(void)ftruncate(g_fd, g_indexBytes);
+	g_lastKey = TC_LOG_INDEX_NO_KEY;
+	g_lastLevel = -1;
+
+	// lines written while the index was off have to be read by every query
+	if ((long)end < offset)
+	{
+		memset(&last, 0, sizeof(last));
+		last.maxKey = TC_LOG_INDEX_NO_KEY;
+		last.offset = end;
+		last.length = (uint32_t)(offset - (long)end);
+		last.levels = TC_LOG_INDEX_ALL_LEVELS;
+		(void)AppendEntry(&last);
+	}
+	StartEntry((uint32_t)offset);
+
+	return 1;
+}
+
+static void CloseIndex(void)
+{
+	if (g_fd >= 0)
+	{
+		if (g_entry.length > 0)
+		{
+			(void)AppendEntry(&g_entry);
+		}
+		close(g_fd);
+		g_fd = -1;
+	}
+	g_logPath[0] = '\0';
+}
+
+static int AppendEntry(const TCLogIndexEntry *entry)
+{
+	int appended = 0;
+
+	if (pwrite(g_fd, entry, sizeof(*entry), g_indexBytes) == (ssize_t)sizeof(*entry))
+	{
+		g_indexBytes += (off_t)sizeof(*entry);
+		appended = 1;
+	}
+
+	return appended;
+}
+
+static void StartEntry(uint32_t offset)
+{
+	memset(&g_entry, 0, sizeof(g_entry));
+	g_entry.minKey = TC_LOG_INDEX_NO_KEY;
+	g_entry.offset = offset;
+}
+
+static void ScanLines(const char *text, unsigned int length)
+{
+	const char *end = text + length;
+	const char *line = text;
+	const char *next;
+	uint64_t key;
+	int level;
+
+	while (line < end)
+	{
+		// hex dump rows and other lines without a header belong to the line before them
+		level = TCLogIndexParseLine(line, (size_t)(end - line), &key);
+		if (level >= 0 || key != TC_LOG_INDEX_NO_KEY)
+		{
+			g_lastKey = key;
+			g_lastLevel = level;
+		}
+
+		if (g_lastKey != TC_LOG_INDEX_NO_KEY)
+		{
+			if (g_lastKey < g_entry.minKey)
+			{
+				g_entry.minKey = g_lastKey;
+			}
+			if (g_lastKey > g_entry.maxKey)
+			{
+				g_entry.maxKey = g_lastKey;
+			}
+		}
+		if (g_lastLevel >= 0)
+		{
+			g_entry.levels |= 1U << g_lastLevel;
+		}
+
+		next = (const char *)memchr(line, '\n', (size_t)(end - line));
+		line = (next != NULL) ? next + 1 : end;
+	}
+}
+
+static const char *ParseStamp(const char *p, const char *end, uint64_t *key)
+{
+	static const char separators[] = "-- ::.]";
+	uint64_t fields[7];
+	int count;
+
+	// "YYYY-MM-DD hh:mm:ss.mmm]" or the monotonic "  sec.mmm]"
+	while (p < end && *p == ' ')
+	{
+		p++;
+	}
+
+	for (count = 0; count < 7; count++)
+	{
+		p = ReadNumber(p, end, &fields[count]);
+		if (p == NULL || p >= end)
+		{
+			return NULL;
+		}
+
+		if (count == 0 && *p == '.')
+		{
+			p = ReadNumber(p + 1, end, &fields[1]);
+			if (p == NULL || p >= end || *p != ']')
+			{
+				return NULL;
+			}
+			*key = fields[0] * 1000ULL + fields[1];
+			return p + 1;
+		}
+
+		if (*p != separators[count])
+		{
+			return NULL;
+		}
+		p++;
+	}
+
+	*key = (((((fields[0] * 100ULL + fields[1]) * 100ULL + fields[2]) * 100ULL + fields[3]) * 100ULL +
+			 fields[4]) * 100ULL + fields[5]) * 1000ULL + fields[6];
+
+	return p;
+}
+
+static const char *ReadNumber(const char *p, const char *end, uint64_t *value)
+{
+	const char *start = p;
+
+	*value = 0;
+	while (p < end && *p >= '0' && *p <= '9' && p - start < 18)
+	{
+		*value = *value * 10ULL + (uint64_t)(*p - '0');
+		p++;
+	}
+
+	return (p != start) ? p : NULL;
+}
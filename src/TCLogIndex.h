@@ -0,0 +1,77 @@
+/****************************************************************************************
+ *   FileName    : TCLogIndex.h
+ *   Description : Sidecar time index of the text log segments
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#ifndef _TC_LOG_INDEX_H
+#define _TC_LOG_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Every text segment "<name>-YYYYMMDDHH_<index>.log" can get a sidecar
+ * "<name>-YYYYMMDDHH_<index>.idx", it stays valid once the segment is
+ * compressed to ".log.gz". The index is a TCLogIndexHeader followed by
+ * TCLogIndexEntry records in the byte order of the writer. Each entry covers
+ * the whole lines in [offset, offset + length) of the uncompressed segment,
+ * entries follow each other without gaps and the bytes after the last entry
+ * are not indexed yet.
+ *
+ * minKey and maxKey bound the time stamps of the lines in the entry. A key is
+ * the printed stamp packed as the decimal number YYYYMMDDhhmmssmmm, or
+ * seconds * 1000 + ms for monotonic stamps, so keys compare like the text
+ * does. An entry without stamped lines has minKey TC_LOG_INDEX_NO_KEY and
+ * maxKey 0, bytes the writer did not see are covered by an entry with minKey
+ * 0 and maxKey TC_LOG_INDEX_NO_KEY. 'levels' has bit (1 << TCLogLevel) set for
+ * every level found in the entry.
+ */
+
+#define TC_LOG_INDEX_MAGIC			"TCLI"
+#define TC_LOG_INDEX_VERSION		1
+#define TC_LOG_INDEX_BYTE_ORDER		0x0102
+#define TC_LOG_INDEX_NO_KEY			UINT64_MAX
+#define TC_LOG_INDEX_ALL_LEVELS		0x0F
+
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t byteOrder;
+	uint32_t interval;
+	uint32_t reserved;
+} TCLogIndexHeader;
+
+typedef struct {
+	uint64_t minKey;
+	uint64_t maxKey;
+	uint32_t offset;
+	uint32_t length;
+	uint32_t levels;
+	uint32_t reserved;
+} TCLogIndexEntry;
+
+// TCLogIndex.c, returns the level of the line header or -1, key is TC_LOG_INDEX_NO_KEY without a stamp
+int TCLogIndexParseLine(const char *line, size_t length, uint64_t *key);
+int TCLogIndexPath(const char *logPath, char *indexPath, size_t size);
+
+#endif // _TC_LOG_INDEX_H
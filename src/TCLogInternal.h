@@ -0,0 +1,195 @@
+/****************************************************************************************
+ *   FileName    : TCLogInternal.h
+ *   Description : Internal interface shared by the TCLog sources
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#ifndef _TC_LOG_INTERNAL_H
+#define _TC_LOG_INTERNAL_H
+
+#include <stddef.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "TCLog.h"
+
+#define TC_LOG_LINE_SIZE	1024
+
+typedef struct {
+	long epoch;		// wall clock seconds, the calendar fields below are derived from it
+	int year;
+	int month;
+	int day;
+	int hour;
+	long stampSec;	// reading of the clock selected with TCLogSetClock()
+	int stampMs;
+	int monotonic;
+} TCLogTime;
+
+// TCLog.c, the write, sync and finish functions require TCLogMutex() to be held.
+// TCLogWriteVector() consumes iov, a short write advances the entries in place.
+int TCLogV(TCLogLevel level, const char *format, va_list va);
+int TCLogTagV(TCLogLevel level, const char *tag, const char *format, va_list va);
+void TCLogRecordV(TCLogLevel level, const char *tag, const char *format, va_list va);
+int TCLogNote(TCLogLevel level, const TCLogTime *logTime, const char *tag, const char *format, ...)
+	__attribute__((format(printf, 4, 5)));
+int TCLogGetLevel(void);
+void TCLogUpdateThreshold(void);
+int TCLogIsLevelEnabled(TCLogLevel level);
+void TCLogGetPrefixes(const char **prefix, const char **subPrefix, int *useTime);
+void TCLogGetFileName(char *name, size_t size);
+void TCLogGetFilePath(char *path, size_t size);
+pthread_mutex_t *TCLogMutex(void);
+int TCLogHexWrite(TCLogLevel level, const TCLogTime *logTime, const unsigned char *bufp,
+				  unsigned int shown, unsigned int length, const char *title);
+int TCLogWriteText(const TCLogTime *logTime, const char *text, unsigned int length);
+void TCLogFinishWrite(void);
+int TCLogWriteVector(const TCLogTime *logTime, struct iovec *iov, int count, unsigned int length, int sync);
+void TCLogSyncOutput(void);
+int TCLogEmit(TCLogLevel level, const TCLogTime *logTime, const char *text, unsigned int length);
+
+// TCLogClock.c
+void TCLogGetTime(TCLogTime *logTime);
+void TCLogTimeFromEpoch(TCLogTime *logTime, long epoch, int stampMs);
+int TCLogFormatTime(char *buffer, size_t size, const TCLogTime *logTime);
+
+// TCLogFormat.c
+typedef enum {
+	TCLogArgNone,			// "%%", no argument consumed
+	TCLogArgInt,
+	TCLogArgLong,
+	TCLogArgLongLong,
+	TCLogArgDouble,
+	TCLogArgLongDouble,
+	TCLogArgPointer,
+	TCLogArgString,
+	TCLogArgUnsupported		// %n, %m, positional or wide arguments
+} TCLogArgType;
+
+typedef struct {
+	TCLogArgType type;
+	int widthStar;			// width is passed as an extra int argument
+	int precisionStar;		// precision is passed as an extra int argument
+	int precision;			// -1 when not given in the format
+	char specifier;
+} TCLogConversion;
+
+int TCLogParseConversion(const char *format, TCLogConversion *conversion);
+int TCLogFormatMessage(char *buffer, size_t size, const char *format, va_list va);
+
+// TCLogBinary.c, returns -1 when no binary log is open
+int TCLogBinaryWriteEvent(TCLogLevel level, const void *record, unsigned int length);
+
+// TCLogJson.c, the line always fits in size and ends with a new line
+int TCLogEventFormatJson(char *buffer, size_t size, TCLogLevel level, const TCLogTime *logTime,
+						 const char *prefix, const char *subPrefix, const char *event,
+						 const TCLogField *fields, unsigned int count);
+
+// TCLogFlight.c, TCLogFlightWrite() is lock free and may run on any thread
+int TCLogFlightEnabled(void);
+void TCLogFlightWrite(const char *text, unsigned int length);
+
+// TCLogSink.c, the text is only borrowed for the call
+int TCLogSinkDispatch(TCLogLevel level, const char *text, unsigned int length);
+int TCLogSinkPrimaryEnabled(TCLogLevel level);
+
+// TCLogShip.c, the shipper thread owns the socket
+typedef struct TCLogShipper TCLogShipper;
+TCLogShipper *TCLogShipperStart(const char *path, unsigned int queueBytes, TCLogAsyncPolicy policy);
+int TCLogShipperPush(TCLogShipper *shipper, const char *text, unsigned int length);
+void TCLogShipperCancel(TCLogShipper *shipper);
+void TCLogShipperStop(TCLogShipper *shipper);
+
+// TCLogMapped.c, called with TCLogMutex() held
+int TCLogMappedOpen(const char *path, long size);
+int TCLogMappedIsOpen(void);
+long TCLogMappedBytes(void);
+int TCLogMappedHasRoom(unsigned int length);
+int TCLogMappedWrite(const char *text, unsigned int length);
+void TCLogMappedSync(int force);
+void TCLogMappedSetSyncInterval(unsigned int msec);
+void TCLogMappedClose(void);
+
+// TCLogUring.c, called with TCLogMutex() held
+int TCLogUringAvailable(void);
+int TCLogUringOpen(const char *path);
+int TCLogUringIsOpen(void);
+long TCLogUringFileBytes(void);
+int TCLogUringWrite(const char *text, unsigned int length);
+void TCLogUringSubmit(int sync);
+void TCLogUringSetSyncInterval(unsigned int msec);
+void TCLogUringClose(void);
+void TCLogUringShutdown(void);
+
+// TCLogDaemon.c, TCLogDaemonPush() returns -1 when no tclogd ring is connected
+int TCLogDaemonConnected(void);
+int TCLogDaemonPush(TCLogLevel level, const TCLogTime *logTime, const char *text, unsigned int length);
+
+// TCLogThreadBuffer.c, TCLogThreadBufferPush() returns -1 when thread buffers are off.
+// A line is stamped with TCLogThreadBufferGetTime() and closed with TCLogThreadBufferDone()
+// so a flush never writes buffered lines newer than one still being formatted.
+int TCLogThreadBuffersEnabled(void);
+void TCLogThreadBufferGetTime(TCLogTime *logTime);
+void TCLogThreadBufferDone(void);
+int TCLogThreadBufferPush(TCLogLevel level, const TCLogTime *logTime, const char *text, unsigned int length);
+
+// TCLogCommit.c, returns -1 when no durability policy was set
+int TCLogCommitPush(TCLogLevel level, const TCLogTime *logTime, const char *text, unsigned int length);
+
+// TCLogAsync.c, TCLogAsyncPush() returns -1 when the asynchronous mode is off
+int TCLogAsyncEnabled(void);
+int TCLogAsyncPush(const TCLogTime *logTime, const char *text, unsigned int length);
+
+// TCLogHex.c, TCLogHexDefer() returns -1 when the dump has to be written by the caller
+unsigned int TCLogHexShownBytes(unsigned int length);
+unsigned int TCLogHexRowSize(void);
+unsigned int TCLogHexFormatRow(char *out, const unsigned char *bytes, unsigned int count, unsigned int offset);
+int TCLogHexDefer(TCLogLevel level, const TCLogTime *logTime, const void *buffer,
+				  unsigned int length, const char *title);
+
+// TCLogCompress.c, called with TCLogMutex() held once a log file is closed for good
+void TCLogCompressClosedFile(const char *path);
+
+// TCLogIndex.c, called with TCLogMutex() held once text landed at offset of logPath
+void TCLogIndexWrite(const char *logPath, long offset, const char *text, unsigned int length);
+
+// TCLogBudget.c, TCLogBudgetMayWrite() stays 1 while no budget is set
+int TCLogBudgetMayWrite(void);
+void TCLogBudgetKick(void);
+
+// TCLogStorm.c, both return 0 when the line must be dropped
+int TCLogStormAdmit(const char *format, unsigned int *suppressed);
+int TCLogStormCollapse(TCLogLevel level, const TCLogTime *logTime, const char *tag,
+					   const char *message, unsigned int length);
+
+// TCLogStats.c, lock free and callable from any thread.
+// TCLogStatsStart() returns 0 while timing is off, TCLogStatsCall() then does nothing.
+void TCLogStatsLine(TCLogLevel level, unsigned int length, int written);
+void TCLogStatsSuppressed(TCLogLevel level);
+void TCLogStatsRotation(void);
+void TCLogStatsRefused(void);
+unsigned long long TCLogStatsStart(void);
+void TCLogStatsCall(unsigned long long start);
+void TCLogStatsLock(pthread_mutex_t *mutex);
+
+#endif // _TC_LOG_INTERNAL_H
@@ -0,0 +1,306 @@
+/****************************************************************************************
+ *   FileName    : TCLogJson.c
+ *   Description : JSON Lines encoder for structured TCLog events
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define CLOSING_RESERVE		24		// room for ",\"truncated\":true}\n"
+
+typedef struct {
+	char *buffer;
+	size_t size;	// usable bytes, CLOSING_RESERVE is kept back
+	size_t used;
+	int overflow;
+} JsonWriter;
+
+static void PutRaw(JsonWriter *writer, const char *text, size_t length);
+static void PutString(JsonWriter *writer, const char *text, size_t length, int cut);
+static void PutMember(JsonWriter *writer, const char *key, size_t keyLength, const char *text);
+static void PutInteger(JsonWriter *writer, long long value);
+static void PutFraction(JsonWriter *writer, long seconds, int milliseconds);
+static void PutField(JsonWriter *writer, const TCLogField *field);
+
+static const char g_hexDigits[16] = "0123456789abcdef";
+static const char *g_levelNames[TotalTCLogLevels] = {
+	"ERROR",
+	"WARN",
+	"INFO",
+	"DEBUG"
+};
+
+int TCLogEventFormatJson(char *buffer, size_t size, TCLogLevel level, const TCLogTime *logTime,
+						 const char *prefix, const char *subPrefix, const char *event,
+						 const TCLogField *fields, unsigned int count)
+{
+	JsonWriter writer;
+	unsigned int i;
+
+	writer.buffer = buffer;
+	writer.size = size - CLOSING_RESERVE;
+	writer.used = 0;
+	writer.overflow = 0;
+
+	if (logTime->monotonic != 0)
+	{
+		PutRaw(&writer, "{\"mono\":", 8);
+	}
+	else
+	{
+		PutRaw(&writer, "{\"ts\":", 6);
+	}
+	PutFraction(&writer, logTime->stampSec, logTime->stampMs);
+
+	PutRaw(&writer, ",\"level\":\"", 10);
+	PutRaw(&writer, g_levelNames[level], strlen(g_levelNames[level]));
+	PutRaw(&writer, "\"", 1);
+	if (prefix != NULL)
+	{
+		PutMember(&writer, ",\"prefix\":", 10, prefix);
+	}
+	if (subPrefix != NULL)
+	{
+		PutMember(&writer, ",\"sub_prefix\":", 14, subPrefix);
+	}
+	PutMember(&writer, ",\"event\":", 9, (event != NULL) ? event : "");
+
+	for (i = 0; i < count && writer.overflow == 0; i++)
+	{
+		size_t used = writer.used;
+
+		PutField(&writer, &fields[i]);
+		if (writer.overflow != 0)
+		{
+			// drop the field that did not fit as a whole
+			writer.used = used;
+		}
+	}
+
+	writer.size = size;
+	if (writer.overflow != 0)
+	{
+		writer.overflow = 0;
+		PutRaw(&writer, ",\"truncated\":true", 17);
+	}
+	PutRaw(&writer, "}\n", 2);
+	buffer[writer.used] = '\0';
+
+	return (int)writer.used;
+}
+
+static void PutRaw(JsonWriter *writer, const char *text, size_t length)
+{
+	if (writer->used + length < writer->size)
+	{
+		memcpy(writer->buffer + writer->used, text, length);
+		writer->used += length;
+	}
+	else
+	{
+		writer->overflow = 1;
+	}
+}
+
+// cut != 0 closes a string that does not fit at the last whole character instead of dropping it
+static void PutString(JsonWriter *writer, const char *text, size_t length, int cut)
+{
+	char *p = writer->buffer + writer->used;
+	char *end = writer->buffer + writer->size - 2;	// closing quote and the next byte
+	size_t i;
+
+	if (p >= end)
+	{
+		writer->overflow = 1;
+		return;
+	}
+
+	*p++ = '"';
+	for (i = 0; i < length && p < end; i++)
+	{
+		unsigned char c = (unsigned char)text[i];
+
+		if (c >= 0x20 && c != '"' && c != '\\')
+		{
+			*p++ = (char)c;
+		}
+		else if (end - p < 6)
+		{
+			break;
+		}
+		else if (c == '"' || c == '\\')
+		{
+			*p++ = '\\';
+			*p++ = (char)c;
+		}
+		else if (c == '\n')
+		{
+			*p++ = '\\';
+			*p++ = 'n';
+		}
+		else
+		{
+			memcpy(p, "\\u00", 4);
+			p[4] = g_hexDigits[c >> 4];
+			p[5] = g_hexDigits[c & 0x0F];
+			p += 6;
+		}
+	}
+
+	if (i < length)
+	{
+		writer->overflow = 1;
+	}
+	if (i == length || cut != 0)
+	{
+		*p++ = '"';
+		writer->used = (size_t)(p - writer->buffer);
+	}
+}
+
+// a member of the line header, its value is cut to fit, a key without room for any value is taken back
+static void PutMember(JsonWriter *writer, const char *key, size_t keyLength, const char *text)
+{
+	size_t used = writer->used;
+
+	PutRaw(writer, key, keyLength);
+	if (writer->used != used)
+	{
+		PutString(writer, text, strlen(text), 1);
+		if (writer->used == used + keyLength)
+		{
+			writer->used = used;
+		}
+	}
+}
+
+static void PutInteger(JsonWriter *writer, long long value)
+{
+	char digits[24];
+	char *p = digits + sizeof(digits);
+	unsigned long long magnitude = (value < 0) ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+
+	do
+	{
+		*--p = (char)('0' + magnitude % 10ULL);
+		magnitude /= 10ULL;
+	} while (magnitude != 0ULL);
+
+	if (value < 0)
+	{
+		*--p = '-';
+	}
+
+	PutRaw(writer, p, (size_t)(digits + sizeof(digits) - p));
+}
+
+static void PutFraction(JsonWriter *writer, long seconds, int milliseconds)
+{
+	char fraction[4];
+
+	PutInteger(writer, seconds);
+	fraction[0] = '.';
+	fraction[1] = (char)('0' + milliseconds / 100);
+	fraction[2] = (char)('0' + milliseconds / 10 % 10);
+	fraction[3] = (char)('0' + milliseconds % 10);
+	PutRaw(writer, fraction, sizeof(fraction));
+}
+
+static void PutField(JsonWriter *writer, const TCLogField *field)
+{
+	PutRaw(writer, ",", 1);
+	PutString(writer, (field->key != NULL) ? field->key : "", (field->key != NULL) ? strlen(field->key) : 0, 0);
+	PutRaw(writer, ":", 1);
+
+	switch (field->type)
+	{
+		case TCLogFieldInt:
+			PutInteger(writer, field->i);
+			break;
+
+		case TCLogFieldDouble:
+			if (isfinite(field->d))
+			{
+				// the only conversion left to snprintf, shortest exact digits are not worth a local copy
+				char number[32];
+				int length = snprintf(number, sizeof(number), "%.17g", field->d);
+
+				PutRaw(writer, number, (size_t)length);
+			}
+			else
+			{
+				PutRaw(writer, "null", 4);
+			}
+			break;
+
+		case TCLogFieldString:
+			if (field->p != NULL)
+			{
+				PutString(writer, (const char *)field->p, strlen((const char *)field->p), 0);
+			}
+			else
+			{
+				PutRaw(writer, "null", 4);
+			}
+			break;
+
+		case TCLogFieldBytes:
+		{
+			const unsigned char *bytes = (const unsigned char *)field->p;
+			char *p = writer->buffer + writer->used;
+			unsigned int i;
+
+			// bytes are written as a lower case hex string
+			if (bytes == NULL || writer->used + 2 + (size_t)field->length * 2 >= writer->size)
+			{
+				if (bytes == NULL)
+				{
+					PutRaw(writer, "null", 4);
+				}
+				else
+				{
+					writer->overflow = 1;
+				}
+				break;
+			}
+
+			*p++ = '"';
+			for (i = 0; i < field->length; i++)
+			{
+				*p++ = g_hexDigits[bytes[i] >> 4];
+				*p++ = g_hexDigits[bytes[i] & 0x0F];
+			}
+			*p++ = '"';
+			writer->used = (size_t)(p - writer->buffer);
+			break;
+		}
+
+		default:
+			PutRaw(writer, "null", 4);
+			break;
+	}
+}
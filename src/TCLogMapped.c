@@ -0,0 +1,215 @@
+/****************************************************************************************
+ *   FileName    : TCLogMapped.c
+ *   Description : Memory-mapped, preallocated log segments
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define DEFAULT_SYNC_INTERVAL_MS	1000
+
+static long FindDataEnd(const char *data, long size);
+static long GetMonotonicMs(void);
+
+static int g_fd = -1;
+static char *g_data = NULL;
+static long g_size = 0;
+static long g_used = 0;
+static long g_synced = 0;
+static long g_lastSyncMs = 0;
+static unsigned int g_syncIntervalMs = DEFAULT_SYNC_INTERVAL_MS;
+static int g_reserveFailed = 0;
+
+int TCLogMappedOpen(const char *path, long size)
+{
+	int opened = 0;
+	int error = 0;
+	struct stat st;
+
+	TCLogMappedClose();
+
+	g_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (g_fd >= 0 && fstat(g_fd, &st) == 0)
+	{
+		long existing = (long)st.st_size;
+
+		// allocate the whole segment up front, the file does not grow line by line
+		if (existing < size)
+		{
+			error = posix_fallocate(g_fd, 0, size);
+		}
+
+		if (error != 0)
+		{
+			// a sparse segment raises SIGBUS on the first write into a page the disk can not back
+			if (g_reserveFailed == 0)
+			{
+				fprintf(stderr, "%s: reserve %ld bytes for %s failed, %s\n", __func__, size, path, strerror(error));
+				g_reserveFailed = 1;
+			}
+			(void)ftruncate(g_fd, existing);
+		}
+		else
+		{
+			if (existing > size)
+			{
+				size = existing;
+			}
+
+			g_data = (char *)mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, g_fd, 0);
+			if (g_data != MAP_FAILED)
+			{
+				g_size = size;
+				g_used = FindDataEnd(g_data, (existing < size) ? existing : size);
+				g_synced = g_used;
+				g_lastSyncMs = GetMonotonicMs();
+				g_reserveFailed = 0;
+				opened = 1;
+			}
+			else
+			{
+				fprintf(stderr, "%s: mmap %s failed\n", __func__, path);
+				g_data = NULL;
+			}
+		}
+	}
+	else
+	{
+		fprintf(stderr, "%s: open %s failed\n", __func__, path);
+	}
+
+	if (opened == 0 && g_fd >= 0)
+	{
+		close(g_fd);
+		g_fd = -1;
+	}
+
+	return opened;
+}
+
+int TCLogMappedIsOpen(void)
+{
+	return (g_data != NULL) ? 1 : 0;
+}
+
+long TCLogMappedBytes(void)
+{
+	return g_used;
+}
+
+int TCLogMappedHasRoom(unsigned int length)
+{
+	return (g_data != NULL && g_used + (long)length <= g_size) ? 1 : 0;
+}
+
+int TCLogMappedWrite(const char *text, unsigned int length)
+{
+	int written = 0;
+
+	if (TCLogMappedHasRoom(length) != 0)
+	{
+		memcpy(g_data + g_used, text, length);
+		g_used += length;
+		written = 1;
+	}
+
+	return written;
+}
+
+void TCLogMappedSync(int force)
+{
+	if (g_data != NULL && g_used > g_synced)
+	{
+		long now = GetMonotonicMs();
+
+		if (force != 0 || now - g_lastSyncMs >= (long)g_syncIntervalMs)
+		{
+			long pageSize = sysconf(_SC_PAGESIZE);
+			long start = g_synced - g_synced % pageSize;
+
+			(void)msync(g_data + start, (size_t)(g_used - start), (force != 0) ? MS_SYNC : MS_ASYNC);
+			g_synced = g_used;
+			g_lastSyncMs = now;
+		}
+	}
+}
+
+void TCLogMappedSetSyncInterval(unsigned int msec)
+{
+	g_syncIntervalMs = (msec != 0) ? msec : DEFAULT_SYNC_INTERVAL_MS;
+}
+
+void TCLogMappedClose(void)
+{
+	if (g_data != NULL)
+	{
+		TCLogMappedSync(1);
+		(void)munmap(g_data, (size_t)g_size);
+		g_data = NULL;
+
+		// give back the unused tail of the preallocation
+		(void)ftruncate(g_fd, g_used);
+	}
+
+	if (g_fd >= 0)
+	{
+		close(g_fd);
+		g_fd = -1;
+	}
+
+	g_size = 0;
+	g_used = 0;
+	g_synced = 0;
+}
+
+static long FindDataEnd(const char *data, long size)
+{
+	// a segment left behind by a crash still carries its zero filled tail
+	while (size > 0 && data[size - 1] == '\0')
+	{
+		size--;
+	}
+
+	return size;
+}
+
+static long GetMonotonicMs(void)
+{
+	struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+	(void)clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+
+	return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,615 @@
+/****************************************************************************************
+ *   FileName    : TCLogQuery.c
+ *   Description : Time range query over indexed text log segments
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "TCLog.h"
+#include "TCLogIndex.h"
+
+#define MAX_PATH_SIZE	256
+#define READ_SIZE		65536
+
+typedef struct {
+	char path[MAX_PATH_SIZE + 1];
+	unsigned long hour;
+	unsigned long index;
+} SegmentFile;
+
+static int ParseKey(const char *text, int upper, uint64_t *key);
+static int ParseFraction(const char *digits, int upper);
+static int ParseLevel(const char *text);
+static int AddSegments(const char *arg, SegmentFile **segments, unsigned int *count, unsigned int *capacity);
+static int AddSegment(const char *path, const char *name, SegmentFile **segments, unsigned int *count,
+					  unsigned int *capacity);
+static int CompareSegments(const void *a, const void *b);
+static TCLogIndexEntry *ReadIndex(const char *path, unsigned int *count);
+static int QuerySegment(const char *path);
+static int EntrySelected(const TCLogIndexEntry *entry);
+static void ScanRange(gzFile file, uint64_t offset, uint64_t length);
+static void FilterLine(const char *line, size_t length);
+static int HasPrefix(const char *line, size_t length);
+
+static uint64_t g_from = 0;
+static uint64_t g_to = TC_LOG_INDEX_NO_KEY;
+static int g_timed = 0;
+static unsigned int g_levelMask = TC_LOG_INDEX_ALL_LEVELS;
+static int g_levelFiltered = 0;
+static char g_prefix[MAX_PATH_SIZE];
+static size_t g_prefixLength = 0;
+static int g_lastMatch = 0;
+static uint64_t g_readEnd = 0;
+static char *g_buffer = NULL;
+static unsigned int g_indexedSegments = 0;
+static unsigned long g_entries = 0;
+static unsigned long g_entriesRead = 0;
+static unsigned long long g_bytesRead = 0;
+static unsigned long long g_linesShown = 0;
+
+int main(int argc, char *argv[])
+{
+	SegmentFile *segments = NULL;
+	unsigned int count = 0;
+	unsigned int capacity = 0;
+	unsigned int i;
+	struct timespec start;
+	struct timespec end;
+	int verbose = 0;
+	int ret = 0;
+	int opt;
+	int level;
+
+	while ((opt = getopt(argc, argv, "f:t:l:p:vh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'f':
+				if (ParseKey(optarg, 0, &g_from) == 0)
+				{
+					fprintf(stderr, "%s: bad time %s\n", argv[0], optarg);
+					return 1;
+				}
+				g_timed = 1;
+				break;
+			case 't':
+				if (ParseKey(optarg, 1, &g_to) == 0)
+				{
+					fprintf(stderr, "%s: bad time %s\n", argv[0], optarg);
+					return 1;
+				}
+				g_timed = 1;
+				break;
+			case 'l':
+				level = ParseLevel(optarg);
+				if (level < 0)
+				{
+					fprintf(stderr, "%s: bad level %s\n", argv[0], optarg);
+					return 1;
+				}
+				g_levelMask = (1U << (level + 1)) - 1U;
+				g_levelFiltered = 1;
+				break;
+			case 'p':
+				snprintf(g_prefix, sizeof(g_prefix), "[%s]", optarg);
+				g_prefixLength = strlen(g_prefix);
+				break;
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				printf("usage: %s [-f FROM] [-t TO] [-l LEVEL] [-p PREFIX] [-v] NAME|SEGMENT...\n", argv[0]);
+				printf("print the lines of the text log segments within a time range, oldest segment first\n");
+				printf("  NAME       the name given to TCLogSetFileName(), all its segments are searched\n");
+				printf("  -f, -t     \"YYYY-MM-DD[ hh:mm[:ss[.mmm]]]\", or \"sec[.mmm]\" for monotonic stamps\n");
+				printf("  -l LEVEL   ERROR, WARN, INFO or DEBUG, lines up to that level are printed\n");
+				printf("  -p PREFIX  only lines whose header has [PREFIX]\n");
+				printf("  -v         print what the sidecar indexes saved on stderr\n");
+				printf("compressed .log.gz segments are searched too, but always decompressed from the start\n");
+				return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if (optind >= argc)
+	{
+		fprintf(stderr, "%s: a log name or segment is required\n", argv[0]);
+		return 1;
+	}
+
+	for (i = (unsigned int)optind; i < (unsigned int)argc; i++)
+	{
+		if (AddSegments(argv[i], &segments, &count, &capacity) == 0)
+		{
+			fprintf(stderr, "%s: no segments for %s\n", argv[0], argv[i]);
+			ret = 1;
+		}
+	}
+
+	g_buffer = (char *)malloc(READ_SIZE * 2);
+	if (g_buffer == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		free(segments);
+		return 1;
+	}
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &start);
+	qsort(segments, count, sizeof(SegmentFile), CompareSegments);
+	for (i = 0; i < count; i++)
+	{
+		if (QuerySegment(segments[i].path) != 0)
+		{
+			ret = 1;
+		}
+	}
+	(void)fflush(stdout);
+	(void)clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (verbose != 0)
+	{
+		fprintf(stderr, "segments %u indexed %u entries %lu/%lu bytes read %llu lines %llu in %ld ms\n",
+				count, g_indexedSegments, g_entriesRead, g_entries, g_bytesRead, g_linesShown,
+				(long)(end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000);
+	}
+
+	free(g_buffer);
+	free(segments);
+
+	return ret;
+}
+
+static int ParseKey(const char *text, int upper, uint64_t *key)
+{
+	// fields left out cover the whole day, hour or minute they belong to
+	int fields[7] = { 0, 0, 0, 0, 0, 0, 0 };
+	static const int highest[7] = { 0, 12, 31, 23, 59, 59, 999 };
+	unsigned long long seconds;
+	const char *fraction;
+	char *end;
+	int count;
+	int i;
+
+	if (strchr(text, '-') != NULL)
+	{
+		count = sscanf(text, "%d-%d-%d%*[ T]%d:%d:%d", &fields[0], &fields[1], &fields[2], &fields[3],
+					   &fields[4], &fields[5]);
+		if (count < 3)
+		{
+			return 0;
+		}
+		fraction = strrchr(text, '.');
+		if (count == 6 && fraction != NULL && fraction > strrchr(text, ':'))
+		{
+			fields[6] = ParseFraction(fraction + 1, upper);
+			count = 7;
+		}
+		for (i = count; i < 7 && upper != 0; i++)
+		{
+			fields[i] = highest[i];
+		}
+		*key = ((((((uint64_t)fields[0] * 100ULL + (uint64_t)fields[1]) * 100ULL + (uint64_t)fields[2]) * 100ULL +
+				  (uint64_t)fields[3]) * 100ULL + (uint64_t)fields[4]) * 100ULL + (uint64_t)fields[5]) * 1000ULL +
+			   (uint64_t)fields[6];
+	}
+	else
+	{
+		seconds = strtoull(text, &end, 10);
+		if (end == text)
+		{
+			return 0;
+		}
+		*key = seconds * 1000ULL + (uint64_t)((*end == '.') ? ParseFraction(end + 1, upper) : ((upper != 0) ? 999 : 0));
+	}
+
+	return 1;
+}
+
+static int ParseFraction(const char *digits, int upper)
+{
+	// ".5" is 500 ms as a lower bound and 599 ms as an upper bound
+	int ms = 0;
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		if (*digits >= '0' && *digits <= '9')
+		{
+			ms = ms * 10 + (*digits - '0');
+			digits++;
+		}
+		else
+		{
+			ms = ms * 10 + ((upper != 0) ? 9 : 0);
+		}
+	}
+
+	return ms;
+}
+
+static int ParseLevel(const char *text)
+{
+	static const char *names[TotalTCLogLevels] = { "ERROR", "WARN", "INFO", "DEBUG" };
+	int level = -1;
+	int i;
+
+	for (i = 0; i < TotalTCLogLevels; i++)
+	{
+		if (strcasecmp(text, names[i]) == 0)
+		{
+			level = i;
+		}
+	}
+
+	if (level < 0 && text[0] >= '0' && text[0] < '0' + TotalTCLogLevels && text[1] == '\0')
+	{
+		level = text[0] - '0';
+	}
+
+	return level;
+}
+
+static int AddSegments(const char *arg, SegmentFile **segments, unsigned int *count, unsigned int *capacity)
+{
+	char copy[MAX_PATH_SIZE];
+	char directory[MAX_PATH_SIZE];
+	char prefix[MAX_PATH_SIZE];
+	char path[MAX_PATH_SIZE + 1];
+	unsigned int before = *count;
+	size_t prefixLength;
+	struct dirent *entry;
+	struct stat st;
+	DIR *dir;
+
+	if (stat(arg, &st) == 0 && S_ISREG(st.st_mode))
+	{
+		snprintf(copy, sizeof(copy), "%s", arg);
+		return AddSegment(arg, basename(copy), segments, count, capacity);
+	}
+
+	snprintf(copy, sizeof(copy), "%s", arg);
+	snprintf(directory, sizeof(directory), "%s", dirname(copy));
+	snprintf(copy, sizeof(copy), "%s", arg);
+	snprintf(prefix, sizeof(prefix), "%s-", basename(copy));
+	prefixLength = strlen(prefix);
+
+	dir = opendir(directory);
+	if (dir == NULL)
+	{
+		return 0;
+	}
+
+	while ((entry = readdir(dir)) != NULL)
+	{
+		size_t length = strlen(entry->d_name);
+		int pathLength;
+
+		// the same "<name>-YYYYMMDDHH_<index>.log" and ".log.gz" the disk budget looks for
+		if (strncmp(entry->d_name, prefix, prefixLength) == 0 &&
+			((length > 4 && strcmp(entry->d_name + length - 4, ".log") == 0) ||
+			 (length > 7 && strcmp(entry->d_name + length - 7, ".log.gz") == 0)))
+		{
+			pathLength = snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+			if (pathLength < 0 || (size_t)pathLength >= sizeof(path))
+			{
+				fprintf(stderr, "%s: path too long, skipped\n", entry->d_name);
+				continue;
+			}
+			(void)AddSegment(path, entry->d_name, segments, count, capacity);
+		}
+	}
+	closedir(dir);
+
+	return (*count > before) ? 1 : 0;
+}
+
+static int AddSegment(const char *path, const char *name, SegmentFile **segments, unsigned int *count,
+					  unsigned int *capacity)
+{
+	SegmentFile *segment;
+	const char *stamp = strrchr(name, '-');
+
+	if (*count == *capacity)
+	{
+		SegmentFile *grown;
+
+		*capacity = (*capacity != 0U) ? *capacity * 2 : 64;
+		grown = (SegmentFile *)realloc(*segments, *capacity * sizeof(SegmentFile));
+		if (grown == NULL)
+		{
+			return 0;
+		}
+		*segments = grown;
+	}
+
+	segment = &(*segments)[*count];
+	snprintf(segment->path, sizeof(segment->path), "%s", path);
+	if (stamp == NULL || sscanf(stamp + 1, "%lu_%lu", &segment->hour, &segment->index) != 2)
+	{
+		segment->hour = 0;
+		segment->index = 0;
+	}
+	(*count)++;
+
+	return 1;
+}
+
+static int CompareSegments(const void *a, const void *b)
+{
+	const SegmentFile *left = (const SegmentFile *)a;
+	const SegmentFile *right = (const SegmentFile *)b;
+	int result;
+
+	if (left->hour != right->hour)
+	{
+		result = (left->hour < right->hour) ? -1 : 1;
+	}
+	else if (left->index != right->index)
+	{
+		result = (left->index < right->index) ? -1 : 1;
+	}
+	else
+	{
+		result = strcmp(left->path, right->path);
+	}
+
+	return result;
+}
+
+static TCLogIndexEntry *ReadIndex(const char *path, unsigned int *count)
+{
+	char indexPath[MAX_PATH_SIZE + 8];
+	TCLogIndexHeader header;
+	TCLogIndexEntry *entries = NULL;
+	struct stat st;
+	FILE *in;
+
+	*count = 0;
+	if (TCLogIndexPath(path, indexPath, sizeof(indexPath)) == 0 || (in = fopen(indexPath, "rb")) == NULL)
+	{
+		return NULL;
+	}
+
+	if (fstat(fileno(in), &st) == 0 && fread(&header, sizeof(header), 1, in) == 1 &&
+		memcmp(header.magic, TC_LOG_INDEX_MAGIC, 4) == 0 && header.version == TC_LOG_INDEX_VERSION &&
+		header.byteOrder == TC_LOG_INDEX_BYTE_ORDER)
+	{
+		*count = (unsigned int)(((size_t)st.st_size - sizeof(header)) / sizeof(TCLogIndexEntry));
+		entries = (TCLogIndexEntry *)malloc((*count + 1) * sizeof(TCLogIndexEntry));
+		if (entries != NULL)
+		{
+			*count = (unsigned int)fread(entries, sizeof(TCLogIndexEntry), *count, in);
+		}
+		else
+		{
+			*count = 0;
+		}
+	}
+	else
+	{
+		fprintf(stderr, "%s: not a log index, reading the whole segment\n", indexPath);
+	}
+	fclose(in);
+
+	return entries;
+}
+
+static int QuerySegment(const char *path)
+{
+	TCLogIndexEntry *entries;
+	unsigned int count;
+	unsigned int i;
+	uint64_t rangeOffset = 0;
+	uint64_t rangeLength = 0;
+	uint64_t indexed = 0;
+	gzFile file;
+
+	// gzread() passes plain segments through, compressed ones keep their index offsets but
+	// have no restart points, so each gzseek() inflates from the start: the index only saves
+	// the line parsing there, not the reading
+	file = gzopen(path, "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "%s: open failed\n", path);
+		return 1;
+	}
+	(void)gzbuffer(file, READ_SIZE);
+
+	g_lastMatch = 0;
+	g_readEnd = UINT64_MAX;
+	entries = ReadIndex(path, &count);
+	if (entries != NULL)
+	{
+		g_indexedSegments++;
+		g_entries += count;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (EntrySelected(&entries[i]) != 0)
+		{
+			if (rangeLength > 0 && rangeOffset + rangeLength != entries[i].offset)
+			{
+				ScanRange(file, rangeOffset, rangeLength);
+				rangeLength = 0;
+			}
+			if (rangeLength == 0)
+			{
+				rangeOffset = entries[i].offset;
+			}
+			rangeLength += entries[i].length;
+			g_entriesRead++;
+		}
+		indexed = (uint64_t)entries[i].offset + entries[i].length;
+	}
+	if (rangeLength > 0)
+	{
+		ScanRange(file, rangeOffset, rangeLength);
+	}
+
+	// whatever follows the last entry was written after it, or without an index
+	ScanRange(file, indexed, UINT64_MAX);
+
+	free(entries);
+	(void)gzclose(file);
+
+	return 0;
+}
+
+static int EntrySelected(const TCLogIndexEntry *entry)
+{
+	return ((g_timed == 0 || (entry->maxKey >= g_from && entry->minKey <= g_to)) &&
+			(g_levelFiltered == 0 || (entry->levels & g_levelMask) != 0U)) ? 1 : 0;
+}
+
+static void ScanRange(gzFile file, uint64_t offset, uint64_t length)
+{
+	size_t used = 0;
+	size_t want;
+	char *line;
+	char *next;
+	int got;
+
+	// a line without a header inherits the verdict of the line before it, unknown after a jump
+	if (offset != g_readEnd)
+	{
+		g_lastMatch = 0;
+		if (gzseek(file, (z_off_t)offset, SEEK_SET) < 0)
+		{
+			return;
+		}
+	}
+
+	while (length > 0)
+	{
+		want = READ_SIZE * 2 - used;
+		if ((uint64_t)want > length)
+		{
+			want = (size_t)length;
+		}
+		got = gzread(file, g_buffer + used, (unsigned int)want);
+		if (got <= 0)
+		{
+			break;
+		}
+		length -= (uint64_t)got;
+		used += (size_t)got;
+		offset += (uint64_t)got;
+		g_bytesRead += (unsigned long long)got;
+
+		line = g_buffer;
+		while ((next = (char *)memchr(line, '\n', used - (size_t)(line - g_buffer))) != NULL)
+		{
+			FilterLine(line, (size_t)(next + 1 - line));
+			line = next + 1;
+		}
+		used -= (size_t)(line - g_buffer);
+		memmove(g_buffer, line, used);
+
+		if (used == READ_SIZE * 2)
+		{
+			FilterLine(g_buffer, used);
+			used = 0;
+		}
+	}
+
+	if (used > 0)
+	{
+		FilterLine(g_buffer, used);
+	}
+	g_readEnd = offset;
+}
+
+static void FilterLine(const char *line, size_t length)
+{
+	uint64_t key;
+	int level;
+	int match;
+
+	// the zero filled tail of a mapped segment left behind by a crash
+	if (line[0] == '\0')
+	{
+		return;
+	}
+
+	level = TCLogIndexParseLine(line, length, &key);
+	if (level < 0 && key == TC_LOG_INDEX_NO_KEY)
+	{
+		match = g_lastMatch;
+	}
+	else
+	{
+		match = 1;
+		if (g_timed != 0 && (key == TC_LOG_INDEX_NO_KEY || key < g_from || key > g_to))
+		{
+			match = 0;
+		}
+		if (g_levelFiltered != 0 && (level < 0 || (g_levelMask & (1U << level)) == 0U))
+		{
+			match = 0;
+		}
+		if (match != 0 && g_prefixLength > 0 && HasPrefix(line, length) == 0)
+		{
+			match = 0;
+		}
+		g_lastMatch = match;
+	}
+
+	if (match != 0)
+	{
+		(void)fwrite(line, 1, length, stdout);
+		g_linesShown++;
+	}
+}
+
+static int HasPrefix(const char *line, size_t length)
+{
+	const char *p = line;
+	const char *end = line + length;
+
+	// only the header counts, it ends with the first "] "
+	while (p + g_prefixLength <= end && *p == '[')
+	{
+		if (memcmp(p, g_prefix, g_prefixLength) == 0)
+		{
+			return 1;
+		}
+		p = (const char *)memchr(p, ']', (size_t)(end - p));
+		if (p == NULL)
+		{
+			break;
+		}
+		p++;
+	}
+
+	return 0;
+}
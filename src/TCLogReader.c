@@ -0,0 +1,603 @@
+/****************************************************************************************
+ *   FileName    : TCLogReader.c
+ *   Description : Zero copy reader and tail follower of the text log segments
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <zlib.h>
+
+#include "TCLog.h"
+
+#define MAX_PATH_SIZE		256
+#define MAP_SLACK			(4 * 1024 * 1024)
+#define INFLATE_CHUNK		(1024 * 1024)
+#define EVENT_BUFFER_SIZE	4096
+
+#define SEGMENT_TEXT		1
+#define SEGMENT_COMPRESSED	2
+
+struct TCLogReader {
+	char directory[MAX_PATH_SIZE];
+	char prefix[MAX_PATH_SIZE];		// "<name>-" while following, empty for a single segment
+	char path[MAX_PATH_SIZE + 1];
+	unsigned long hour;
+	unsigned long index;
+	int fd;
+	char *data;
+	size_t mapLength;
+	size_t size;
+	size_t position;
+	size_t pageSize;
+	int inflated;					// data is a decompressed copy, not a mapping
+	int finished;					// a newer segment exists, the last line may miss its new line
+	int rescan;
+	int inotifyFd;
+};
+
+static TCLogReader *CreateReader(void);
+static int LoadSegment(TCLogReader *reader, const char *path);
+static int InflateSegment(TCLogReader *reader, const char *path);
+static void ReleaseSegment(TCLogReader *reader);
+static int ReadLine(TCLogReader *reader, TCLogLine *line);
+static void ParseLine(const char *text, size_t length, TCLogLine *line);
+static int Refresh(TCLogReader *reader);
+static int FindSegment(TCLogReader *reader, int newest, char *path, size_t size, unsigned long *hour, unsigned long *index);
+static int ParseSegmentName(const char *name, unsigned long *hour, unsigned long *index);
+static int CompareSegments(unsigned long hour, unsigned long index, unsigned long otherHour, unsigned long otherIndex);
+static int DrainEvents(TCLogReader *reader);
+
+static const char *g_levelNames[TotalTCLogLevels] = {
+	"ERROR",
+	"WARN",
+	"INFO",
+	"DEBUG"
+};
+
+TCLogReader *TCLogReaderOpen(const char *path)
+{
+	TCLogReader *reader = CreateReader();
+
+	if (reader != NULL && LoadSegment(reader, path) == 0)
+	{
+		TCLogReaderClose(reader);
+		reader = NULL;
+	}
+
+	return reader;
+}
+
+TCLogReader *TCLogReaderFollow(const char *name)
+{
+	TCLogReader *reader = CreateReader();
+	char copy[MAX_PATH_SIZE];
+	char path[MAX_PATH_SIZE + 1];
+
+	if (reader == NULL)
+	{
+		return NULL;
+	}
+
+	snprintf(copy, sizeof(copy), "%s", name);
+	snprintf(reader->directory, sizeof(reader->directory), "%s", dirname(copy));
+	snprintf(copy, sizeof(copy), "%s", name);
+	snprintf(reader->prefix, sizeof(reader->prefix), "%s-", basename(copy));
+
+	// the directory is watched, not the segment, so rotation shows up as a new file
+	reader->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (reader->inotifyFd < 0 ||
+		inotify_add_watch(reader->inotifyFd, reader->directory, IN_CREATE | IN_MOVED_TO | IN_MODIFY) < 0)
+	{
+		fprintf(stderr, "%s: watch %s failed, %s\n", __func__, reader->directory, strerror(errno));
+		TCLogReaderClose(reader);
+		return NULL;
+	}
+
+	// like tail -f, only lines written from now on
+	reader->hour = 0;
+	reader->index = 0;
+	if (FindSegment(reader, 1, path, sizeof(path), &reader->hour, &reader->index) != 0 && LoadSegment(reader, path) != 0)
+	{
+		reader->position = reader->size;
+		while (reader->position > 0 && reader->data[reader->position - 1] == '\0')
+		{
+			reader->position--;
+		}
+	}
+
+	return reader;
+}
+
+int TCLogReaderNext(TCLogReader *reader, TCLogLine *line)
+{
+	int found = 0;
+
+	while (found == 0)
+	{
+		found = ReadLine(reader, line);
+		if (found == 0 && (reader->inotifyFd < 0 || Refresh(reader) == 0))
+		{
+			break;
+		}
+	}
+
+	return found;
+}
+
+int TCLogReaderWait(TCLogReader *reader, int timeoutMs)
+{
+	struct pollfd pfd;
+	int ready = 0;
+
+	if (reader->inotifyFd >= 0)
+	{
+		ready = Refresh(reader);
+		if (ready == 0)
+		{
+			pfd.fd = reader->inotifyFd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			ready = (poll(&pfd, 1, timeoutMs) > 0) ? 1 : 0;
+		}
+	}
+
+	return ready;
+}
+
+int TCLogReaderFd(const TCLogReader *reader)
+{
+	return reader->inotifyFd;
+}
+
+void TCLogReaderClose(TCLogReader *reader)
+{
+	if (reader != NULL)
+	{
+		ReleaseSegment(reader);
+		if (reader->inotifyFd >= 0)
+		{
+			close(reader->inotifyFd);
+		}
+		free(reader);
+	}
+}
+
+static TCLogReader *CreateReader(void)
+{
+	TCLogReader *reader = (TCLogReader *)calloc(1, sizeof(TCLogReader));
+
+	if (reader != NULL)
+	{
+		reader->fd = -1;
+		reader->inotifyFd = -1;
+		reader->pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	}
+	else
+	{
+		fprintf(stderr, "%s: out of memory\n", __func__);
+	}
+
+	return reader;
+}
+
+static int LoadSegment(TCLogReader *reader, const char *path)
+{
+	size_t length = strlen(path);
+	struct stat st;
+
+	ReleaseSegment(reader);
+	snprintf(reader->path, sizeof(reader->path), "%s", path);
+
+	if (length > 3 && strcmp(path + length - 3, ".gz") == 0)
+	{
+		return InflateSegment(reader, path);
+	}
+
+	reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (reader->fd < 0 || fstat(reader->fd, &st) != 0)
+	{
+		fprintf(stderr, "%s: open %s failed\n", __func__, path);
+		return 0;
+	}
+
+	// a followed segment keeps growing into the slack of its mapping
+	reader->size = (size_t)st.st_size;
+	reader->mapLength = reader->size;
+	if (reader->inotifyFd >= 0)
+	{
+		reader->mapLength = (reader->size / MAP_SLACK + 1) * MAP_SLACK;
+	}
+
+	if (reader->mapLength > 0)
+	{
+		reader->data = (char *)mmap(NULL, reader->mapLength, PROT_READ, MAP_SHARED, reader->fd, 0);
+		if (reader->data == MAP_FAILED)
+		{
+			fprintf(stderr, "%s: mmap %s failed\n", __func__, path);
+			reader->data = NULL;
+			return 0;
+		}
+		(void)madvise(reader->data, reader->mapLength, MADV_SEQUENTIAL);
+	}
+
+	return 1;
+}
+
+static int InflateSegment(TCLogReader *reader, const char *path)
+{
+	gzFile file = gzopen(path, "rb");
+	char *grown;
+	int got = 1;
+
+	if (file == NULL)
+	{
+		fprintf(stderr, "%s: open %s failed\n", __func__, path);
+		return 0;
+	}
+
+	// a compressed segment is closed for good, one copy of it is all that is needed
+	reader->inflated = 1;
+	while (got > 0)
+	{
+		if (reader->size + INFLATE_CHUNK > reader->mapLength)
+		{
+			grown = (char *)realloc(reader->data, reader->mapLength + INFLATE_CHUNK);
+			if (grown == NULL)
+			{
+				break;
+			}
+			reader->data = grown;
+			reader->mapLength += INFLATE_CHUNK;
+		}
+		got = gzread(file, reader->data + reader->size, INFLATE_CHUNK);
+		if (got > 0)
+		{
+			reader->size += (size_t)got;
+		}
+	}
+	(void)gzclose(file);
+
+	return (got == 0) ? 1 : 0;
+}
+
+static void ReleaseSegment(TCLogReader *reader)
+{
+	if (reader->inflated != 0)
+	{
+		free(reader->data);
+	}
+	else if (reader->data != NULL)
+	{
+		(void)munmap(reader->data, reader->mapLength);
+	}
+	if (reader->fd >= 0)
+	{
+		close(reader->fd);
+	}
+
+	reader->fd = -1;
+	reader->data = NULL;
+	reader->mapLength = 0;
+	reader->size = 0;
+	reader->position = 0;
+	reader->inflated = 0;
+	reader->finished = 0;
+}
+
+static int ReadLine(TCLogReader *reader, TCLogLine *line)
+{
+	struct stat st;
+	const char *start;
+	const char *newLine;
+	size_t length;
+
+	// a mapped segment is cut back to its data once closed, never touch a page past its end
+	if (reader->inotifyFd >= 0 && reader->inflated == 0 && reader->position % reader->pageSize == 0 &&
+		reader->position < reader->size && fstat(reader->fd, &st) == 0 && (size_t)st.st_size < reader->size)
+	{
+		reader->size = (size_t)st.st_size;
+	}
+
+	if (reader->position >= reader->size || reader->data[reader->position] == '\0')
+	{
+		return 0;
+	}
+
+	// memchr() is the vectorized new line scan of the C library on every target
+	start = reader->data + reader->position;
+	newLine = (const char *)memchr(start, '\n', reader->size - reader->position);
+	if (newLine != NULL)
+	{
+		length = (size_t)(newLine - start);
+		reader->position += length + 1;
+	}
+	else if (reader->inotifyFd < 0 || reader->finished != 0)
+	{
+		length = strnlen(start, reader->size - reader->position);
+		reader->position += length;
+	}
+	else
+	{
+		// the writer has not finished this line yet
+		return 0;
+	}
+
+	ParseLine(start, length, line);
+
+	return 1;
+}
+
+static void ParseLine(const char *text, size_t length, TCLogLine *line)
+{
+	const char *end = text + length;
+	const char *p = text;
+	const char *groups[4];
+	unsigned int groupLengths[4];
+	const char *close;
+	unsigned int count = 0;
+	unsigned int i = 0;
+	int level;
+
+	memset(line, 0x00, sizeof(TCLogLine));
+	line->text = text;
+	line->length = (unsigned int)length;
+	line->level = -1;
+	line->message = text;
+	line->messageLength = (unsigned int)length;
+
+	// "[time][LEVEL][prefix][sub] message", the time and the sub prefix are optional
+	while (count < 4 && p < end && *p == '[' && (close = (const char *)memchr(p, ']', (size_t)(end - p))) != NULL)
+	{
+		groups[count] = p + 1;
+		groupLengths[count] = (unsigned int)(close - p - 1);
+		count++;
+		p = close + 1;
+	}
+
+	if (count > 0 && (groups[0][0] == ' ' || (groups[0][0] >= '0' && groups[0][0] <= '9')))
+	{
+		line->time = groups[0];
+		line->timeLength = groupLengths[0];
+		i = 1;
+	}
+
+	for (level = 0; i < count && level < TotalTCLogLevels; level++)
+	{
+		if (groupLengths[i] == strlen(g_levelNames[level]) && memcmp(groups[i], g_levelNames[level], groupLengths[i]) == 0)
+		{
+			break;
+		}
+	}
+	if (i >= count || level >= TotalTCLogLevels)
+	{
+		// not a TCLog header, the whole line is the message
+		line->time = NULL;
+		line->timeLength = 0;
+		return;
+	}
+
+	line->level = level;
+	i++;
+	if (i < count)
+	{
+		line->prefix = groups[i];
+		line->prefixLength = groupLengths[i];
+		i++;
+	}
+	if (i < count)
+	{
+		line->subPrefix = groups[i];
+		line->subPrefixLength = groupLengths[i];
+	}
+
+	if (p < end && *p == ' ')
+	{
+		p++;
+	}
+	line->message = p;
+	line->messageLength = (unsigned int)(end - p);
+}
+
+static int Refresh(TCLogReader *reader)
+{
+	char path[MAX_PATH_SIZE + 1];
+	unsigned long hour = 0;
+	unsigned long index = 0;
+	struct stat st;
+	size_t mapLength;
+	void *data;
+
+	(void)DrainEvents(reader);
+
+	if (reader->fd >= 0 && fstat(reader->fd, &st) == 0 && (size_t)st.st_size != reader->size)
+	{
+		if ((size_t)st.st_size > reader->mapLength)
+		{
+			mapLength = ((size_t)st.st_size / MAP_SLACK + 1) * MAP_SLACK;
+			data = mmap(NULL, mapLength, PROT_READ, MAP_SHARED, reader->fd, 0);
+			if (data == MAP_FAILED)
+			{
+				return 0;
+			}
+			if (reader->data != NULL)
+			{
+				(void)munmap(reader->data, reader->mapLength);
+			}
+			reader->data = (char *)data;
+			reader->mapLength = mapLength;
+		}
+		reader->size = (size_t)st.st_size;
+		if (reader->position > reader->size)
+		{
+			reader->position = reader->size;
+		}
+		return 1;
+	}
+
+	if (reader->rescan != 0)
+	{
+		// step through every segment rotated out while this one was being read
+		if (FindSegment(reader, (reader->data == NULL) ? 1 : 0, path, sizeof(path), &hour, &index) != 0)
+		{
+			// hand out a last line cut without its new line before moving on
+			if (reader->finished == 0 && reader->position < reader->size && reader->data[reader->position] != '\0')
+			{
+				reader->finished = 1;
+				return 1;
+			}
+
+			reader->hour = hour;
+			reader->index = index;
+			return LoadSegment(reader, path);
+		}
+		reader->rescan = 0;
+	}
+
+	return 0;
+}
+
+static int FindSegment(TCLogReader *reader, int newest, char *path, size_t size, unsigned long *hour, unsigned long *index)
+{
+	size_t prefixLength = strlen(reader->prefix);
+	char candidate[MAX_PATH_SIZE + 1];
+	struct dirent *entry;
+	unsigned long entryHour;
+	unsigned long entryIndex;
+	int found = 0;
+	DIR *dir;
+
+	dir = opendir(reader->directory);
+	if (dir == NULL)
+	{
+		return 0;
+	}
+
+	// the newest segment, or the oldest one after the current segment
+	while ((entry = readdir(dir)) != NULL)
+	{
+		int kind = 0;
+		int order;
+
+		if (strncmp(entry->d_name, reader->prefix, prefixLength) == 0)
+		{
+			kind = ParseSegmentName(entry->d_name + prefixLength, &entryHour, &entryIndex);
+		}
+
+		// compressed segments are closed already, only a ".log" can still grow
+		if (kind == 0 || (newest != 0 && kind != SEGMENT_TEXT) ||
+			(newest == 0 && CompareSegments(entryHour, entryIndex, reader->hour, reader->index) <= 0))
+		{
+			continue;
+		}
+
+		// a ".log" still next to its ".log.gz" means the compression is not done yet
+		order = CompareSegments(entryHour, entryIndex, *hour, *index);
+		if (found == 0 || (newest != 0 && order > 0) || (newest == 0 && order < 0) ||
+			(order == 0 && kind == SEGMENT_TEXT))
+		{
+			int length = snprintf(candidate, sizeof(candidate), "%s/%s", reader->directory, entry->d_name);
+
+			if (length < 0 || (size_t)length >= sizeof(candidate) || (size_t)length >= size)
+			{
+				fprintf(stderr, "%s: path of %s is too long, skipped\n", __func__, entry->d_name);
+				continue;
+			}
+			memcpy(path, candidate, (size_t)length + 1);
+			*hour = entryHour;
+			*index = entryIndex;
+			found = 1;
+		}
+	}
+	closedir(dir);
+
+	return found;
+}
+
+static int ParseSegmentName(const char *name, unsigned long *hour, unsigned long *index)
+{
+	int consumed = 0;
+	int kind = 0;
+
+	if (sscanf(name, "%lu_%lu%n", hour, index, &consumed) == 2 && consumed > 0)
+	{
+		if (strcmp(name + consumed, ".log") == 0)
+		{
+			kind = SEGMENT_TEXT;
+		}
+		else if (strcmp(name + consumed, ".log.gz") == 0)
+		{
+			kind = SEGMENT_COMPRESSED;
+		}
+	}
+
+	return kind;
+}
+
+static int CompareSegments(unsigned long hour, unsigned long index, unsigned long otherHour, unsigned long otherIndex)
+{
+	if (hour != otherHour)
+	{
+		return (hour > otherHour) ? 1 : -1;
+	}
+	if (index != otherIndex)
+	{
+		return (index > otherIndex) ? 1 : -1;
+	}
+	return 0;
+}
+
+static int DrainEvents(TCLogReader *reader)
+{
+	char buffer[EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	size_t prefixLength = strlen(reader->prefix);
+	ssize_t received;
+	ssize_t offset;
+	int count = 0;
+
+	while ((received = read(reader->inotifyFd, buffer, sizeof(buffer))) > 0)
+	{
+		for (offset = 0; offset < received; offset += (ssize_t)(sizeof(struct inotify_event) + event->len))
+		{
+			event = (const struct inotify_event *)(buffer + offset);
+			if ((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0 && event->len > 0 &&
+				strncmp(event->name, reader->prefix, prefixLength) == 0)
+			{
+				reader->rescan = 1;
+			}
+			count++;
+		}
+	}
+
+	return count;
+}
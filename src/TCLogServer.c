@@ -0,0 +1,483 @@
+/****************************************************************************************
+ *   FileName    : TCLogServer.c
+ *   Description : tclogd, merges the shared memory rings of TCLog clients into one log
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+#include "TCLogDaemon.h"
+
+#define MAX_CLIENTS				64
+#define DEFAULT_DRAIN_MS		50
+#define DEFAULT_HOLDBACK_MS		100
+
+typedef struct {
+	int fd;
+	int pid;
+	TCLogDaemonRing *ring;
+	const char *data;
+	uint32_t size;
+	uint64_t cursor;		// next record to merge, published as tail after the batch
+	uint64_t head;			// snapshot taken at the start of the batch
+	uint64_t dropped;		// drops already reported
+	int urgent;				// past half full, drained without waiting for the other rings
+	int closing;
+} DaemonClient;
+
+static int AcceptClient(int listenFd);
+static int MapRing(DaemonClient *client, int memfd, const TCLogDaemonHello *hello);
+static void ReleaseClient(DaemonClient *client);
+static unsigned long Drain(int force);
+static const char *NextRecord(DaemonClient *client, TCLogDaemonRecord *record);
+static uint64_t RecordKey(const TCLogDaemonRecord *record);
+static uint64_t GetWallMs(void);
+static void Stop(int signo);
+
+static DaemonClient g_clients[MAX_CLIENTS];
+static unsigned int g_clientCount = 0;
+static unsigned int g_holdbackMs = DEFAULT_HOLDBACK_MS;
+static volatile sig_atomic_t g_stop = 0;
+
+int main(int argc, char *argv[])
+{
+	struct pollfd fds[MAX_CLIENTS + 1];
+	struct sockaddr_un address;
+	struct sigaction action;
+	const char *socketPath = TC_LOG_DAEMON_SOCKET;
+	const char *name = "/run/log/tclogd";
+	unsigned long long maxBytes = 0;
+	unsigned int maxFiles = 0;
+	unsigned int indexBytes = 0;
+	unsigned int drainMs = DEFAULT_DRAIN_MS;
+	unsigned long long lines = 0;
+	int compressLevel = 0;
+	int opt;
+	unsigned int i;
+
+	while ((opt = getopt(argc, argv, "s:o:d:H:b:f:z:x:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+				socketPath = optarg;
+				break;
+			case 'o':
+				name = optarg;
+				break;
+			case 'd':
+				drainMs = (unsigned int)atoi(optarg);
+				break;
+			case 'H':
+				g_holdbackMs = (unsigned int)atoi(optarg);
+				break;
+			case 'b':
+				maxBytes = strtoull(optarg, NULL, 10) * 1024ULL * 1024ULL;
+				break;
+			case 'f':
+				maxFiles = (unsigned int)atoi(optarg);
+				break;
+			case 'z':
+				compressLevel = atoi(optarg);
+				break;
+			case 'x':
+				indexBytes = (unsigned int)atoi(optarg);
+				break;
+			default:
+				printf("usage: %s [-s SOCKET] [-o NAME] [-d MS] [-H MS] [-b MB] [-f FILES] [-z LEVEL] [-x BYTES]\n", argv[0]);
+				printf("write the lines of every TCLogConnectDaemon() client into one log, merged by time\n");
+				printf("  -s SOCKET  listening socket (default %s)\n", TC_LOG_DAEMON_SOCKET);
+				printf("  -o NAME    log name as given to TCLogSetFileName() (default /run/log/tclogd)\n");
+				printf("  -d MS      drain interval (default %d)\n", DEFAULT_DRAIN_MS);
+				printf("  -H MS      lines younger than this wait for slower rings (default %d)\n", DEFAULT_HOLDBACK_MS);
+				printf("  -b MB, -f FILES  disk budget of all segments, see TCLogSetDiskBudget()\n");
+				printf("  -z LEVEL   compress closed segments\n");
+				printf("  -x BYTES   sidecar index interval, see TCLogSetIndexInterval()\n");
+				return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if (strlen(socketPath) >= sizeof(address.sun_path))
+	{
+		fprintf(stderr, "%s: invalid socket path\n", argv[0]);
+		return 1;
+	}
+
+	// tclogd is the only writer, rotation, budget and compression run here for every client
+	TCLogInitialize("tclogd", NULL, 1);
+	TCRedirectLog(NULL);
+	TCLogSetFileName(name);
+	TCLogSetPersistentFile(1);
+	if (maxBytes != 0ULL || maxFiles != 0U)
+	{
+		(void)TCLogSetDiskBudget(maxBytes, maxFiles, 0, 0);
+	}
+	if (compressLevel != 0)
+	{
+		(void)TCLogEnableCompression(compressLevel);
+	}
+	TCLogSetIndexInterval(indexBytes);
+
+	memset(&address, 0x00, sizeof(address));
+	address.sun_family = AF_UNIX;
+	(void)strcpy(address.sun_path, socketPath);
+	(void)unlink(address.sun_path);
+
+	fds[0].fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	fds[0].events = POLLIN;
+	if (fds[0].fd < 0 || bind(fds[0].fd, (const struct sockaddr *)&address, sizeof(address)) != 0 ||
+		listen(fds[0].fd, 16) != 0)
+	{
+		fprintf(stderr, "%s: listen on %s failed, %s\n", argv[0], address.sun_path, strerror(errno));
+		return 1;
+	}
+
+	memset(&action, 0x00, sizeof(action));
+	action.sa_handler = Stop;
+	(void)sigaction(SIGINT, &action, NULL);
+	(void)sigaction(SIGTERM, &action, NULL);
+	action.sa_handler = SIG_IGN;
+	(void)sigaction(SIGPIPE, &action, NULL);
+
+	while (g_stop == 0)
+	{
+		for (i = 0; i < g_clientCount; i++)
+		{
+			fds[i + 1].fd = g_clients[i].fd;
+			fds[i + 1].events = POLLIN;
+			fds[i + 1].revents = 0;
+		}
+
+		if (poll(fds, (nfds_t)(g_clientCount + 1), (int)drainMs) > 0)
+		{
+			for (i = 0; i < g_clientCount; i++)
+			{
+				char kick[64];
+				ssize_t received;
+
+				// a byte is a client asking for an early drain, the end of the stream its exit
+				if (fds[i + 1].revents != 0)
+				{
+					received = recv(g_clients[i].fd, kick, sizeof(kick), MSG_DONTWAIT);
+					if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR))
+					{
+						g_clients[i].closing = 1;
+					}
+				}
+			}
+
+			if ((fds[0].revents & POLLIN) != 0)
+			{
+				(void)AcceptClient(fds[0].fd);
+			}
+		}
+
+		lines += Drain(0);
+
+		for (i = g_clientCount; i > 0; i--)
+		{
+			if (g_clients[i - 1].closing != 0)
+			{
+				TCLog(TCLogLevelInfo, "client %d disconnected\n", g_clients[i - 1].pid);
+				ReleaseClient(&g_clients[i - 1]);
+				g_clients[i - 1] = g_clients[--g_clientCount];
+			}
+		}
+	}
+
+	lines += Drain(1);
+	for (i = 0; i < g_clientCount; i++)
+	{
+		ReleaseClient(&g_clients[i]);
+	}
+	TCLog(TCLogLevelInfo, "stopped after %llu lines\n", lines);
+	(void)unlink(address.sun_path);
+	TCLogDisableCompression();
+	TCLogStopDiskBudget();
+
+	return 0;
+}
+
+static int AcceptClient(int listenFd)
+{
+	TCLogDaemonHello hello;
+	struct msghdr message;
+	struct iovec iov;
+	struct cmsghdr *control;
+	struct timeval timeout;
+	char buffer[CMSG_SPACE(sizeof(int))];
+	DaemonClient *client;
+	ssize_t received;
+	int memfd = -1;
+	int fd;
+
+	fd = accept(listenFd, NULL, NULL);
+	if (fd < 0)
+	{
+		return 0;
+	}
+	(void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	// a client that connects but never says hello must not stall the others
+	timeout.tv_sec = 1;
+	timeout.tv_usec = 0;
+	(void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	memset(&message, 0x00, sizeof(message));
+	iov.iov_base = &hello;
+	iov.iov_len = sizeof(hello);
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	message.msg_control = buffer;
+	message.msg_controllen = sizeof(buffer);
+
+	received = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+	if (received > 0 && (control = CMSG_FIRSTHDR(&message)) != NULL && control->cmsg_level == SOL_SOCKET &&
+		control->cmsg_type == SCM_RIGHTS && control->cmsg_len == CMSG_LEN(sizeof(int)))
+	{
+		memcpy(&memfd, CMSG_DATA(control), sizeof(int));
+	}
+
+	if (g_clientCount >= MAX_CLIENTS)
+	{
+		TCLog(TCLogLevelWarn, "client refused, %d clients connected already\n", MAX_CLIENTS);
+		close(fd);
+		if (memfd >= 0)
+		{
+			close(memfd);
+		}
+		return 0;
+	}
+
+	client = &g_clients[g_clientCount];
+	memset(client, 0x00, sizeof(DaemonClient));
+	client->fd = fd;
+	if (memfd < 0 || received != (ssize_t)sizeof(hello) || MapRing(client, memfd, &hello) == 0 || send(fd, "K", 1, MSG_NOSIGNAL) != 1)
+	{
+		TCLog(TCLogLevelWarn, "client refused, no valid ring\n");
+		ReleaseClient(client);
+		if (memfd >= 0)
+		{
+			close(memfd);
+		}
+		return 0;
+	}
+	close(memfd);
+
+	client->pid = hello.pid;
+	client->cursor = __atomic_load_n(&client->ring->tail, __ATOMIC_ACQUIRE);
+	g_clientCount++;
+	TCLog(TCLogLevelInfo, "client %d connected with a %u bytes ring\n", client->pid, client->size);
+
+	return 1;
+}
+
+static int MapRing(DaemonClient *client, int memfd, const TCLogDaemonHello *hello)
+{
+	size_t mapSize = TC_LOG_DAEMON_DATA_OFFSET + (size_t)hello->size;
+	int seals = fcntl(memfd, F_GET_SEALS);
+	struct stat st;
+	void *map;
+
+	// the size has to be sealed, a client shrinking the ring would crash tclogd on the next read
+	if (memcmp(hello->magic, TC_LOG_DAEMON_MAGIC, 4) != 0 || hello->version != TC_LOG_DAEMON_VERSION ||
+		hello->size == 0U || hello->size % TC_LOG_DAEMON_ALIGN != 0U || seals < 0 ||
+		(seals & F_SEAL_SHRINK) == 0 || fstat(memfd, &st) != 0 || (size_t)st.st_size != mapSize)
+	{
+		return 0;
+	}
+
+	map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+	if (map == MAP_FAILED)
+	{
+		return 0;
+	}
+
+	client->ring = (TCLogDaemonRing *)map;
+	client->data = (const char *)map + TC_LOG_DAEMON_DATA_OFFSET;
+	client->size = hello->size;
+
+	return 1;
+}
+
+static void ReleaseClient(DaemonClient *client)
+{
+	if (client->ring != NULL)
+	{
+		(void)munmap(client->ring, TC_LOG_DAEMON_DATA_OFFSET + (size_t)client->size);
+		client->ring = NULL;
+	}
+	if (client->fd >= 0)
+	{
+		close(client->fd);
+		client->fd = -1;
+	}
+}
+
+static unsigned long Drain(int force)
+{
+	pthread_mutex_t *logMutex = TCLogMutex();
+	TCLogDaemonRecord record;
+	TCLogDaemonRecord oldestRecord;
+	const char *text;
+	const char *oldestText = NULL;
+	DaemonClient *oldest;
+	TCLogTime logTime;
+	uint64_t cutoff;
+	uint64_t oldestKey = 0;
+	uint64_t dropped;
+	unsigned long lines = 0;
+	unsigned int i;
+
+	cutoff = (force != 0) ? UINT64_MAX : GetWallMs() - g_holdbackMs;
+	for (i = 0; i < g_clientCount; i++)
+	{
+		g_clients[i].head = __atomic_load_n(&g_clients[i].ring->head, __ATOMIC_ACQUIRE);
+		if (g_clients[i].head - g_clients[i].cursor > g_clients[i].size)
+		{
+			TCLog(TCLogLevelError, "client %d ring is corrupted, dropped\n", g_clients[i].pid);
+			g_clients[i].cursor = g_clients[i].head;
+			g_clients[i].closing = 1;
+		}
+		g_clients[i].urgent = (g_clients[i].head - g_clients[i].cursor > g_clients[i].size / 2) ? 1 : 0;
+	}
+
+	(void)pthread_mutex_lock(logMutex);
+	for (;;)
+	{
+		// always the oldest line of all rings, an urgent or closing ring does not wait for the others
+		oldest = NULL;
+		for (i = 0; i < g_clientCount; i++)
+		{
+			text = NextRecord(&g_clients[i], &record);
+			if (text != NULL && (RecordKey(&record) <= cutoff || g_clients[i].urgent != 0 || g_clients[i].closing != 0) &&
+				(oldest == NULL || RecordKey(&record) < oldestKey))
+			{
+				oldest = &g_clients[i];
+				oldestKey = RecordKey(&record);
+				oldestRecord = record;
+				oldestText = text;
+			}
+		}
+		if (oldest == NULL)
+		{
+			break;
+		}
+
+		TCLogTimeFromEpoch(&logTime, (long)oldestRecord.epoch, oldestRecord.stampMs);
+		(void)TCLogWriteText(&logTime, oldestText, oldestRecord.length);
+		oldest->cursor += (sizeof(TCLogDaemonRecord) + oldestRecord.length + TC_LOG_DAEMON_ALIGN - 1) &
+						  ~(uint64_t)(TC_LOG_DAEMON_ALIGN - 1);
+		lines++;
+	}
+	if (lines != 0UL)
+	{
+		TCLogFinishWrite();
+	}
+	(void)pthread_mutex_unlock(logMutex);
+
+	for (i = 0; i < g_clientCount; i++)
+	{
+		__atomic_store_n(&g_clients[i].ring->tail, g_clients[i].cursor, __ATOMIC_RELEASE);
+
+		dropped = __atomic_load_n(&g_clients[i].ring->dropped, __ATOMIC_RELAXED);
+		if (dropped != g_clients[i].dropped)
+		{
+			TCLog(TCLogLevelWarn, "client %d dropped %llu lines on a full ring\n", g_clients[i].pid,
+				  (unsigned long long)(dropped - g_clients[i].dropped));
+			g_clients[i].dropped = dropped;
+		}
+	}
+
+	return lines;
+}
+
+static const char *NextRecord(DaemonClient *client, TCLogDaemonRecord *record)
+{
+	const char *text = NULL;
+	uint32_t position;
+	uint32_t contiguous;
+
+	while (text == NULL && client->cursor < client->head)
+	{
+		position = (uint32_t)(client->cursor % client->size);
+		contiguous = client->size - position;
+
+		// the client can still write the ring, only this copy of the header is checked and used
+		memcpy(record, client->data + position,
+			   (contiguous >= sizeof(TCLogDaemonRecord)) ? sizeof(TCLogDaemonRecord) : sizeof(uint32_t));
+
+		if (record->length == TC_LOG_DAEMON_WRAP)
+		{
+			client->cursor += contiguous;
+		}
+		else if (contiguous >= sizeof(TCLogDaemonRecord) && record->length <= contiguous - sizeof(TCLogDaemonRecord) &&
+				 client->cursor + sizeof(TCLogDaemonRecord) + record->length <= client->head)
+		{
+			text = client->data + position + sizeof(TCLogDaemonRecord);
+		}
+		else
+		{
+			// the client wrote past its own records, nothing after this point can be trusted
+			client->cursor = client->head;
+			client->closing = 1;
+		}
+	}
+
+	return text;
+}
+
+static uint64_t RecordKey(const TCLogDaemonRecord *record)
+{
+	return (uint64_t)record->epoch * 1000ULL + ((record->monotonic != 0) ? 0ULL : (uint64_t)record->stampMs);
+}
+
+static uint64_t GetWallMs(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_REALTIME, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)(ts.tv_nsec / 1000000);
+}
+
+static void Stop(int signo)
+{
+	(void)signo;
+	g_stop = 1;
+}
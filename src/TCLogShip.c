@@ -0,0 +1,405 @@
+/****************************************************************************************
+ *   FileName    : TCLogShip.c
+ *   Description : batched shipping of TCLog lines to a local collector socket
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define SHIP_BATCH_SIZE			65536
+#define DEFAULT_QUEUE_BYTES		(16 * SHIP_BATCH_SIZE)
+#define MIN_QUEUE_BATCHES		2
+#define FLUSH_INTERVAL_MS		100
+#define MIN_RECONNECT_MS		100
+#define MAX_RECONNECT_MS		5000
+
+typedef struct {
+	char *data;
+	unsigned int used;
+	unsigned int lines;
+} ShipBatch;
+
+struct TCLogShipper {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t readyCond;
+	pthread_cond_t spaceCond;
+	ShipBatch *batches;
+	unsigned int count;
+	unsigned int head;			// oldest sealed batch, the one being sent
+	unsigned int sealed;		// the filling batch follows the sealed ones
+	long openedMs;
+	TCLogAsyncPolicy policy;
+	int stop;
+	int unreachable;			// the last connect failed, a blocking push drops instead of waiting
+	int fd;
+	struct sockaddr_un address;
+	socklen_t addressLength;
+	unsigned long dropped;
+	unsigned long packets;
+	unsigned long lines;
+};
+
+static void *ShipperThread(void *arg);
+static int SendBatch(TCLogShipper *shipper, const ShipBatch *batch);
+static int Connect(TCLogShipper *shipper);
+static int SetReachable(TCLogShipper *shipper, int reachable);
+static int IsStopping(TCLogShipper *shipper);
+static void GetTimeout(struct timespec *ts, long msec);
+static long GetMonotonicMs(void);
+
+TCLogShipper *TCLogShipperStart(const char *path, unsigned int queueBytes, TCLogAsyncPolicy policy)
+{
+	TCLogShipper *shipper;
+	unsigned int i;
+
+	if (path == NULL || strlen(path) >= sizeof(shipper->address.sun_path))
+	{
+		fprintf(stderr, "%s: invalid socket path\n", __func__);
+		return NULL;
+	}
+	if (policy != TCLogAsyncBlock && policy != TCLogAsyncDropNewest)
+	{
+		fprintf(stderr, "%s: only the block and drop newest policies apply to shipping\n", __func__);
+		return NULL;
+	}
+
+	shipper = (TCLogShipper *)calloc(1, sizeof(TCLogShipper));
+	if (shipper == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", __func__);
+		return NULL;
+	}
+
+	shipper->count = ((queueBytes != 0U) ? queueBytes : DEFAULT_QUEUE_BYTES) / SHIP_BATCH_SIZE;
+	shipper->count = (shipper->count < MIN_QUEUE_BATCHES) ? MIN_QUEUE_BATCHES : shipper->count;
+	shipper->batches = (ShipBatch *)calloc(shipper->count, sizeof(ShipBatch));
+	for (i = 0; shipper->batches != NULL && i < shipper->count; i++)
+	{
+		shipper->batches[i].data = (char *)malloc(SHIP_BATCH_SIZE);
+		if (shipper->batches[i].data == NULL)
+		{
+			break;
+		}
+	}
+
+	shipper->policy = policy;
+	shipper->fd = -1;
+	shipper->address.sun_family = AF_UNIX;
+	(void)strcpy(shipper->address.sun_path, path);
+	shipper->addressLength = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + strlen(path) + 1);
+	(void)pthread_mutex_init(&shipper->mutex, NULL);
+	(void)pthread_cond_init(&shipper->readyCond, NULL);
+	(void)pthread_cond_init(&shipper->spaceCond, NULL);
+
+	if (shipper->batches == NULL || i < shipper->count ||
+		pthread_create(&shipper->thread, NULL, ShipperThread, shipper) != 0)
+	{
+		fprintf(stderr, "%s: start failed\n", __func__);
+		shipper->count = i;
+		shipper->thread = pthread_self();
+		TCLogShipperStop(shipper);
+		shipper = NULL;
+	}
+
+	return shipper;
+}
+
+int TCLogShipperPush(TCLogShipper *shipper, const char *text, unsigned int length)
+{
+	struct timespec ts;
+	int queued = 1;
+	int counted = 0;
+
+	(void)pthread_mutex_lock(&shipper->mutex);
+	while (length > 0U)
+	{
+		ShipBatch *batch;
+		unsigned int room;
+
+		if (shipper->sealed == shipper->count)
+		{
+			// blocking only lasts while the collector takes packets, the callers hold the sink lock
+			if (shipper->policy == TCLogAsyncBlock && shipper->stop == 0 && shipper->unreachable == 0)
+			{
+				GetTimeout(&ts, FLUSH_INTERVAL_MS);
+				(void)pthread_cond_timedwait(&shipper->spaceCond, &shipper->mutex, &ts);
+				continue;
+			}
+			shipper->dropped++;
+			queued = 0;
+			break;
+		}
+
+		batch = &shipper->batches[(shipper->head + shipper->sealed) % shipper->count];
+		room = SHIP_BATCH_SIZE - batch->used;
+		if (length > room && batch->used > 0U)
+		{
+			// lines stay whole inside a packet unless one alone is larger than a batch
+			shipper->sealed++;
+			(void)pthread_cond_signal(&shipper->readyCond);
+			continue;
+		}
+
+		if (batch->used == 0U)
+		{
+			shipper->openedMs = GetMonotonicMs();
+		}
+		room = (length < room) ? length : room;
+		memcpy(batch->data + batch->used, text, room);
+		batch->used += room;
+		text += room;
+		length -= room;
+		if (counted == 0)
+		{
+			batch->lines++;
+			counted = 1;
+		}
+
+		if (batch->used == SHIP_BATCH_SIZE)
+		{
+			shipper->sealed++;
+			(void)pthread_cond_signal(&shipper->readyCond);
+		}
+	}
+	(void)pthread_mutex_unlock(&shipper->mutex);
+
+	return queued;
+}
+
+void TCLogShipperCancel(TCLogShipper *shipper)
+{
+	if (shipper != NULL)
+	{
+		(void)pthread_mutex_lock(&shipper->mutex);
+		shipper->stop = 1;
+		(void)pthread_cond_broadcast(&shipper->readyCond);
+		(void)pthread_cond_broadcast(&shipper->spaceCond);
+		(void)pthread_mutex_unlock(&shipper->mutex);
+	}
+}
+
+void TCLogShipperStop(TCLogShipper *shipper)
+{
+	unsigned int i;
+
+	if (shipper != NULL)
+	{
+		TCLogShipperCancel(shipper);
+
+		if (pthread_equal(shipper->thread, pthread_self()) == 0)
+		{
+			(void)pthread_join(shipper->thread, NULL);
+		}
+
+		if (shipper->dropped > 0UL)
+		{
+			fprintf(stderr, "%s: %s dropped %lu lines, shipped %lu lines in %lu packets\n", __func__,
+					shipper->address.sun_path, shipper->dropped, shipper->lines, shipper->packets);
+		}
+
+		if (shipper->fd >= 0)
+		{
+			close(shipper->fd);
+		}
+		for (i = 0; shipper->batches != NULL && i < shipper->count; i++)
+		{
+			free(shipper->batches[i].data);
+		}
+		free(shipper->batches);
+		(void)pthread_cond_destroy(&shipper->spaceCond);
+		(void)pthread_cond_destroy(&shipper->readyCond);
+		(void)pthread_mutex_destroy(&shipper->mutex);
+		free(shipper);
+	}
+}
+
+static void *ShipperThread(void *arg)
+{
+	TCLogShipper *shipper = (TCLogShipper *)arg;
+	struct timespec ts;
+	ShipBatch *batch;
+	int sent;
+
+	(void)pthread_mutex_lock(&shipper->mutex);
+	for (;;)
+	{
+		batch = &shipper->batches[shipper->head];
+		while (shipper->sealed == 0)
+		{
+			// a partly filled batch leaves once it is older than the flush interval or on stop
+			if (batch->used > 0U && (shipper->stop != 0 || GetMonotonicMs() - shipper->openedMs >= FLUSH_INTERVAL_MS))
+			{
+				shipper->sealed = 1;
+			}
+			else if (shipper->stop != 0)
+			{
+				break;
+			}
+			else
+			{
+				GetTimeout(&ts, FLUSH_INTERVAL_MS);
+				(void)pthread_cond_timedwait(&shipper->readyCond, &shipper->mutex, &ts);
+			}
+		}
+
+		if (shipper->sealed == 0)
+		{
+			break;
+		}
+
+		(void)pthread_mutex_unlock(&shipper->mutex);
+		sent = SendBatch(shipper, batch);
+		(void)pthread_mutex_lock(&shipper->mutex);
+
+		if (sent != 0)
+		{
+			shipper->packets++;
+			shipper->lines += batch->lines;
+		}
+		else
+		{
+			shipper->dropped += batch->lines;
+		}
+		batch->used = 0;
+		batch->lines = 0;
+		shipper->head = (shipper->head + 1U) % shipper->count;
+		shipper->sealed--;
+		(void)pthread_cond_broadcast(&shipper->spaceCond);
+	}
+	(void)pthread_mutex_unlock(&shipper->mutex);
+
+	return NULL;
+}
+
+static int SendBatch(TCLogShipper *shipper, const ShipBatch *batch)
+{
+	long backoff = MIN_RECONNECT_MS;
+	ssize_t ret;
+
+	for (;;)
+	{
+		if (shipper->fd < 0 && SetReachable(shipper, Connect(shipper)) == 0)
+		{
+			struct timespec ts;
+
+			// while the collector is away the queue fills and further lines are dropped
+			if (IsStopping(shipper) != 0)
+			{
+				return 0;
+			}
+			ts.tv_sec = backoff / 1000;
+			ts.tv_nsec = (backoff % 1000) * 1000000L;
+			(void)nanosleep(&ts, NULL);
+			backoff = (backoff * 2 < MAX_RECONNECT_MS) ? backoff * 2 : MAX_RECONNECT_MS;
+			continue;
+		}
+
+		// one packet per batch, the collector never sees half a batch
+		ret = send(shipper->fd, batch->data, batch->used, MSG_NOSIGNAL);
+		if (ret == (ssize_t)batch->used)
+		{
+			return 1;
+		}
+		if (ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		close(shipper->fd);
+		shipper->fd = -1;
+	}
+}
+
+static int Connect(TCLogShipper *shipper)
+{
+	int sendBuffer = 4 * SHIP_BATCH_SIZE;
+
+	shipper->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (shipper->fd >= 0)
+	{
+		(void)setsockopt(shipper->fd, SOL_SOCKET, SO_SNDBUF, &sendBuffer, sizeof(sendBuffer));
+		if (connect(shipper->fd, (const struct sockaddr *)&shipper->address, shipper->addressLength) != 0)
+		{
+			close(shipper->fd);
+			shipper->fd = -1;
+		}
+	}
+
+	return (shipper->fd >= 0) ? 1 : 0;
+}
+
+static int SetReachable(TCLogShipper *shipper, int reachable)
+{
+	(void)pthread_mutex_lock(&shipper->mutex);
+	shipper->unreachable = (reachable == 0) ? 1 : 0;
+	if (reachable == 0)
+	{
+		(void)pthread_cond_broadcast(&shipper->spaceCond);
+	}
+	(void)pthread_mutex_unlock(&shipper->mutex);
+
+	return reachable;
+}
+
+static int IsStopping(TCLogShipper *shipper)
+{
+	int stop;
+
+	(void)pthread_mutex_lock(&shipper->mutex);
+	stop = shipper->stop;
+	(void)pthread_mutex_unlock(&shipper->mutex);
+
+	return stop;
+}
+
+static void GetTimeout(struct timespec *ts, long msec)
+{
+	(void)clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += msec / 1000;
+	ts->tv_nsec += (msec % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+static long GetMonotonicMs(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+	return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,389 @@
+/****************************************************************************************
+ *   FileName    : TCLogSink.c
+ *   Description : extra TCLog outputs, each line is formatted once and handed to every sink
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define MAX_SINKS			16
+#define SINK_DISABLED		-1
+#define SYSLOG_FACILITY		1	// LOG_USER
+
+typedef enum {
+	SinkFree,
+	SinkStream,
+	SinkDatagram,
+	SinkCallback,
+	SinkShip
+} SinkType;
+
+typedef struct {
+	SinkType type;
+	int level;
+	FILE *fp;
+	int fd;
+	struct sockaddr_un address;
+	socklen_t addressLength;
+	TCLogSinkCallback callback;
+	void *context;
+	TCLogShipper *shipper;
+	unsigned long dropped;
+} Sink;
+
+static int AddSink(const Sink *sink);
+static int SendDatagram(Sink *sink, TCLogLevel level, const char *text, unsigned int length);
+static void RemoveShippingSinks(void);
+
+static pthread_rwlock_t g_sinkLock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t g_removeMutex = PTHREAD_MUTEX_INITIALIZER;
+static Sink g_sinks[MAX_SINKS];
+static int g_sinkCount = 0;
+static int g_primaryLevel = TCLogLevelDebug;
+static const int g_syslogSeverities[TotalTCLogLevels] = { 3, 4, 6, 7 };
+
+int TCLogAddStreamSink(FILE *fp, int level)
+{
+	Sink sink;
+
+	if (fp == NULL)
+	{
+		fprintf(stderr, "%s: invalid stream\n", __func__);
+		return -1;
+	}
+
+	memset(&sink, 0x00, sizeof(sink));
+	sink.type = SinkStream;
+	sink.level = level;
+	sink.fp = fp;
+	sink.fd = -1;
+
+	return AddSink(&sink);
+}
+
+int TCLogAddDatagramSink(const char *path, int level)
+{
+	Sink sink;
+	int id = -1;
+
+	if (path == NULL || strlen(path) >= sizeof(sink.address.sun_path))
+	{
+		fprintf(stderr, "%s: invalid socket path\n", __func__);
+		return id;
+	}
+
+	memset(&sink, 0x00, sizeof(sink));
+	sink.type = SinkDatagram;
+	sink.level = level;
+	sink.address.sun_family = AF_UNIX;
+	(void)strcpy(sink.address.sun_path, path);
+	sink.addressLength = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + strlen(path) + 1);
+	sink.fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (sink.fd >= 0)
+	{
+		id = AddSink(&sink);
+		if (id < 0)
+		{
+			close(sink.fd);
+		}
+	}
+	else
+	{
+		fprintf(stderr, "%s: socket failed, %s\n", __func__, strerror(errno));
+	}
+
+	return id;
+}
+
+int TCLogAddCallbackSink(TCLogSinkCallback callback, void *context, int level)
+{
+	Sink sink;
+
+	if (callback == NULL)
+	{
+		fprintf(stderr, "%s: invalid callback\n", __func__);
+		return -1;
+	}
+
+	memset(&sink, 0x00, sizeof(sink));
+	sink.type = SinkCallback;
+	sink.level = level;
+	sink.fd = -1;
+	sink.callback = callback;
+	sink.context = context;
+
+	return AddSink(&sink);
+}
+
+int TCLogAddShippingSink(const char *path, int level, unsigned int queueBytes, TCLogAsyncPolicy policy)
+{
+	static int registered = 0;
+	Sink sink;
+	int id = -1;
+
+	memset(&sink, 0x00, sizeof(sink));
+	sink.type = SinkShip;
+	sink.level = level;
+	sink.fd = -1;
+	if (level >= SINK_DISABLED && level < TotalTCLogLevels)
+	{
+		sink.shipper = TCLogShipperStart(path, queueBytes, policy);
+	}
+
+	if (sink.shipper != NULL)
+	{
+		id = AddSink(&sink);
+		if (id < 0)
+		{
+			TCLogShipperStop(sink.shipper);
+		}
+		else if (registered == 0 && atexit(RemoveShippingSinks) == 0)
+		{
+			// queued batches still reach the collector on a normal exit
+			registered = 1;
+		}
+	}
+	else
+	{
+		fprintf(stderr, "%s: invalid level or shipping start failed\n", __func__);
+	}
+
+	return id;
+}
+
+int TCLogSetSinkLevel(int sink, int level)
+{
+	int ret = 0;
+
+	if (level < SINK_DISABLED || level >= TotalTCLogLevels)
+	{
+		fprintf(stderr, "%s: invalid level %d\n", __func__, level);
+	}
+	else if (sink == TC_LOG_PRIMARY_SINK)
+	{
+		__atomic_store_n(&g_primaryLevel, level, __ATOMIC_RELAXED);
+		ret = 1;
+	}
+	else
+	{
+		if (sink > 0 && sink <= MAX_SINKS)
+		{
+			(void)pthread_rwlock_wrlock(&g_sinkLock);
+			if (g_sinks[sink - 1].type != SinkFree)
+			{
+				g_sinks[sink - 1].level = level;
+				ret = 1;
+			}
+			(void)pthread_rwlock_unlock(&g_sinkLock);
+		}
+
+		if (ret == 0)
+		{
+			fprintf(stderr, "%s: unknown sink %d\n", __func__, sink);
+		}
+	}
+
+	return ret;
+}
+
+int TCLogRemoveSink(int sink)
+{
+	TCLogShipper *shipper;
+	int ret = 0;
+
+	if (sink > 0 && sink <= MAX_SINKS)
+	{
+		// a push blocked on a full shipping queue holds the read lock, stop it before asking for the write lock
+		(void)pthread_mutex_lock(&g_removeMutex);
+		(void)pthread_rwlock_rdlock(&g_sinkLock);
+		shipper = g_sinks[sink - 1].shipper;
+		(void)pthread_rwlock_unlock(&g_sinkLock);
+		TCLogShipperCancel(shipper);
+
+		(void)pthread_rwlock_wrlock(&g_sinkLock);
+		if (g_sinks[sink - 1].type != SinkFree)
+		{
+			if (g_sinks[sink - 1].type == SinkStream)
+			{
+				fflush(g_sinks[sink - 1].fp);
+			}
+			if (g_sinks[sink - 1].fd >= 0)
+			{
+				close(g_sinks[sink - 1].fd);
+			}
+			TCLogShipperStop(g_sinks[sink - 1].shipper);
+			if (g_sinks[sink - 1].dropped > 0UL)
+			{
+				fprintf(stderr, "%s: sink %d dropped %lu lines\n", __func__, sink, g_sinks[sink - 1].dropped);
+			}
+			memset(&g_sinks[sink - 1], 0x00, sizeof(Sink));
+			__atomic_store_n(&g_sinkCount, g_sinkCount - 1, __ATOMIC_RELAXED);
+			ret = 1;
+		}
+		(void)pthread_rwlock_unlock(&g_sinkLock);
+		(void)pthread_mutex_unlock(&g_removeMutex);
+	}
+
+	return ret;
+}
+
+int TCLogSinkPrimaryEnabled(TCLogLevel level)
+{
+	return ((int)level <= __atomic_load_n(&g_primaryLevel, __ATOMIC_RELAXED)) ? 1 : 0;
+}
+
+int TCLogSinkDispatch(TCLogLevel level, const char *text, unsigned int length)
+{
+	int handed = 0;
+	int i;
+
+	if (__atomic_load_n(&g_sinkCount, __ATOMIC_RELAXED) > 0)
+	{
+		(void)pthread_rwlock_rdlock(&g_sinkLock);
+		for (i = 0; i < MAX_SINKS; i++)
+		{
+			Sink *sink = &g_sinks[i];
+
+			if (sink->type == SinkFree || (int)level > sink->level)
+			{
+				continue;
+			}
+
+			// every sink reads the caller's line, nothing is formatted or copied again
+			switch (sink->type)
+			{
+				case SinkStream:
+					if (fwrite(text, 1, length, sink->fp) == length)
+					{
+						handed++;
+					}
+					fflush(sink->fp);
+					break;
+				case SinkDatagram:
+					handed += SendDatagram(sink, level, text, length);
+					break;
+				case SinkCallback:
+					sink->callback(sink->context, level, text, length);
+					handed++;
+					break;
+				case SinkShip:
+					handed += TCLogShipperPush(sink->shipper, text, length);
+					break;
+				default:
+					break;
+			}
+		}
+		(void)pthread_rwlock_unlock(&g_sinkLock);
+	}
+
+	return handed;
+}
+
+static int AddSink(const Sink *sink)
+{
+	int id = -1;
+	int i;
+
+	if (sink->level < SINK_DISABLED || sink->level >= TotalTCLogLevels)
+	{
+		fprintf(stderr, "%s: invalid level %d\n", __func__, sink->level);
+		return id;
+	}
+
+	(void)pthread_rwlock_wrlock(&g_sinkLock);
+	for (i = 0; i < MAX_SINKS && id < 0; i++)
+	{
+		if (g_sinks[i].type == SinkFree)
+		{
+			g_sinks[i] = *sink;
+			__atomic_store_n(&g_sinkCount, g_sinkCount + 1, __ATOMIC_RELAXED);
+			id = i + 1;
+		}
+	}
+	(void)pthread_rwlock_unlock(&g_sinkLock);
+
+	if (id < 0)
+	{
+		fprintf(stderr, "%s: no more than %d sinks\n", __func__, MAX_SINKS);
+	}
+
+	return id;
+}
+
+static void RemoveShippingSinks(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_SINKS; i++)
+	{
+		if (g_sinks[i].type == SinkShip)
+		{
+			(void)TCLogRemoveSink(i + 1);
+		}
+	}
+}
+
+static int SendDatagram(Sink *sink, TCLogLevel level, const char *text, unsigned int length)
+{
+	char priority[8];
+	struct iovec iov[2];
+	struct msghdr msg;
+	int ret;
+
+	// syslog framing, journald and syslogd take the priority from the leading <N>
+	iov[0].iov_base = priority;
+	iov[0].iov_len = (size_t)snprintf(priority, sizeof(priority), "<%d>",
+									  SYSLOG_FACILITY * 8 + g_syslogSeverities[level]);
+	iov[1].iov_base = (void *)text;
+	iov[1].iov_len = length;
+
+	memset(&msg, 0x00, sizeof(msg));
+	msg.msg_name = &sink->address;
+	msg.msg_namelen = sink->addressLength;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	// a stalled reader must not hold up the logging thread
+	do
+	{
+		ret = (int)sendmsg(sink->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0)
+	{
+		__atomic_add_fetch(&sink->dropped, 1UL, __ATOMIC_RELAXED);
+	}
+
+	return (ret >= 0) ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+/****************************************************************************************
+ *   FileName    : TCLogStats.c
+ *   Description : Logging statistics and self instrumentation counters
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <time.h>
+#include <pthread.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+static unsigned int BucketOf(unsigned long long nsec);
+static unsigned long long GetMonotonicNs(void);
+
+// one line of counters is shared by every logging thread, keep it off the neighbours' lines
+static TCLogStats g_stats __attribute__((aligned(64)));
+static int g_timing = 0;
+
+void TCLogGetStats(TCLogStats *stats)
+{
+	const unsigned long *counters = (const unsigned long *)&g_stats;
+	unsigned long *snapshot = (unsigned long *)stats;
+	size_t i;
+
+	// TCLogStats only holds unsigned long counters, each one is read on its own
+	for (i = 0; i < sizeof(TCLogStats) / sizeof(unsigned long); i++)
+	{
+		snapshot[i] = __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+	}
+}
+
+void TCLogResetStats(void)
+{
+	unsigned long *counters = (unsigned long *)&g_stats;
+	size_t i;
+
+	for (i = 0; i < sizeof(TCLogStats) / sizeof(unsigned long); i++)
+	{
+		__atomic_store_n(&counters[i], 0UL, __ATOMIC_RELAXED);
+	}
+}
+
+void TCLogSetStatsTiming(int enable)
+{
+	__atomic_store_n(&g_timing, (enable != 0) ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+void TCLogStatsLine(TCLogLevel level, unsigned int length, int written)
+{
+	__atomic_add_fetch(&g_stats.lines[level], 1UL, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&g_stats.bytes[level], (unsigned long)length, __ATOMIC_RELAXED);
+	if (written == 0)
+	{
+		__atomic_add_fetch(&g_stats.dropped[level], 1UL, __ATOMIC_RELAXED);
+	}
+}
+
+void TCLogStatsSuppressed(TCLogLevel level)
+{
+	__atomic_add_fetch(&g_stats.suppressed[level], 1UL, __ATOMIC_RELAXED);
+}
+
+void TCLogStatsRotation(void)
+{
+	__atomic_add_fetch(&g_stats.rotations, 1UL, __ATOMIC_RELAXED);
+}
+
+void TCLogStatsRefused(void)
+{
+	__atomic_add_fetch(&g_stats.refused, 1UL, __ATOMIC_RELAXED);
+}
+
+unsigned long long TCLogStatsStart(void)
+{
+	return (__atomic_load_n(&g_timing, __ATOMIC_RELAXED) != 0) ? GetMonotonicNs() : 0ULL;
+}
+
+void TCLogStatsCall(unsigned long long start)
+{
+	if (start != 0ULL)
+	{
+		__atomic_add_fetch(&g_stats.callLatency[BucketOf(GetMonotonicNs() - start)], 1UL, __ATOMIC_RELAXED);
+	}
+}
+
+void TCLogStatsLock(pthread_mutex_t *mutex)
+{
+	unsigned long long start;
+
+	// the clock is only read when the lock is actually contended
+	if (pthread_mutex_trylock(mutex) == 0)
+	{
+		__atomic_add_fetch(&g_stats.lockWait[0], 1UL, __ATOMIC_RELAXED);
+	}
+	else
+	{
+		start = GetMonotonicNs();
+		(void)pthread_mutex_lock(mutex);
+		__atomic_add_fetch(&g_stats.lockWait[BucketOf(GetMonotonicNs() - start)], 1UL, __ATOMIC_RELAXED);
+	}
+}
+
+static unsigned int BucketOf(unsigned long long nsec)
+{
+	unsigned int bucket = (nsec > 1ULL) ? 63U - (unsigned int)__builtin_clzll(nsec) : 0U;
+
+	return (bucket < TC_LOG_STATS_BUCKETS) ? bucket : TC_LOG_STATS_BUCKETS - 1;
+}
+
+static unsigned long long GetMonotonicNs(void)
+{
+	struct timespec now;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
@@ -0,0 +1,305 @@
+/****************************************************************************************
+ *   FileName    : TCLogStorm.c
+ *   Description : Rate limiting and duplicate collapsing of TCLog messages
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define MAX_RATE_SITES			256		// power of two
+#define RATE_SITE_WAYS			4		// sites sharing a set by format pointer
+#define RATE_SITE_SETS			(MAX_RATE_SITES / RATE_SITE_WAYS)
+#define TOKEN_SCALE				1000ULL
+#define FNV_OFFSET				14695981039346656037ULL
+#define FNV_PRIME				1099511628211ULL
+
+typedef struct {
+	const char *format;
+	unsigned long long tokens;		// scaled by TOKEN_SCALE
+	unsigned long long refillMs;
+	unsigned int suppressed;
+} RateSite;
+
+typedef struct {
+	uint64_t hash;
+	unsigned int length;
+	unsigned int repeats;
+	unsigned long long windowMs;
+	TCLogLevel level;
+	const char *tag;
+} LastMessage;
+
+static RateSite *FindRateSite(const char *format, unsigned long long now, unsigned long long burst, unsigned int *evicted);
+static unsigned long long GetMonotonicMs(void);
+static void ReportPending(void);
+
+static RateSite g_rateSites[MAX_RATE_SITES];
+static RateSite g_overflowSite;		// shared by the call sites of a set full of busy ones
+static unsigned int g_rateBurst = 0;
+static unsigned int g_ratePerSecond = 0;
+static int g_rateEnabled = 0;
+static LastMessage g_lastMessage;
+static unsigned int g_collapseWindowMs = 0;
+static int g_collapseEnabled = 0;
+static int g_exitHandler = 0;
+static pthread_mutex_t g_stormMutex = PTHREAD_MUTEX_INITIALIZER;
+
+int TCLogSetRateLimit(unsigned int burst, unsigned int perSecond)
+{
+	ReportPending();
+
+	(void)pthread_mutex_lock(&g_stormMutex);
+	memset(g_rateSites, 0x00, sizeof(g_rateSites));
+	memset(&g_overflowSite, 0x00, sizeof(g_overflowSite));
+	g_overflowSite.tokens = (unsigned long long)burst * TOKEN_SCALE;
+	g_rateBurst = burst;
+	g_ratePerSecond = perSecond;
+	__atomic_store_n(&g_rateEnabled, (burst != 0U) ? 1 : 0, __ATOMIC_RELEASE);
+	if (burst != 0U && g_exitHandler == 0)
+	{
+		g_exitHandler = (atexit(ReportPending) == 0) ? 1 : 0;
+	}
+	(void)pthread_mutex_unlock(&g_stormMutex);
+
+	return 1;
+}
+
+int TCLogSetDuplicateCollapse(unsigned int windowSec)
+{
+	ReportPending();
+
+	(void)pthread_mutex_lock(&g_stormMutex);
+	memset(&g_lastMessage, 0x00, sizeof(g_lastMessage));
+	g_collapseWindowMs = windowSec * 1000U;
+	__atomic_store_n(&g_collapseEnabled, (windowSec != 0U) ? 1 : 0, __ATOMIC_RELEASE);
+	if (windowSec != 0U && g_exitHandler == 0)
+	{
+		g_exitHandler = (atexit(ReportPending) == 0) ? 1 : 0;
+	}
+	(void)pthread_mutex_unlock(&g_stormMutex);
+
+	return 1;
+}
+
+int TCLogStormAdmit(const char *format, unsigned int *suppressed)
+{
+	int admit = 1;
+
+	*suppressed = 0;
+
+	if (__atomic_load_n(&g_rateEnabled, __ATOMIC_ACQUIRE) != 0)
+	{
+		unsigned long long now = GetMonotonicMs();
+		unsigned long long burst;
+		unsigned int pending = 0;
+		RateSite *site;
+		TCLogTime logTime;
+
+		(void)pthread_mutex_lock(&g_stormMutex);
+		burst = (unsigned long long)g_rateBurst * TOKEN_SCALE;
+		site = FindRateSite(format, now, burst, &pending);
+		site->tokens += (now - site->refillMs) * g_ratePerSecond;
+		site->refillMs = now;
+		if (site->tokens > burst)
+		{
+			site->tokens = burst;
+		}
+
+		if (site->tokens >= TOKEN_SCALE)
+		{
+			site->tokens -= TOKEN_SCALE;
+			if (site == &g_overflowSite)
+			{
+				pending += site->suppressed;
+			}
+			else
+			{
+				*suppressed = site->suppressed;
+			}
+			site->suppressed = 0;
+		}
+		else
+		{
+			site->suppressed++;
+			admit = 0;
+		}
+		(void)pthread_mutex_unlock(&g_stormMutex);
+
+		// counts that no longer belong to one call site
+		if (pending > 0U)
+		{
+			TCLogThreadBufferGetTime(&logTime);
+			(void)TCLogNote(TCLogLevelWarn, &logTime, NULL, "%u messages suppressed by rate limit\n", pending);
+			TCLogThreadBufferDone();
+		}
+	}
+
+	return admit;
+}
+
+int TCLogStormCollapse(TCLogLevel level, const TCLogTime *logTime, const char *tag,
+					   const char *message, unsigned int length)
+{
+	int emit = 1;
+
+	if (__atomic_load_n(&g_collapseEnabled, __ATOMIC_ACQUIRE) != 0)
+	{
+		unsigned long long now = GetMonotonicMs();
+		uint64_t hash = FNV_OFFSET;
+		LastMessage repeated;
+		unsigned int i;
+
+		for (i = 0; i < length; i++)
+		{
+			hash = (hash ^ (unsigned char)message[i]) * FNV_PRIME;
+		}
+
+		repeated.repeats = 0;
+
+		(void)pthread_mutex_lock(&g_stormMutex);
+		if (g_lastMessage.hash == hash && g_lastMessage.length == length)
+		{
+			g_lastMessage.repeats++;
+			emit = 0;
+			if (now - g_lastMessage.windowMs >= g_collapseWindowMs)
+			{
+				// a storm that never ends still reports once per window
+				repeated = g_lastMessage;
+				g_lastMessage.repeats = 0;
+				g_lastMessage.windowMs = now;
+			}
+		}
+		else
+		{
+			repeated = g_lastMessage;
+			g_lastMessage.hash = hash;
+			g_lastMessage.length = length;
+			g_lastMessage.repeats = 0;
+			g_lastMessage.windowMs = now;
+			g_lastMessage.level = level;
+			g_lastMessage.tag = tag;
+		}
+		(void)pthread_mutex_unlock(&g_stormMutex);
+
+		if (repeated.repeats > 0U)
+		{
+			(void)TCLogNote(repeated.level, logTime, repeated.tag,
+							"last message repeated %u times\n", repeated.repeats);
+		}
+	}
+
+	return emit;
+}
+
+static RateSite *FindRateSite(const char *format, unsigned long long now, unsigned long long burst, unsigned int *evicted)
+{
+	RateSite *set = &g_rateSites[(((uintptr_t)format >> 3) & (RATE_SITE_SETS - 1)) * RATE_SITE_WAYS];
+	RateSite *victim = NULL;
+	int i;
+
+	for (i = 0; i < RATE_SITE_WAYS; i++)
+	{
+		if (set[i].format == format)
+		{
+			return &set[i];
+		}
+		if (set[i].format == NULL)
+		{
+			victim = &set[i];
+			break;
+		}
+
+		// only a site whose bucket has refilled is idle, a storming one keeps its slot
+		if (set[i].tokens + (now - set[i].refillMs) * g_ratePerSecond >= burst &&
+			(victim == NULL || set[i].refillMs < victim->refillMs))
+		{
+			victim = &set[i];
+		}
+	}
+
+	if (victim == NULL)
+	{
+		return &g_overflowSite;
+	}
+
+	*evicted += victim->suppressed;
+	victim->format = format;
+	victim->tokens = burst;
+	victim->refillMs = now;
+	victim->suppressed = 0;
+
+	return victim;
+}
+
+static unsigned long long GetMonotonicMs(void)
+{
+	struct timespec now;
+
+	(void)clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+	return (unsigned long long)now.tv_sec * 1000ULL + (unsigned long long)now.tv_nsec / 1000000ULL;
+}
+
+// a storm still going on at exit or reconfiguration would otherwise go unreported
+static void ReportPending(void)
+{
+	LastMessage repeated;
+	unsigned int suppressed = 0;
+	TCLogTime logTime;
+	int i;
+
+	(void)pthread_mutex_lock(&g_stormMutex);
+	repeated = g_lastMessage;
+	g_lastMessage.repeats = 0;
+	for (i = 0; i < MAX_RATE_SITES; i++)
+	{
+		suppressed += g_rateSites[i].suppressed;
+		g_rateSites[i].suppressed = 0;
+	}
+	suppressed += g_overflowSite.suppressed;
+	g_overflowSite.suppressed = 0;
+	(void)pthread_mutex_unlock(&g_stormMutex);
+
+	if (repeated.repeats > 0U || suppressed > 0U)
+	{
+		TCLogThreadBufferGetTime(&logTime);
+		if (repeated.repeats > 0U)
+		{
+			(void)TCLogNote(repeated.level, &logTime, repeated.tag,
+							"last message repeated %u times\n", repeated.repeats);
+		}
+		if (suppressed > 0U)
+		{
+			(void)TCLogNote(TCLogLevelWarn, &logTime, NULL,
+							"%u messages suppressed by rate limit\n", suppressed);
+		}
+		TCLogThreadBufferDone();
+	}
+}
@@ -0,0 +1,450 @@
+/****************************************************************************************
+ *   FileName    : TCLogThreadBuffer.c
+ *   Description : Per-thread TCLog buffers merged by timestamp on flush
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define DEFAULT_BUFFER_SIZE			16384
+#define MIN_BUFFER_SIZE				(2 * TC_LOG_LINE_SIZE)
+#define DEFAULT_FLUSH_INTERVAL_MS	200
+#define ENTRY_ALIGN					8
+#define NO_LINE						(~0ULL)
+#define MAX_FLUSH_TRIES				64
+
+typedef struct {
+	unsigned long long stamp;	// printed timestamp in ms, merge key across threads
+	unsigned long long order;	// monotonic nanoseconds, breaks ties within a millisecond
+	TCLogTime time;
+	unsigned int length;
+} EntryHead;
+
+typedef struct ThreadBuffer {
+	pthread_mutex_t mutex;		// only contended while the buffer is being flushed
+	struct ThreadBuffer *next;
+	unsigned long long inFlight;	// stamp of the line being formatted, NO_LINE when idle
+	unsigned int size;
+	unsigned int used;
+	unsigned int cursor;
+	char *data;
+} ThreadBuffer;
+
+static ThreadBuffer *GetThreadBuffer(void);
+static void ReleaseThreadBuffer(void *arg);
+static void FlushAll(int force, const EntryHead *extra, const char *extraText, ThreadBuffer *remove);
+static void *FlusherThread(void *arg);
+static unsigned long long GetOrder(void);
+static int IsOlder(const EntryHead *a, const EntryHead *b);
+static unsigned int EntrySize(unsigned int length);
+
+static ThreadBuffer *g_buffers = NULL;
+static pthread_mutex_t g_registryMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_bufferKey;
+static int g_keyCreated = 0;
+static int g_buffersEnabled = 0;
+static unsigned int g_bufferSize = DEFAULT_BUFFER_SIZE;
+static unsigned int g_flushIntervalMs = DEFAULT_FLUSH_INTERVAL_MS;
+static int g_flusherRun = 0;
+static int g_exitHandler = 0;
+static pthread_t g_flusherThread;
+static pthread_mutex_t g_flusherMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_flusherCond = PTHREAD_COND_INITIALIZER;
+
+int TCLogEnableThreadBuffers(unsigned int bufferSize, unsigned int flushIntervalMs)
+{
+	int enabled = 0;
+
+	(void)pthread_mutex_lock(&g_registryMutex);
+	if (TCLogMutex() == NULL)
+	{
+		fprintf(stderr, "%s: TCLogInitialize must be called first\n", __func__);
+	}
+	else if (g_buffersEnabled != 0)
+	{
+		fprintf(stderr, "%s: thread buffers already enabled\n", __func__);
+	}
+	else if (g_keyCreated == 0 && pthread_key_create(&g_bufferKey, ReleaseThreadBuffer) != 0)
+	{
+		fprintf(stderr, "%s: pthread_key_create failed\n", __func__);
+	}
+	else
+	{
+		g_keyCreated = 1;
+		g_bufferSize = (bufferSize == 0) ? DEFAULT_BUFFER_SIZE :
+					   (bufferSize < MIN_BUFFER_SIZE) ? MIN_BUFFER_SIZE : bufferSize;
+		g_flushIntervalMs = (flushIntervalMs != 0) ? flushIntervalMs : DEFAULT_FLUSH_INTERVAL_MS;
+		g_flusherRun = 1;
+
+		if (pthread_create(&g_flusherThread, NULL, FlusherThread, NULL) == 0)
+		{
+			__atomic_store_n(&g_buffersEnabled, 1, __ATOMIC_SEQ_CST);
+			enabled = 1;
+
+			// lines held back in the last flush interval are written on exit()
+			if (g_exitHandler == 0)
+			{
+				g_exitHandler = (atexit(TCLogDisableThreadBuffers) == 0) ? 1 : 0;
+			}
+		}
+		else
+		{
+			perror("create log flusher thread failed: ");
+			g_flusherRun = 0;
+		}
+	}
+	(void)pthread_mutex_unlock(&g_registryMutex);
+
+	return enabled;
+}
+
+void TCLogDisableThreadBuffers(void)
+{
+	if (__atomic_exchange_n(&g_buffersEnabled, 0, __ATOMIC_SEQ_CST) != 0)
+	{
+		(void)pthread_mutex_lock(&g_flusherMutex);
+		g_flusherRun = 0;
+		(void)pthread_cond_signal(&g_flusherCond);
+		(void)pthread_mutex_unlock(&g_flusherMutex);
+		(void)pthread_join(g_flusherThread, NULL);
+
+		FlushAll(1, NULL, NULL, NULL);
+	}
+}
+
+void TCLogFlushThreadBuffers(void)
+{
+	FlushAll(1, NULL, NULL, NULL);
+}
+
+int TCLogThreadBuffersEnabled(void)
+{
+	return __atomic_load_n(&g_buffersEnabled, __ATOMIC_RELAXED);
+}
+
+void TCLogThreadBufferGetTime(TCLogTime *logTime)
+{
+	ThreadBuffer *buffer = NULL;
+
+	if (__atomic_load_n(&g_buffersEnabled, __ATOMIC_RELAXED) != 0)
+	{
+		buffer = GetThreadBuffer();
+	}
+
+	if (buffer != NULL)
+	{
+		// hold back flushes until the real stamp is known, it can not be older than this point
+		__atomic_store_n(&buffer->inFlight, 0ULL, __ATOMIC_SEQ_CST);
+		TCLogGetTime(logTime);
+		__atomic_store_n(&buffer->inFlight,
+						 (unsigned long long)logTime->stampSec * 1000ULL + (unsigned long long)logTime->stampMs,
+						 __ATOMIC_SEQ_CST);
+	}
+	else
+	{
+		TCLogGetTime(logTime);
+	}
+}
+
+void TCLogThreadBufferDone(void)
+{
+	ThreadBuffer *buffer;
+
+	if (g_keyCreated != 0)
+	{
+		buffer = (ThreadBuffer *)pthread_getspecific(g_bufferKey);
+		if (buffer != NULL)
+		{
+			__atomic_store_n(&buffer->inFlight, NO_LINE, __ATOMIC_SEQ_CST);
+		}
+	}
+}
+
+int TCLogThreadBufferPush(TCLogLevel level, const TCLogTime *logTime, const char *text, unsigned int length)
+{
+	int queued = -1;
+
+	if (__atomic_load_n(&g_buffersEnabled, __ATOMIC_RELAXED) != 0)
+	{
+		ThreadBuffer *buffer = GetThreadBuffer();
+		EntryHead head;
+
+		head.stamp = (unsigned long long)logTime->stampSec * 1000ULL + (unsigned long long)logTime->stampMs;
+		head.order = GetOrder();
+		head.time = *logTime;
+		head.length = length;
+
+		if (buffer != NULL && EntrySize(length) <= buffer->size)
+		{
+			(void)pthread_mutex_lock(&buffer->mutex);
+			if (__atomic_load_n(&g_buffersEnabled, __ATOMIC_RELAXED) != 0)
+			{
+				int tries;
+
+				// a flush keeps lines newer than one another thread is still formatting,
+				// give that thread a chance to finish before writing out of order
+				for (tries = 0; tries < MAX_FLUSH_TRIES && buffer->used + EntrySize(length) > buffer->size; tries++)
+				{
+					(void)pthread_mutex_unlock(&buffer->mutex);
+					if (tries > 0)
+					{
+						(void)sched_yield();
+					}
+					FlushAll(0, NULL, NULL, NULL);
+					(void)pthread_mutex_lock(&buffer->mutex);
+				}
+
+				if (buffer->used + EntrySize(length) <= buffer->size)
+				{
+					memcpy(buffer->data + buffer->used, &head, sizeof(head));
+					memcpy(buffer->data + buffer->used + sizeof(head), text, length);
+					buffer->used += EntrySize(length);
+					queued = 1;
+				}
+			}
+			(void)pthread_mutex_unlock(&buffer->mutex);
+		}
+
+		if (queued < 0 && __atomic_load_n(&g_buffersEnabled, __ATOMIC_RELAXED) != 0)
+		{
+			// does not fit into a buffer, write it in order with everything buffered so far
+			FlushAll(1, &head, text, NULL);
+			queued = 1;
+		}
+		else if (queued > 0 && level == TCLogLevelError)
+		{
+			FlushAll(0, NULL, NULL, NULL);
+		}
+	}
+
+	return queued;
+}
+
+static ThreadBuffer *GetThreadBuffer(void)
+{
+	ThreadBuffer *buffer = (ThreadBuffer *)pthread_getspecific(g_bufferKey);
+
+	if (buffer == NULL)
+	{
+		buffer = (ThreadBuffer *)calloc(1, sizeof(ThreadBuffer));
+		if (buffer != NULL)
+		{
+			buffer->size = g_bufferSize;
+			buffer->inFlight = NO_LINE;
+			buffer->data = (char *)malloc(buffer->size);
+			if (buffer->data != NULL && pthread_mutex_init(&buffer->mutex, NULL) == 0)
+			{
+				(void)pthread_setspecific(g_bufferKey, buffer);
+
+				(void)pthread_mutex_lock(&g_registryMutex);
+				buffer->next = g_buffers;
+				g_buffers = buffer;
+				(void)pthread_mutex_unlock(&g_registryMutex);
+			}
+			else
+			{
+				free(buffer->data);
+				free(buffer);
+				buffer = NULL;
+			}
+		}
+	}
+
+	return buffer;
+}
+
+static void ReleaseThreadBuffer(void *arg)
+{
+	ThreadBuffer *buffer = (ThreadBuffer *)arg;
+	unsigned int used = 1;
+	int tries;
+
+	// write out what the exiting thread left behind, then forget the buffer
+	for (tries = 0; tries < MAX_FLUSH_TRIES && used != 0; tries++)
+	{
+		if (tries > 0)
+		{
+			(void)sched_yield();
+		}
+		FlushAll(0, NULL, NULL, NULL);
+
+		(void)pthread_mutex_lock(&buffer->mutex);
+		used = buffer->used;
+		(void)pthread_mutex_unlock(&buffer->mutex);
+	}
+	FlushAll(1, NULL, NULL, buffer);
+
+	(void)pthread_mutex_destroy(&buffer->mutex);
+	free(buffer->data);
+	free(buffer);
+}
+
+static void FlushAll(int force, const EntryHead *extra, const char *extraText, ThreadBuffer *remove)
+{
+	pthread_mutex_t *logMutex = TCLogMutex();
+	ThreadBuffer **link;
+	ThreadBuffer *buffer;
+	unsigned long long watermark = NO_LINE;
+	int extraPending = (extra != NULL);
+	int written = 0;
+
+	(void)pthread_mutex_lock(&g_registryMutex);
+	for (buffer = g_buffers; buffer != NULL; buffer = buffer->next)
+	{
+		(void)pthread_mutex_lock(&buffer->mutex);
+		buffer->cursor = 0;
+	}
+
+	// lines newer than one still being formatted stay buffered for the next flush
+	for (buffer = g_buffers; buffer != NULL && force == 0; buffer = buffer->next)
+	{
+		unsigned long long inFlight = __atomic_load_n(&buffer->inFlight, __ATOMIC_SEQ_CST);
+		if (inFlight < watermark)
+		{
+			watermark = inFlight;
+		}
+	}
+
+	(void)pthread_mutex_lock(logMutex);
+	for (;;)
+	{
+		// every buffer is already in order, pick the oldest head among them
+		ThreadBuffer *oldest = NULL;
+		const EntryHead *oldestHead = extraPending ? extra : NULL;
+
+		for (buffer = g_buffers; buffer != NULL; buffer = buffer->next)
+		{
+			if (buffer->cursor < buffer->used)
+			{
+				const EntryHead *head = (const EntryHead *)(buffer->data + buffer->cursor);
+				if (oldestHead == NULL || IsOlder(head, oldestHead) != 0)
+				{
+					oldest = buffer;
+					oldestHead = head;
+				}
+			}
+		}
+
+		if (oldestHead == NULL || (oldest != NULL && oldestHead->stamp > watermark))
+		{
+			break;
+		}
+
+		if (oldest != NULL)
+		{
+			(void)TCLogWriteText(&oldestHead->time, (const char *)(oldestHead + 1), oldestHead->length);
+			oldest->cursor += EntrySize(oldestHead->length);
+		}
+		else
+		{
+			(void)TCLogWriteText(&extra->time, extraText, extra->length);
+			extraPending = 0;
+		}
+		written = 1;
+	}
+
+	if (written != 0)
+	{
+		TCLogFinishWrite();
+	}
+	(void)pthread_mutex_unlock(logMutex);
+
+	link = &g_buffers;
+	while (*link != NULL)
+	{
+		buffer = *link;
+		if (buffer->cursor < buffer->used)
+		{
+			memmove(buffer->data, buffer->data + buffer->cursor, buffer->used - buffer->cursor);
+		}
+		buffer->used -= buffer->cursor;
+		(void)pthread_mutex_unlock(&buffer->mutex);
+
+		if (buffer == remove)
+		{
+			*link = buffer->next;
+		}
+		else
+		{
+			link = &buffer->next;
+		}
+	}
+	(void)pthread_mutex_unlock(&g_registryMutex);
+}
+
+static void *FlusherThread(void *arg)
+{
+	(void)arg;
+
+	(void)pthread_mutex_lock(&g_flusherMutex);
+	while (g_flusherRun != 0)
+	{
+		struct timespec ts;
+
+		(void)clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += g_flushIntervalMs / 1000;
+		ts.tv_nsec += (long)(g_flushIntervalMs % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		(void)pthread_cond_timedwait(&g_flusherCond, &g_flusherMutex, &ts);
+
+		if (g_flusherRun != 0)
+		{
+			(void)pthread_mutex_unlock(&g_flusherMutex);
+			FlushAll(0, NULL, NULL, NULL);
+			(void)pthread_mutex_lock(&g_flusherMutex);
+		}
+	}
+	(void)pthread_mutex_unlock(&g_flusherMutex);
+
+	return NULL;
+}
+
+static unsigned long long GetOrder(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static int IsOlder(const EntryHead *a, const EntryHead *b)
+{
+	return (a->stamp < b->stamp || (a->stamp == b->stamp && a->order < b->order)) ? 1 : 0;
+}
+
+static unsigned int EntrySize(unsigned int length)
+{
+	return ((unsigned int)sizeof(EntryHead) + length + ENTRY_ALIGN - 1) & ~(unsigned int)(ENTRY_ALIGN - 1);
+}
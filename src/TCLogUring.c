@@ -0,0 +1,683 @@
+/****************************************************************************************
+ *   FileName    : TCLogUring.c
+ *   Description : io_uring based file output for TCLog
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#ifdef HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES				16
+#define URING_BUFFERS				8
+#define URING_BUFFER_SIZE			65536
+#define URING_FSYNC_TAG				0xFFFFFFFFULL
+#define DEFAULT_SYNC_INTERVAL_MS	1000
+
+typedef struct {
+	char *data;
+	unsigned int used;
+	unsigned int done;		// bytes the kernel confirmed, a short write resubmits the rest
+	long long offset;
+	int inFlight;
+} UringBuffer;
+
+static int SetupRing(void);
+static void ReleaseRing(void);
+static struct io_uring_sqe *GetSqe(void);
+static int Enter(unsigned int toSubmit, unsigned int minComplete);
+static void SubmitWrite(int index);
+static void SubmitSync(void);
+static void ReapCompletions(unsigned int minComplete);
+static void ReadCompletions(void);
+static void RollBack(void);
+static int InFlightCount(void);
+static void DrainOnExit(void *value);
+static void StartFlusher(void);
+static void StopFlusher(void);
+static void *FlusherThread(void *arg);
+static long GetMonotonicMs(void);
+
+static int g_ringFd = -1;
+static void *g_sqRing = NULL;
+static void *g_cqRing = NULL;
+static size_t g_sqRingSize = 0;
+static size_t g_cqRingSize = 0;
+static struct io_uring_sqe *g_sqes = NULL;
+static size_t g_sqesSize = 0;
+static unsigned int *g_sqHead;
+static unsigned int *g_sqTail;
+static unsigned int *g_sqMask;
+static unsigned int *g_sqArray;
+static unsigned int *g_cqHead;
+static unsigned int *g_cqTail;
+static unsigned int *g_cqMask;
+static struct io_uring_cqe *g_cqes;
+static int g_fixedBuffers = 0;
+static int g_syncInFlight = 0;
+static int g_available = -1;
+static UringBuffer g_buffers[URING_BUFFERS];
+static int g_current = 0;
+static int g_fd = -1;
+static long long g_offset = 0;
+static long long g_failedOffset = -1;	// end of the data before the first lost write, -1 when none
+static long g_lastSyncMs = 0;
+static int g_dirty = 0;
+static unsigned int g_syncIntervalMs = DEFAULT_SYNC_INTERVAL_MS;
+static pthread_key_t g_submitterKey;
+static int g_keyCreated = 0;
+static int g_flusherRun = 0;
+static pthread_t g_flusherThread;
+static pthread_mutex_t g_flusherMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_flusherCond = PTHREAD_COND_INITIALIZER;
+
+int TCLogUringAvailable(void)
+{
+	if (g_available < 0)
+	{
+		g_available = SetupRing();
+		if (g_available != 0)
+		{
+			StartFlusher();
+		}
+	}
+
+	return g_available;
+}
+
+int TCLogUringOpen(const char *path)
+{
+	struct stat st;
+
+	TCLogUringClose();
+
+	g_fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (g_fd >= 0 && fstat(g_fd, &st) == 0)
+	{
+		g_offset = (long long)st.st_size;
+	}
+	else
+	{
+		fprintf(stderr, "%s: open %s failed\n", __func__, path);
+		if (g_fd >= 0)
+		{
+			close(g_fd);
+			g_fd = -1;
+		}
+	}
+
+	return (g_fd >= 0) ? 1 : 0;
+}
+
+int TCLogUringIsOpen(void)
+{
+	return (g_fd >= 0) ? 1 : 0;
+}
+
+long TCLogUringFileBytes(void)
+{
+	return (long)g_offset + (long)g_buffers[g_current].used;
+}
+
+int TCLogUringWrite(const char *text, unsigned int length)
+{
+	int written = 0;
+
+	if (g_fd >= 0 && g_ringFd >= 0)
+	{
+		while (length > 0U)
+		{
+			UringBuffer *buffer = &g_buffers[g_current];
+			unsigned int room;
+
+			// all buffers in the kernel, wait for the oldest one
+			while (buffer->inFlight != 0)
+			{
+				ReapCompletions(1);
+			}
+
+			room = URING_BUFFER_SIZE - buffer->used;
+			if (room > length)
+			{
+				room = length;
+			}
+			memcpy(buffer->data + buffer->used, text, room);
+			buffer->used += room;
+			text += room;
+			length -= room;
+
+			if (buffer->used == URING_BUFFER_SIZE)
+			{
+				SubmitWrite(g_current);
+			}
+		}
+		written = 1;
+	}
+
+	return written;
+}
+
+void TCLogUringSubmit(int sync)
+{
+	if (g_fd >= 0 && g_ringFd >= 0)
+	{
+		long now;
+
+		ReapCompletions(0);
+
+		// while a write is in the kernel the following lines gather in the next buffer
+		if (g_buffers[g_current].used > 0U && (sync != 0 || InFlightCount() == 0))
+		{
+			SubmitWrite(g_current);
+		}
+
+		now = GetMonotonicMs();
+		if (sync != 0)
+		{
+			// a sync already in the kernel may have been queued before these writes
+			while (InFlightCount() > 0 || g_syncInFlight != 0)
+			{
+				ReapCompletions(1);
+			}
+			if (g_dirty != 0)
+			{
+				SubmitSync();
+				g_lastSyncMs = now;
+				while (g_syncInFlight != 0)
+				{
+					ReapCompletions(1);
+				}
+			}
+		}
+		else if (g_dirty != 0 && g_syncInFlight == 0 && now - g_lastSyncMs >= (long)g_syncIntervalMs)
+		{
+			SubmitSync();
+			g_lastSyncMs = now;
+		}
+	}
+}
+
+void TCLogUringSetSyncInterval(unsigned int msec)
+{
+	g_syncIntervalMs = (msec != 0U) ? msec : DEFAULT_SYNC_INTERVAL_MS;
+}
+
+void TCLogUringClose(void)
+{
+	if (g_fd >= 0)
+	{
+		TCLogUringSubmit(1);
+		close(g_fd);
+		g_fd = -1;
+	}
+	g_offset = 0;
+}
+
+void TCLogUringShutdown(void)
+{
+	TCLogUringClose();
+	if (g_available > 0)
+	{
+		StopFlusher();
+		ReleaseRing();
+		g_available = -1;
+	}
+}
+
+static int SetupRing(void)
+{
+	struct io_uring_params params;
+	struct iovec iov[URING_BUFFERS];
+	int i;
+
+	if (g_keyCreated == 0 && pthread_key_create(&g_submitterKey, DrainOnExit) != 0)
+	{
+		fprintf(stderr, "%s: pthread_key_create failed\n", __func__);
+		return 0;
+	}
+	g_keyCreated = 1;
+
+	memset(&params, 0x00, sizeof(params));
+	g_ringFd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+	if (g_ringFd < 0)
+	{
+		return 0;
+	}
+
+	g_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	g_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0U)
+	{
+		g_sqRingSize = (g_cqRingSize > g_sqRingSize) ? g_cqRingSize : g_sqRingSize;
+		g_cqRingSize = g_sqRingSize;
+	}
+
+	g_sqRing = mmap(NULL, g_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, g_ringFd, IORING_OFF_SQ_RING);
+	if (g_sqRing != MAP_FAILED)
+	{
+		g_cqRing = ((params.features & IORING_FEAT_SINGLE_MMAP) != 0U) ? g_sqRing :
+				   mmap(NULL, g_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, g_ringFd, IORING_OFF_CQ_RING);
+		g_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+		g_sqes = (struct io_uring_sqe *)mmap(NULL, g_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+											 g_ringFd, IORING_OFF_SQES);
+	}
+
+	if (g_sqRing == MAP_FAILED || g_cqRing == MAP_FAILED || g_sqes == (struct io_uring_sqe *)MAP_FAILED)
+	{
+		g_sqRing = (g_sqRing == MAP_FAILED) ? NULL : g_sqRing;
+		g_cqRing = (g_cqRing == MAP_FAILED) ? NULL : g_cqRing;
+		g_sqes = (g_sqes == (struct io_uring_sqe *)MAP_FAILED) ? NULL : g_sqes;
+		ReleaseRing();
+		return 0;
+	}
+
+	g_sqHead = (unsigned int *)((char *)g_sqRing + params.sq_off.head);
+	g_sqTail = (unsigned int *)((char *)g_sqRing + params.sq_off.tail);
+	g_sqMask = (unsigned int *)((char *)g_sqRing + params.sq_off.ring_mask);
+	g_sqArray = (unsigned int *)((char *)g_sqRing + params.sq_off.array);
+	g_cqHead = (unsigned int *)((char *)g_cqRing + params.cq_off.head);
+	g_cqTail = (unsigned int *)((char *)g_cqRing + params.cq_off.tail);
+	g_cqMask = (unsigned int *)((char *)g_cqRing + params.cq_off.ring_mask);
+	g_cqes = (struct io_uring_cqe *)((char *)g_cqRing + params.cq_off.cqes);
+
+	for (i = 0; i < URING_BUFFERS; i++)
+	{
+		if (posix_memalign((void **)&g_buffers[i].data, 4096, URING_BUFFER_SIZE) != 0)
+		{
+			g_buffers[i].data = NULL;
+			ReleaseRing();
+			return 0;
+		}
+		g_buffers[i].used = 0;
+		g_buffers[i].inFlight = 0;
+		iov[i].iov_base = g_buffers[i].data;
+		iov[i].iov_len = URING_BUFFER_SIZE;
+	}
+
+	// registered buffers save the page pinning on every write, RLIMIT_MEMLOCK may refuse them
+	g_fixedBuffers = (syscall(__NR_io_uring_register, g_ringFd, IORING_REGISTER_BUFFERS, iov, URING_BUFFERS) == 0) ? 1 : 0;
+	g_current = 0;
+
+	return 1;
+}
+
+static void ReleaseRing(void)
+{
+	int i;
+
+	if (g_sqes != NULL)
+	{
+		(void)munmap(g_sqes, g_sqesSize);
+		g_sqes = NULL;
+	}
+	if (g_cqRing != NULL && g_cqRing != g_sqRing)
+	{
+		(void)munmap(g_cqRing, g_cqRingSize);
+	}
+	g_cqRing = NULL;
+	if (g_sqRing != NULL)
+	{
+		(void)munmap(g_sqRing, g_sqRingSize);
+		g_sqRing = NULL;
+	}
+	if (g_ringFd >= 0)
+	{
+		close(g_ringFd);
+		g_ringFd = -1;
+	}
+
+	for (i = 0; i < URING_BUFFERS; i++)
+	{
+		free(g_buffers[i].data);
+		g_buffers[i].data = NULL;
+	}
+	g_fixedBuffers = 0;
+}
+
+static struct io_uring_sqe *GetSqe(void)
+{
+	unsigned int tail = *g_sqTail;
+	struct io_uring_sqe *sqe;
+
+	// at most one write per buffer and one sync are queued, far below URING_ENTRIES
+	sqe = &g_sqes[tail & *g_sqMask];
+	memset(sqe, 0x00, sizeof(*sqe));
+	g_sqArray[tail & *g_sqMask] = tail & *g_sqMask;
+
+	return sqe;
+}
+
+static int Enter(unsigned int toSubmit, unsigned int minComplete)
+{
+	int ret;
+
+	if (toSubmit > 0U)
+	{
+		__atomic_store_n(g_sqTail, *g_sqTail + toSubmit, __ATOMIC_RELEASE);
+		if (pthread_getspecific(g_submitterKey) == NULL)
+		{
+			(void)pthread_setspecific(g_submitterKey, (void *)1);
+		}
+	}
+
+	do
+	{
+		ret = (int)syscall(__NR_io_uring_enter, g_ringFd, toSubmit, minComplete,
+						   (minComplete > 0U) ? IORING_ENTER_GETEVENTS : 0U, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret;
+}
+
+static void SubmitWrite(int index)
+{
+	UringBuffer *buffer = &g_buffers[index];
+	struct io_uring_sqe *sqe = GetSqe();
+
+	if (buffer->inFlight == 0)
+	{
+		buffer->offset = g_offset;
+		buffer->done = 0;
+		g_offset += buffer->used;
+		g_current = (index + 1) % URING_BUFFERS;
+	}
+
+	sqe->opcode = (g_fixedBuffers != 0) ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->fd = g_fd;
+	sqe->addr = (unsigned long long)(unsigned long)(buffer->data + buffer->done);
+	sqe->len = buffer->used - buffer->done;
+	sqe->off = (unsigned long long)(buffer->offset + buffer->done);
+	sqe->buf_index = (unsigned short)index;
+	sqe->user_data = (unsigned long long)index;
+	buffer->inFlight = 1;
+	g_dirty = 1;
+
+	(void)Enter(1, 0);
+}
+
+static void SubmitSync(void)
+{
+	struct io_uring_sqe *sqe = GetSqe();
+
+	// drained, so the sync covers every write queued before it
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->flags = IOSQE_IO_DRAIN;
+	sqe->fd = g_fd;
+	sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	sqe->user_data = URING_FSYNC_TAG;
+	g_syncInFlight = 1;
+	g_dirty = 0;
+
+	(void)Enter(1, 0);
+}
+
+static void ReapCompletions(unsigned int minComplete)
+{
+	if (minComplete > 0U)
+	{
+		(void)Enter(0, minComplete);
+	}
+	ReadCompletions();
+
+	// the writes behind a lost one would leave a hole, wait for them and cut the file back
+	if (g_failedOffset >= 0)
+	{
+		while (InFlightCount() > 0)
+		{
+			(void)Enter(0, 1);
+			ReadCompletions();
+		}
+		RollBack();
+	}
+}
+
+static void ReadCompletions(void)
+{
+	unsigned int head;
+	unsigned int tail;
+
+	head = *g_cqHead;
+	tail = __atomic_load_n(g_cqTail, __ATOMIC_ACQUIRE);
+	while (head != tail)
+	{
+		const struct io_uring_cqe *cqe = &g_cqes[head & *g_cqMask];
+
+		if (cqe->user_data == URING_FSYNC_TAG)
+		{
+			g_syncInFlight = 0;
+		}
+		else if (cqe->user_data < URING_BUFFERS)
+		{
+			UringBuffer *buffer = &g_buffers[cqe->user_data];
+
+			if (cqe->res > 0)
+			{
+				buffer->done += (unsigned int)cqe->res;
+			}
+			else if (buffer->done < buffer->used)
+			{
+				fprintf(stderr, "%s: write failed, %s\n", __func__, (cqe->res < 0) ? strerror(-cqe->res) : "nothing written");
+				if (g_failedOffset < 0 || buffer->offset + buffer->done < g_failedOffset)
+				{
+					g_failedOffset = buffer->offset + buffer->done;
+				}
+			}
+
+			if (buffer->done < buffer->used && cqe->res > 0)
+			{
+				// still in flight, the rest goes out right behind the confirmed part
+				SubmitWrite((int)cqe->user_data);
+			}
+			else
+			{
+				buffer->inFlight = 0;
+				buffer->used = 0;
+			}
+		}
+		head++;
+	}
+	__atomic_store_n(g_cqHead, head, __ATOMIC_RELEASE);
+}
+
+static void RollBack(void)
+{
+	fprintf(stderr, "%s: %lld bytes lost\n", __func__, g_offset - g_failedOffset);
+	if (ftruncate(g_fd, (off_t)g_failedOffset) != 0)
+	{
+		fprintf(stderr, "%s: truncate failed, %s\n", __func__, strerror(errno));
+	}
+	g_offset = g_failedOffset;
+	g_failedOffset = -1;
+}
+
+static int InFlightCount(void)
+{
+	int count = 0;
+	int i;
+
+	for (i = 0; i < URING_BUFFERS; i++)
+	{
+		count += g_buffers[i].inFlight;
+	}
+
+	return count;
+}
+
+static void DrainOnExit(void *value)
+{
+	pthread_mutex_t *mutex = TCLogMutex();
+
+	(void)value;
+
+	// requests still queued for an exiting thread are cancelled by the kernel
+	(void)pthread_mutex_lock(mutex);
+	if (g_ringFd >= 0)
+	{
+		while (InFlightCount() > 0 || g_syncInFlight != 0)
+		{
+			ReapCompletions(1);
+		}
+	}
+	(void)pthread_mutex_unlock(mutex);
+}
+
+// a quiet process makes no log call that would submit the lines gathered behind a write or the periodic sync
+static void StartFlusher(void)
+{
+	g_flusherRun = 1;
+	if (pthread_create(&g_flusherThread, NULL, FlusherThread, NULL) != 0)
+	{
+		fprintf(stderr, "%s: create uring flusher thread failed\n", __func__);
+		g_flusherRun = 0;
+	}
+}
+
+// called with TCLogMutex() held, the flusher never blocks on it
+static void StopFlusher(void)
+{
+	if (g_flusherRun != 0)
+	{
+		(void)pthread_mutex_lock(&g_flusherMutex);
+		g_flusherRun = 0;
+		(void)pthread_cond_signal(&g_flusherCond);
+		(void)pthread_mutex_unlock(&g_flusherMutex);
+		(void)pthread_join(g_flusherThread, NULL);
+	}
+}
+
+static void *FlusherThread(void *arg)
+{
+	pthread_mutex_t *mutex = TCLogMutex();
+	struct timespec ts;
+	long msec;
+
+	(void)arg;
+
+	(void)pthread_mutex_lock(&g_flusherMutex);
+	while (g_flusherRun != 0)
+	{
+		msec = (long)g_syncIntervalMs;
+		(void)clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += msec / 1000;
+		ts.tv_nsec += (msec % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		(void)pthread_cond_timedwait(&g_flusherCond, &g_flusherMutex, &ts);
+
+		if (g_flusherRun != 0)
+		{
+			(void)pthread_mutex_unlock(&g_flusherMutex);
+			// a busy log mutex means a writer is submitting right now
+			if (pthread_mutex_trylock(mutex) == 0)
+			{
+				TCLogUringSubmit(0);
+				(void)pthread_mutex_unlock(mutex);
+			}
+			(void)pthread_mutex_lock(&g_flusherMutex);
+		}
+	}
+	(void)pthread_mutex_unlock(&g_flusherMutex);
+
+	// TCLogUringShutdown() drained the ring before stopping this thread and holds the log mutex
+	(void)pthread_setspecific(g_submitterKey, NULL);
+
+	return NULL;
+}
+
+static long GetMonotonicMs(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+	return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+#else // HAVE_IO_URING
+
+// built without <linux/io_uring.h>, TCLogSetUringFile() keeps the stdio output
+int TCLogUringAvailable(void)
+{
+	return 0;
+}
+
+int TCLogUringOpen(const char *path)
+{
+	(void)path;
+	return 0;
+}
+
+int TCLogUringIsOpen(void)
+{
+	return 0;
+}
+
+long TCLogUringFileBytes(void)
+{
+	return 0;
+}
+
+int TCLogUringWrite(const char *text, unsigned int length)
+{
+	(void)text;
+	(void)length;
+	return 0;
+}
+
+void TCLogUringSubmit(int sync)
+{
+	(void)sync;
+}
+
+void TCLogUringSetSyncInterval(unsigned int msec)
+{
+	(void)msec;
+}
+
+void TCLogUringClose(void)
+{
+}
+
+void TCLogUringShutdown(void)
+{
+}
+
+#endif // HAVE_IO_URING
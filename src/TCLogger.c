@@ -0,0 +1,501 @@
+/****************************************************************************************
+ *   FileName    : TCLogger.c
+ *   Description : TCLogger instances, each with its own files, level, prefix and lock
+ ****************************************************************************************
+ *
+ *   TCC Version 1.0
+ *   Copyright (c) Telechips Inc.
+ *   All rights reserved 
+ 
+This source code contains confidential information of Telechips.
+Any unauthorized use without a written permission of Telechips including not limited 
+to re-distribution in source or binary form is strictly prohibited.
+This source code is provided “AS IS” and nothing contained in this source code 
+shall constitute any express or implied warranty of any kind, including without limitation, 
+any warranty of merchantability, fitness for a particular purpose or non-infringement of any patent, 
+copyright or other third party intellectual property right. 
+No warranty is made, express or implied, regarding the information’s accuracy, 
+completeness, or performance. 
+In no event shall Telechips be liable for any claim, damages or other liability arising from, 
+out of or in connection with this source code or the use in the source code. 
+This source code is provided subject to the terms of a Mutual Non-Disclosure Agreement 
+between Telechips and Company.
+*
+****************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "TCLog.h"
+#include "TCLogInternal.h"
+
+#define MAX_LOG_FILE_SIZE	10485760 // 10 MB
+#define MAX_STRING_SIZE		256
+#define MAX_HEADER_SIZE		(MAX_STRING_SIZE * 2 + 32)
+#define HEX_HEADER_SIZE		512
+#define HEX_TRAILER_SIZE	64
+
+struct TCLogger {
+	pthread_mutex_t mutex;
+	FILE *stream;			// NULL writes the rotated files of fileName
+	FILE *file;
+	char prefix[MAX_STRING_SIZE];
+	char subPrefix[MAX_STRING_SIZE];
+	char fileName[MAX_STRING_SIZE];
+	char filePath[MAX_STRING_SIZE];
+	char headers[TotalTCLogLevels][MAX_HEADER_SIZE];
+	int headerLengths[TotalTCLogLevels];
+	int level;
+	int enable;
+	int useTime;
+	int persistentFile;
+	int fileIndex;
+	int fileHour;
+	int fileDay;
+	long fileBytes;
+};
+
+static int LogLineV(TCLogger *logger, TCLogLevel level, const char *format, va_list va);
+static int FormatLine(TCLogger *logger, char *buffer, size_t size, const TCLogTime *logTime,
+					  TCLogLevel level, const char *format, va_list va);
+static int WriteText(TCLogger *logger, const TCLogTime *logTime, const char *text, unsigned int length);
+static int PrepareFile(TCLogger *logger, const TCLogTime *logTime, unsigned int length);
+static void CloseFile(TCLogger *logger);
+
+// the process wide TCLog* state, every TCLogger* call on it is forwarded there
+static struct TCLogger g_defaultLogger;
+static const char *g_levelNames[TotalTCLogLevels] = {
+	"ERROR",
+	"WARN",
+	"INFO",
+	"DEBUG"
+};
+
+TCLogger *TCLoggerCreate(const char *prefix, const char *subPrefix, int useTime)
+{
+	TCLogger *logger = (TCLogger *)calloc(1, sizeof(TCLogger));
+	int level;
+
+	if (logger == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", __func__);
+	}
+	else if (pthread_mutex_init(&logger->mutex, NULL) != 0)
+	{
+		fprintf(stderr, "%s: pthread_mutex_init failed\n", __func__);
+		free(logger);
+		logger = NULL;
+	}
+	else
+	{
+		if (prefix != NULL)
+		{
+			strncpy(logger->prefix, prefix, MAX_STRING_SIZE - 1);
+		}
+		if (subPrefix != NULL)
+		{
+			strncpy(logger->subPrefix, subPrefix, MAX_STRING_SIZE - 1);
+		}
+
+		for (level = 0; level < TotalTCLogLevels; level++)
+		{
+			if (prefix != NULL && subPrefix != NULL)
+			{
+				logger->headerLengths[level] = snprintf(logger->headers[level], MAX_HEADER_SIZE, "[%s][%s][%s] ",
+														g_levelNames[level], logger->prefix, logger->subPrefix);
+			}
+			else if (prefix != NULL)
+			{
+				logger->headerLengths[level] = snprintf(logger->headers[level], MAX_HEADER_SIZE, "[%s][%s] ",
+														g_levelNames[level], logger->prefix);
+			}
+			else
+			{
+				logger->headerLengths[level] = snprintf(logger->headers[level], MAX_HEADER_SIZE, "[%s][NO NAME] ",
+														g_levelNames[level]);
+			}
+		}
+
+		logger->stream = stdout;
+		logger->level = TCLogLevelInfo;
+		logger->enable = 1;
+		logger->useTime = (useTime != 0);
+		logger->fileHour = -1;
+		logger->fileDay = -1;
+	}
+
+	return logger;
+}
+
+void TCLoggerDestroy(TCLogger *logger)
+{
+	if (logger != NULL && logger != &g_defaultLogger)
+	{
+		(void)pthread_mutex_lock(&logger->mutex);
+		CloseFile(logger);
+		(void)pthread_mutex_unlock(&logger->mutex);
+		(void)pthread_mutex_destroy(&logger->mutex);
+		free(logger);
+	}
+}
+
+TCLogger *TCLoggerDefault(void)
+{
+	return &g_defaultLogger;
+}
+
+FILE *TCLoggerRedirect(TCLogger *logger, FILE *fp)
+{
+	FILE *oldFp;
+
+	if (logger == NULL || logger == &g_defaultLogger)
+	{
+		return TCRedirectLog(fp);
+	}
+
+	(void)pthread_mutex_lock(&logger->mutex);
+	oldFp = logger->stream;
+	logger->stream = fp;
+	(void)pthread_mutex_unlock(&logger->mutex);
+
+	return oldFp;
+}
+
+void TCLoggerSetFileName(TCLogger *logger, const char *name)
+{
+	if (logger == NULL || logger == &g_defaultLogger)
+	{
+		TCLogSetFileName(name);
+	}
+	else if (name != NULL)
+	{
+		(void)pthread_mutex_lock(&logger->mutex);
+		CloseFile(logger);
+		memset(logger->fileName, 0x00, MAX_STRING_SIZE);
+		strncpy(logger->fileName, name, MAX_STRING_SIZE - 1);
+		(void)pthread_mutex_unlock(&logger->mutex);
+	}
+	else
+	{
+		fprintf(stderr, "%s: set file name failed. name is null pointer\n", __func__);
+	}
+}
+
+void TCLoggerSetLevel(TCLogger *logger, int level)
+{
+	if (logger == NULL || logger == &g_defaultLogger)
+	{
+		TCLogSetLevel(level);
+	}
+	else if (level >= TCLogLevelError && level < TotalTCLogLevels)
+	{
+		__atomic_store_n(&logger->level, level, __ATOMIC_RELAXED);
+	}
+	else
+	{
+		fprintf(stderr, "%s: set log level failed\n", __func__);
+	}
+}
+
+void TCLoggerSetPersistentFile(TCLogger *logger, int enable)
+{
+	if (logger == NULL || logger == &g_defaultLogger)
+	{
+		TCLogSetPersistentFile(enable);
+	}
+	else
+	{
+		(void)pthread_mutex_lock(&logger->mutex);
+		logger->persistentFile = (enable != 0);
+		if (logger->persistentFile == 0)
+		{
+			CloseFile(logger);
+		}
+		(void)pthread_mutex_unlock(&logger->mutex);
+	}
+}
+
+void TCLoggerEnable(TCLogger *logger, int enable)
+{
+	if (logger == NULL || logger == &g_defaultLogger)
+	{
+		TCEnableLog(enable);
+	}
+	else
+	{
+		__atomic_store_n(&logger->enable, (enable != 0), __ATOMIC_RELAXED);
+	}
+}
+
+int TCLoggerLog(TCLogger *logger, TCLogLevel level, const char *format, ...)
+{
+	int printLog;
+	va_list va;
+
+	va_start(va, format);
+	if (logger == NULL || logger == &g_defaultLogger)
+	{
+		printLog = TCLogV(level, format, va);
+	}
+	else
+	{
+		printLog = LogLineV(logger, level, format, va);
+	}
+	va_end(va);
+
+	return printLog;
+}
+
+int TCLoggerHex(TCLogger *logger, TCLogLevel level, const void *buffer, unsigned int length, const char *title)
+{
+	const unsigned char *bufp = (const unsigned char *)buffer;
+	unsigned int shown;
+	TCLogTime logTime;
+	char *dump;
+	size_t size;
+	int used;
+	int printLog = 0;
+	unsigned int i;
+
+	if (logger == NULL || logger == &g_defaultLogger)
+	{
+		return TCLogHex(level, buffer, length, title);
+	}
+
+	if (__atomic_load_n(&logger->enable, __ATOMIC_RELAXED) == 0 || level < TCLogLevelError ||
+		(int)level > __atomic_load_n(&logger->level, __ATOMIC_RELAXED))
+	{
+		return 0;
+	}
+
+	shown = TCLogHexShownBytes(length);
+	size = HEX_HEADER_SIZE + ((size_t)shown / 16 + 1) * TCLogHexRowSize() + HEX_TRAILER_SIZE;
+	dump = (char *)malloc(size);
+	if (dump != NULL)
+	{
+		used = snprintf(dump, HEX_HEADER_SIZE, "\n    %s%sHEXDUMP [%u BYTES]\n             | 00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F\n"
+						"    ---------+------------------------------------------------",
+						title != NULL ? title : "", title != NULL ? " " : "", length);
+		if (used >= HEX_HEADER_SIZE)
+		{
+			used = HEX_HEADER_SIZE - 1;
+		}
+
+		for (i = 0; i < shown; i += 16)
+		{
+			used += (int)TCLogHexFormatRow(dump + used, bufp + i, (shown - i < 16) ? shown - i : 16, i);
+		}
+
+		if (shown < length)
+		{
+			used += snprintf(dump + used, size - used, "\n    ... %u of %u bytes shown", shown, length);
+		}
+		used += snprintf(dump + used, size - used, "\n\n");
+
+		TCLogGetTime(&logTime);
+		(void)pthread_mutex_lock(&logger->mutex);
+		printLog = WriteText(logger, &logTime, dump, (unsigned int)used);
+		(void)pthread_mutex_unlock(&logger->mutex);
+		free(dump);
+	}
+
+	return printLog;
+}
+
+static int LogLineV(TCLogger *logger, TCLogLevel level, const char *format, va_list va)
+{
+	TCLogTime logTime;
+	char lineBuffer[TC_LOG_LINE_SIZE];
+	char *text = lineBuffer;
+	int length;
+	int printLog = 0;
+	va_list copy;
+
+	if (__atomic_load_n(&logger->enable, __ATOMIC_RELAXED) == 0 || level < TCLogLevelError ||
+		(int)level > __atomic_load_n(&logger->level, __ATOMIC_RELAXED))
+	{
+		return 0;
+	}
+
+	TCLogGetTime(&logTime);
+
+	va_copy(copy, va);
+	length = FormatLine(logger, lineBuffer, sizeof(lineBuffer), &logTime, level, format, copy);
+	va_end(copy);
+
+	if (length >= (int)sizeof(lineBuffer))
+	{
+		text = (char *)malloc((size_t)length + 1);
+		if (text != NULL)
+		{
+			va_copy(copy, va);
+			(void)FormatLine(logger, text, (size_t)length + 1, &logTime, level, format, copy);
+			va_end(copy);
+		}
+		else
+		{
+			text = lineBuffer;
+			length = (int)sizeof(lineBuffer) - 1;
+		}
+	}
+
+	if (length > 0)
+	{
+		(void)pthread_mutex_lock(&logger->mutex);
+		printLog = WriteText(logger, &logTime, text, (unsigned int)length);
+		(void)pthread_mutex_unlock(&logger->mutex);
+	}
+
+	if (text != lineBuffer)
+	{
+		free(text);
+	}
+
+	return printLog;
+}
+
+static int FormatLine(TCLogger *logger, char *buffer, size_t size, const TCLogTime *logTime,
+					  TCLogLevel level, const char *format, va_list va)
+{
+	int length = 0;
+	int ret;
+
+	if (logger->useTime != 0)
+	{
+		length += TCLogFormatTime(buffer, size, logTime);
+	}
+
+	if ((size_t)(length + logger->headerLengths[level]) < size)
+	{
+		memcpy(buffer + length, logger->headers[level], (size_t)logger->headerLengths[level]);
+	}
+	length += logger->headerLengths[level];
+
+	ret = TCLogFormatMessage(buffer + length, ((size_t)length < size) ? size - length : 0, format, va);
+	if (ret > 0)
+	{
+		length += ret;
+	}
+
+	return length;
+}
+
+static int WriteText(TCLogger *logger, const TCLogTime *logTime, const char *text, unsigned int length)
+{
+	int written = 0;
+
+	if (logger->stream != NULL)
+	{
+		written = (fwrite(text, 1, length, logger->stream) == length) ? 1 : 0;
+		fflush(logger->stream);
+	}
+	else if (PrepareFile(logger, logTime, length) != 0)
+	{
+		written = (fwrite(text, 1, length, logger->file) == length) ? 1 : 0;
+		logger->fileBytes += length;
+
+		if (logger->persistentFile != 0)
+		{
+			fflush(logger->file);
+		}
+		else
+		{
+			CloseFile(logger);
+		}
+	}
+
+	return written;
+}
+
+static int PrepareFile(TCLogger *logger, const TCLogTime *logTime, unsigned int length)
+{
+	char closedPath[MAX_STRING_SIZE];
+	char archivePath[MAX_STRING_SIZE + 4];
+	int pathLength;
+	int tries;
+
+	if (logger->file != NULL && (logger->fileHour != logTime->hour || logger->fileDay != logTime->day))
+	{
+		CloseFile(logger);
+	}
+	else if (logger->file != NULL && logger->fileBytes + (long)length > MAX_LOG_FILE_SIZE)
+	{
+		CloseFile(logger);
+		logger->fileIndex++;
+	}
+
+	for (tries = 0; tries < 16 && logger->file == NULL; tries++)
+	{
+		if (logger->fileName[0] == '\0' || TCLogBudgetMayWrite() == 0)
+		{
+			break;
+		}
+
+		if (logger->fileHour != logTime->hour || logger->fileDay != logTime->day)
+		{
+			logger->fileHour = logTime->hour;
+			logger->fileDay = logTime->day;
+			logger->fileIndex = 0;
+		}
+
+		memcpy(closedPath, logger->filePath, MAX_STRING_SIZE);
+		for (;;)
+		{
+			pathLength = snprintf(logger->filePath, MAX_STRING_SIZE, "%s-%d%02d%02d%02d_%d.log", logger->fileName,
+								  logTime->year, logTime->month, logTime->day, logTime->hour, logger->fileIndex);
+			if (pathLength < 0 || pathLength >= MAX_STRING_SIZE)
+			{
+				break;
+			}
+
+			// an archive left by an earlier run within this hour keeps its index
+			snprintf(archivePath, sizeof(archivePath), "%s.gz", logger->filePath);
+			if (access(archivePath, F_OK) != 0)
+			{
+				break;
+			}
+			logger->fileIndex++;
+		}
+		if (pathLength < 0 || pathLength >= MAX_STRING_SIZE)
+		{
+			fprintf(stderr, "%s: file name %s is too long\n", __func__, logger->fileName);
+			memcpy(logger->filePath, closedPath, MAX_STRING_SIZE);
+			break;
+		}
+		if (closedPath[0] != '\0' && strcmp(closedPath, logger->filePath) != 0)
+		{
+			TCLogCompressClosedFile(closedPath);
+			TCLogBudgetKick();
+		}
+
+		logger->file = fopen(logger->filePath, "a");
+		if (logger->file == NULL)
+		{
+			fprintf(stderr, "%s: open %s failed\n", __func__, logger->filePath);
+			break;
+		}
+
+		// an earlier run may have filled this index already
+		logger->fileBytes = ftell(logger->file);
+		if (logger->fileBytes > 0 && logger->fileBytes + (long)length > MAX_LOG_FILE_SIZE)
+		{
+			CloseFile(logger);
+			logger->fileIndex++;
+		}
+	}
+
+	return (logger->file != NULL) ? 1 : 0;
+}
+
+static void CloseFile(TCLogger *logger)
+{
+	if (logger->file != NULL)
+	{
+		fclose(logger->file);
+		logger->file = NULL;
+	}
+}